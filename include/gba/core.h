@@ -29,6 +29,19 @@ enum core_states {
     CORE_STOP = 2,
 };
 
+/*
+** The register banks. USR and SYS share the same one.
+*/
+enum core_banks {
+    BANK_USR = 0,
+    BANK_FIQ,
+    BANK_IRQ,
+    BANK_SVC,
+    BANK_ABT,
+    BANK_UND,
+    BANK_LEN,
+};
+
 struct psr {
     union {
         struct {
@@ -46,6 +59,42 @@ struct psr {
     };
 } __packed;
 
+/*
+** The kind of the last flag-setting operation.
+*/
+enum core_flags_kind {
+    FLAGS_SYNCED = 0,   // `cpsr` holds the condition flags
+    FLAGS_LOGICAL,      // N and Z come from `res`, C from `carry` and V from `cpsr`
+    FLAGS_ADD,          // N, Z, C and V come from `res = op1 + op2 (+ carry)`
+    FLAGS_SUB,          // N, Z, C and V come from `res = op1 - op2 (- !carry)`
+};
+
+/*
+** The condition flags are evaluated lazily: flag-setting instructions only
+** record their operands and result, and the flags are computed when something
+** actually needs them.
+**
+** For additions and subtractions, the carry-in is recovered from `res`, `op1`
+** and `op2`, so ADC/SBC/RSC don't need any extra field.
+*/
+struct core_flags {
+    enum core_flags_kind kind;
+    uint32_t res;
+    uint32_t op1;
+    uint32_t op2;
+    bool carry;
+};
+
+/*
+** The liveness of the condition flags set by an instruction in ROM, as computed
+** by `core_flags_analyze_rom()`.
+*/
+enum core_flags_liveness {
+    FLAGS_NOT_SET = 0,  // The instruction doesn't set any flag, or wasn't analyzed
+    FLAGS_LIVE,         // The flags it sets may be read
+    FLAGS_DEAD,         // The flags it sets are all overwritten before being read
+};
+
 struct dma_channel;
 
 struct core {
@@ -71,55 +120,45 @@ struct core {
         uint32_t registers[16];
     };
 
-    union {
-        struct {
-            uint32_t r8_sys;
-            uint32_t r9_sys;
-            uint32_t r10_sys;
-            uint32_t r11_sys;
-            uint32_t r12_sys;
-            uint32_t r13_sys;
-            uint32_t r14_sys;
-            struct psr spsr_sys;
-
-            uint32_t r8_fiq;
-            uint32_t r9_fiq;
-            uint32_t r10_fiq;
-            uint32_t r11_fiq;
-            uint32_t r12_fiq;
-            uint32_t r13_fiq;
-            uint32_t r14_fiq;
-            struct psr spsr_fiq;
-
-            uint32_t r13_svc;
-            uint32_t r14_svc;
-            struct psr spsr_svc;
-
-            uint32_t r13_abt;
-            uint32_t r14_abt;
-            struct psr spsr_abt;
-
-            uint32_t r13_irq;
-            uint32_t r14_irq;
-            struct psr spsr_irq;
-
-            uint32_t r13_und;
-            uint32_t r14_und;
-            struct psr spsr_und;
-        } __packed;
-        uint32_t bank_registers[28];
-    };
-
     uint32_t prefetch[2];                   // The next instruction to be executed
     enum access_type prefetch_access_type;
 
-    struct psr cpsr;
+    struct psr cpsr;                        // The condition flags are only valid after `core_flags_sync()`
+    struct core_flags flags;                // The last flag-setting operation, see `struct core_flags`
 
     enum core_states state;                 // 0=Run, 1=Halt, 2=Stop
 
+    bool pending_irq;                       // (IE & IF) != 0. Wakes the core up when halted.
+    bool irq_line;                          // An IRQ is pending and is masked by neither IME nor CPSR.I
+
     uint64_t cycles;                        // Amount of cycles spent by the CPU since initialization
+    uint64_t target_cycles;                 // Cycle budget of the threaded interpreter
+
+    uint64_t flags_set;                     // Flag-setting instructions executed from ROM
+    uint64_t flags_elided;                  // Among them, the ones whose flags were dead and not computed
 
     struct dma_channel *current_dma;        // The DMA the core is currently waiting for. Can be NULL.
+
+    /*
+    ** Everything below is only used on mode switches, and is kept out of the cache
+    ** lines touched by every instruction.
+    */
+
+    /*
+    ** The banked registers.
+    **
+    ** r8-r12 are only banked in FIQ mode, and r13-r14 in all modes except SYS,
+    ** which shares the USR bank. See `core_switch_mode()`.
+    */
+    uint32_t bank_r8_r12[2][5];             // Indexed by `bank == BANK_FIQ`
+    uint32_t bank_r13_r14[BANK_LEN][2];     // Indexed by `enum core_banks`
+    struct psr spsr[BANK_LEN];              // Indexed by `enum core_banks`. The USR entry is unused.
+
+#ifdef WITH_THUMB_PAIR_PROFILING
+    /* The previous Thumb instruction executed from ROM, see `core_thumb_profile_pair()`. */
+    uint32_t profile_last_addr;
+    size_t profile_last_insn;
+#endif
 };
 
 /*
@@ -190,6 +229,22 @@ enum arm_irq {
     IRQ_GAMEPAK         = 0xD,
 };
 
+/*
+** The register bank of all modes, indexed by the mode bits of the CPSR.
+**
+** Invalid modes are mapped to `BANK_LEN`.
+*/
+static uint8_t const core_mode_banks[32] = {
+    [0 ... 31]          = BANK_LEN,
+    [MODE_USR]          = BANK_USR,
+    [MODE_FIQ]          = BANK_FIQ,
+    [MODE_IRQ]          = BANK_IRQ,
+    [MODE_SVC]          = BANK_SVC,
+    [MODE_ABT]          = BANK_ABT,
+    [MODE_UND]          = BANK_UND,
+    [MODE_SYS]          = BANK_USR,
+};
+
 /*
 ** The user-friendly name of all modes.
 */
@@ -203,6 +258,300 @@ static char const * const arm_modes_name[] = {
     [MODE_SYS]          = "sys"
 };
 
+/*
+** Return the carry flag.
+*/
+static inline
+bool
+core_flags_carry(
+    struct core const *core
+) {
+    switch (core->flags.kind) {
+        case FLAGS_LOGICAL:     return (core->flags.carry);
+        case FLAGS_ADD:         return (uadd32(core->flags.op1, core->flags.op2, core->flags.res - core->flags.op1 - core->flags.op2));
+        case FLAGS_SUB:         return (usub32(core->flags.op1, core->flags.op2, core->flags.op1 - core->flags.op2 - core->flags.res));
+        default:                return (core->cpsr.carry);
+    }
+}
+
+/*
+** Return the overflow flag.
+*/
+static inline
+bool
+core_flags_overflow(
+    struct core const *core
+) {
+    switch (core->flags.kind) {
+        case FLAGS_ADD:         return (iadd32(core->flags.op1, core->flags.op2, core->flags.res - core->flags.op1 - core->flags.op2));
+        case FLAGS_SUB:         return (isub32(core->flags.op1, core->flags.op2, core->flags.op1 - core->flags.op2 - core->flags.res));
+        default:                return (core->cpsr.overflow);
+    }
+}
+
+/*
+** Return the condition flags, packed as NZCV.
+*/
+static inline
+uint32_t
+core_flags_nzcv(
+    struct core const *core
+) {
+    if (core->flags.kind == FLAGS_SYNCED) {
+        return (core->cpsr.raw >> 28);
+    }
+
+    return (
+          ((core->flags.res >> 31) << 3)
+        | ((uint32_t)!core->flags.res << 2)
+        | ((uint32_t)core_flags_carry(core) << 1)
+        | ((uint32_t)core_flags_overflow(core) << 0)
+    );
+}
+
+/*
+** Write the condition flags back to `cpsr`.
+**
+** This must be called before reading or writing the condition flags of `cpsr`
+** directly, or before copying it (exceptions, MRS, savestates, etc.).
+*/
+static inline
+void
+core_flags_sync(
+    struct core *core
+) {
+    if (core->flags.kind != FLAGS_SYNCED) {
+        core->cpsr.raw = (core->cpsr.raw & 0x0FFFFFFF) | (core_flags_nzcv(core) << 28);
+        core->flags.kind = FLAGS_SYNCED;
+    }
+}
+
+/*
+** Record an operation setting N and Z according to `res`, C to `carry` and
+** leaving V untouched.
+*/
+static inline
+void
+core_flags_logical(
+    struct core *core,
+    uint32_t res,
+    bool carry
+) {
+    if (core->flags.kind == FLAGS_ADD || core->flags.kind == FLAGS_SUB) {
+        core->cpsr.overflow = core_flags_overflow(core);
+    }
+
+    core->flags.kind = FLAGS_LOGICAL;
+    core->flags.res = res;
+    core->flags.carry = carry;
+}
+
+/*
+** Record an operation setting N and Z according to `res` and leaving C and V
+** untouched.
+*/
+static inline
+void
+core_flags_nz(
+    struct core *core,
+    uint32_t res
+) {
+    core_flags_logical(core, res, core_flags_carry(core));
+}
+
+/*
+** Record the addition `res = op1 + op2 (+ carry)`.
+*/
+static inline
+void
+core_flags_add(
+    struct core *core,
+    uint32_t op1,
+    uint32_t op2,
+    uint32_t res
+) {
+    core->flags.kind = FLAGS_ADD;
+    core->flags.res = res;
+    core->flags.op1 = op1;
+    core->flags.op2 = op2;
+}
+
+/*
+** Record the subtraction `res = op1 - op2 (- !carry)`.
+*/
+static inline
+void
+core_flags_sub(
+    struct core *core,
+    uint32_t op1,
+    uint32_t op2,
+    uint32_t res
+) {
+    core->flags.kind = FLAGS_SUB;
+    core->flags.res = res;
+    core->flags.op1 = op1;
+    core->flags.op2 = op2;
+}
+
+/*
+** Return the liveness of the flags set by the instruction at `addr`.
+**
+** Only instructions in ROM are analyzed, everything else (including what lies past
+** the end of the ROM) is `FLAGS_NOT_SET`.
+*/
+static inline
+enum core_flags_liveness
+core_flags_liveness(
+    struct memory const *memory,
+    uint32_t addr,
+    bool thumb
+) {
+    uint32_t idx;
+
+    if (
+           (addr >> 24) < CART_REGION_START
+        || (addr >> 24) > CART_REGION_END
+        || (addr & CART_MASK) >= memory->rom_size
+    ) {
+        return (FLAGS_NOT_SET);
+    }
+
+    if (thumb) {
+        return (memory->rom_thumb_insns[(addr & CART_MASK) >> 1] & 0b11);
+    }
+
+    idx = (addr & CART_MASK) >> 2;
+    return ((memory->rom_arm_flags[idx >> 2] >> ((idx & 0b11) * 2)) & 0b11);
+}
+
+/*
+** Return the index, plus one, in `thumb_fused_insns` of the pair starting with the
+** Thumb instruction at `addr`, or 0 if it doesn't start a fused pair.
+*/
+static inline
+uint32_t
+core_thumb_fused(
+    struct memory const *memory,
+    uint32_t addr
+) {
+    if (
+           (addr >> 24) < CART_REGION_START
+        || (addr >> 24) > CART_REGION_END
+        || (addr & CART_MASK) >= memory->rom_size
+    ) {
+        return (0);
+    }
+
+    return (memory->rom_thumb_insns[(addr & CART_MASK) >> 1] >> 2);
+}
+
+/*
+** Shift `value` by the immediate amount `bits`, following the encoding used by
+** instructions with an immediate shift amount: LSR#0 and ASR#0 encode a shift
+** by 32 and ROR#0 encodes RRX.
+**
+** `type` is usually known at compile time, removing the switch entirely.
+*/
+static inline
+uint32_t
+core_shift_imm(
+    struct core const *core,
+    uint32_t type,
+    uint32_t bits,
+    uint32_t value,
+    bool *carry
+) {
+    switch (type) {
+        case 0: { // LSL
+            if (bits) {
+                *carry = (value >> (32 - bits)) & 0b1;
+                value <<= bits;
+            }
+            break;
+        };
+        case 1: { // LSR
+            if (bits) {
+                *carry = (value >> (bits - 1)) & 0b1;
+                value >>= bits;
+            } else {
+                *carry = value >> 31;
+                value = 0;
+            }
+            break;
+        };
+        case 2: { // ASR
+            if (bits) {
+                *carry = (value >> (bits - 1)) & 0b1;
+                value = (int32_t)value >> bits;
+            } else {
+                *carry = value >> 31;
+                value = (int32_t)value >> 31;
+            }
+            break;
+        };
+        case 3: { // ROR
+            if (bits) {
+                *carry = (value >> (bits - 1)) & 0b1;
+                value = ror32(value, bits);
+            } else {
+                bool old_carry;
+
+                old_carry = core_flags_carry(core);
+                *carry = value & 0b1;
+                value = (value >> 1) | (old_carry << 31);
+            }
+            break;
+        };
+    }
+    return (value);
+}
+
+/*
+** Get the SPSR of the given mode.
+**
+** USR and SYS have no SPSR, the CPSR is returned instead.
+*/
+static inline
+struct psr
+core_spsr_get(
+    struct core const *core,
+    enum arm_modes mode
+) {
+    uint32_t bank;
+
+    bank = core_mode_banks[mode & 0x1F];
+    if (likely(bank != BANK_USR && bank != BANK_LEN)) {
+        return (core->spsr[bank]);
+    } else if (bank == BANK_USR) {
+        return (core->cpsr);
+    }
+    panic(HS_CORE, "core_spsr_get(): unsupported mode (%u)", mode);
+}
+
+/*
+** Set the SPSR of the given mode to the given value.
+**
+** USR and SYS have no SPSR, the CPSR is set instead.
+*/
+static inline
+void
+core_spsr_set(
+    struct core *core,
+    enum arm_modes mode,
+    struct psr psr
+) {
+    uint32_t bank;
+
+    bank = core_mode_banks[mode & 0x1F];
+    if (likely(bank != BANK_USR && bank != BANK_LEN)) {
+        core->spsr[bank].raw = psr.raw;
+    } else if (bank == BANK_USR) {
+        core->cpsr.raw = psr.raw;
+    } else {
+        panic(HS_CORE, "core_spsr_set(): unsupported mode (%u)", mode);
+    }
+}
+
 /* gba/core/core.c */
 void core_init(struct gba *gba);
 void core_run(struct gba *gba);
@@ -210,12 +559,19 @@ void core_next(struct gba *gba);
 void core_idle(struct gba *gba);
 void core_idle_for(struct gba *gba, uint32_t cycles);
 void core_reload_pipeline(struct gba *gba);
-struct psr core_spsr_get(struct core const *core, enum arm_modes mode);
-void core_spsr_set(struct core *core, enum arm_modes mode, struct psr psr);
 void core_switch_mode(struct core *core, enum arm_modes mode);
+void core_exception_return(struct gba *gba);
 uint32_t core_compute_shift(struct core *core, uint32_t encoded_shift, uint32_t value, bool *update_carry);
 
+/* gba/core/liveness.c */
+void core_flags_analyze_rom(struct gba *gba);
+
+/* gba/core/threaded.c */
+void core_run_threaded(struct gba *gba, uint64_t target);
+
 /* gba/core/interrupt.c */
 void core_interrupt(struct gba *gba, enum arm_vectors vector, enum arm_modes mode);
+void core_scan_irq(struct gba *gba);
+void core_trigger_irq(struct gba *gba, enum arm_irq irq);
 
 #endif /* !GBA_CORE_H */
\ No newline at end of file
@@ -15,19 +15,40 @@
 
 struct gba;
 
-struct hs_arm_insn {
-    char const *name;
-    char const *mask;
-    void (*op)(struct gba *gba, uint32_t op);
+/*
+** The different forms the second operand of a data processing instruction can take.
+*/
+enum arm_alu_operand {
+    ARM_ALU_IMM = 0,            // Rotated immediate value
+    ARM_ALU_REG_IMM_LSL,        // Register, shifted by an immediate value
+    ARM_ALU_REG_IMM_LSR,
+    ARM_ALU_REG_IMM_ASR,
+    ARM_ALU_REG_IMM_ROR,
+    ARM_ALU_REG_REG_LSL,        // Register, shifted by a register
+    ARM_ALU_REG_REG_LSR,
+    ARM_ALU_REG_REG_ASR,
+    ARM_ALU_REG_REG_ROR,
+
+    ARM_ALU_OPERAND_LEN,
 };
 
-struct hs_arm_decoded_insn {
-    uint32_t mask;
-    uint32_t value;
+/*
+** The different forms the offset of a single data transfer instruction can take.
+*/
+enum arm_sdt_offset {
+    ARM_SDT_IMM = 0,            // 12-bit immediate value
+    ARM_SDT_REG_LSL,            // Register, shifted by an immediate value
+    ARM_SDT_REG_LSR,
+    ARM_SDT_REG_ASR,
+    ARM_SDT_REG_ROR,
+
+    ARM_SDT_OFFSET_LEN,
 };
 
-extern void (*arm_lut[4096])(struct gba *gba, uint32_t op);
-extern bool cond_lut[256];
+/* Generated by core/decode_gen.c */
+extern void (* const arm_lut[4096])(struct gba *gba, uint32_t op);
+extern void (* const arm_nf_lut[4096])(struct gba *gba, uint32_t op);
+extern bool const cond_lut[256];
 
 /* core/arm/alu.c */
 void core_arm_alu(struct gba *gba, uint32_t op);
@@ -39,9 +60,6 @@ void core_arm_bdt(struct gba *gba, uint32_t op);
 void core_arm_branch(struct gba *gba, uint32_t op);
 void core_arm_branch_xchg(struct gba *gba, uint32_t op);
 
-/* core/arm/core.c */
-void core_arm_decode_insns(void);
-
 /* core/arm/mul.c */
 void core_arm_mul(struct gba *gba, uint32_t op);
 void core_arm_mull(struct gba *gba, uint32_t op);
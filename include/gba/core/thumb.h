@@ -15,34 +15,60 @@
 
 struct gba;
 
-struct hs_thumb_insn {
+struct hs_thumb_fused_insn {
     char const *name;
-    char const *mask;
+    void (*first)(struct gba *gba, uint16_t op);
+    void (*second)(struct gba *gba, uint16_t op);
     void (*op)(struct gba *gba, uint16_t op);
 };
 
-struct hs_thumb_decoded_insn {
-    uint16_t mask;
-    uint16_t value;
-};
+/* Generated by core/decode_gen.c */
+extern void (* const thumb_lut[256])(struct gba *gba, uint16_t op);
+extern void (* const thumb_nf_lut[256])(struct gba *gba, uint16_t op);
+extern uint8_t const thumb_insns_idx[256];      // The index in `thumb/insns.h` of each entry of `thumb_lut`
 
-extern void (*thumb_lut[256])(struct gba *gba, uint16_t op);
+/*
+** Define `core_thumb_<name>()` and its flag-free variant, `core_thumb_<name>_nf()`,
+** out of `core_thumb_<name>_impl()`, whose last argument tells if the condition
+** flags must be updated.
+**
+** The flag-free variant is used when the flags are overwritten before being
+** read, see `core_flags_analyze_rom()`.
+*/
+# define THUMB_FLAGS_HANDLERS(name)                                             \
+    void core_thumb_##name(struct gba *gba, uint16_t op)                        \
+    {                                                                           \
+        core_thumb_##name##_impl(gba, op, true);                                \
+    }                                                                           \
+                                                                                \
+    void core_thumb_##name##_nf(struct gba *gba, uint16_t op)                   \
+    {                                                                           \
+        core_thumb_##name##_impl(gba, op, false);                               \
+    }
 
 /* gba/thumb/alu.c */
 
 void core_thumb_lo_add(struct gba *gba, uint16_t op);
+void core_thumb_lo_add_nf(struct gba *gba, uint16_t op);
 void core_thumb_lo_sub(struct gba *gba, uint16_t op);
+void core_thumb_lo_sub_nf(struct gba *gba, uint16_t op);
 void core_thumb_mov_imm(struct gba *gba, uint16_t op);
+void core_thumb_mov_imm_nf(struct gba *gba, uint16_t op);
 void core_thumb_cmp_imm(struct gba *gba, uint16_t op);
+void core_thumb_cmp_imm_nf(struct gba *gba, uint16_t op);
 void core_thumb_add_imm(struct gba *gba, uint16_t op);
+void core_thumb_add_imm_nf(struct gba *gba, uint16_t op);
 void core_thumb_sub_imm(struct gba *gba, uint16_t op);
+void core_thumb_sub_imm_nf(struct gba *gba, uint16_t op);
 void core_thumb_hi_add(struct gba *gba, uint16_t op);
 void core_thumb_hi_cmp(struct gba *gba, uint16_t op);
+void core_thumb_hi_cmp_nf(struct gba *gba, uint16_t op);
 void core_thumb_hi_mov(struct gba *gba, uint16_t op);
 void core_thumb_add_sp_imm(struct gba *gba, uint16_t op);
 void core_thumb_add_pc_imm(struct gba *gba, uint16_t op);
 void core_thumb_add_sp_s_imm(struct gba *gba, uint16_t op);
 void core_thumb_alu(struct gba *gba, uint16_t op);
+void core_thumb_alu_nf(struct gba *gba, uint16_t op);
 
 /* gba/thumb/branch.c */
 void core_thumb_branch(struct gba *gba, uint16_t op);
@@ -50,25 +76,44 @@ void core_thumb_branch_link(struct gba *gba, uint16_t op);
 void core_thumb_branch_xchg(struct gba *gba, uint16_t op);
 void core_thumb_branch_cond(struct gba *gba, uint16_t op);
 
-/* gba/thumb/gba.c */
-void core_thumb_decode_insns(void);
+/* gba/thumb/core.c */
+void core_thumb_profile_pair(struct gba *gba, uint16_t op);
+void core_thumb_profile_dump(void);
+
+/* gba/thumb/fused.c */
+extern struct hs_thumb_fused_insn const thumb_fused_insns[];
+void core_thumb_fuse_rom(struct gba *gba);
 
 /* gba/thumb/logical.c */
 void core_thumb_lsl(struct gba *gba, uint16_t op);
+void core_thumb_lsl_nf(struct gba *gba, uint16_t op);
 void core_thumb_lsr(struct gba *gba, uint16_t op);
+void core_thumb_lsr_nf(struct gba *gba, uint16_t op);
 void core_thumb_asr(struct gba *gba, uint16_t op);
+void core_thumb_asr_nf(struct gba *gba, uint16_t op);
 
 /* gba/thumb/sdt.c */
 void core_thumb_push(struct gba *gba, uint16_t op);
 void core_thumb_pop(struct gba *gba, uint16_t op);
 void core_thumb_ldmia(struct gba *gba, uint16_t op);
 void core_thumb_stmia(struct gba *gba, uint16_t op);
-void core_thumb_sdt_imm(struct gba *gba, uint16_t op);
-void core_thumb_sdt_h_imm(struct gba *gba, uint16_t op);
-void core_thumb_sdt_wb_reg(struct gba *gba, uint16_t op);
-void core_thumb_sdt_sbh_reg(struct gba *gba, uint16_t op);
+void core_thumb_str_imm(struct gba *gba, uint16_t op);
+void core_thumb_ldr_imm(struct gba *gba, uint16_t op);
+void core_thumb_strb_imm(struct gba *gba, uint16_t op);
+void core_thumb_ldrb_imm(struct gba *gba, uint16_t op);
+void core_thumb_str_reg(struct gba *gba, uint16_t op);
+void core_thumb_ldr_reg(struct gba *gba, uint16_t op);
+void core_thumb_strb_reg(struct gba *gba, uint16_t op);
+void core_thumb_ldrb_reg(struct gba *gba, uint16_t op);
+void core_thumb_strh_imm(struct gba *gba, uint16_t op);
+void core_thumb_ldrh_imm(struct gba *gba, uint16_t op);
+void core_thumb_strh_reg(struct gba *gba, uint16_t op);
+void core_thumb_ldrh_reg(struct gba *gba, uint16_t op);
+void core_thumb_ldrsb_reg(struct gba *gba, uint16_t op);
+void core_thumb_ldrsh_reg(struct gba *gba, uint16_t op);
 void core_thumb_ldr_pc(struct gba *gba, uint16_t op);
-void core_thumb_sdt_sp(struct gba *gba, uint16_t op);
+void core_thumb_str_sp(struct gba *gba, uint16_t op);
+void core_thumb_ldr_sp(struct gba *gba, uint16_t op);
 
 /* gba/thumb/swi.c */
 void core_thumb_swi(struct gba *gba, uint16_t op);
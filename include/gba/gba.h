@@ -45,6 +45,8 @@ enum message_type {
     MESSAGE_AUDIO_RESAMPLE_FREQ,
     MESSAGE_COLOR_CORRECTION,
     MESSAGE_RTC,
+    MESSAGE_SKIP_BIOS,
+    MESSAGE_PPU_WORKER,
 };
 
 enum keyinput {
@@ -88,6 +90,14 @@ struct message_data {
     void (*cleanup)(void *);
 };
 
+/*
+** The reference held on `rom` is transferred to the emulator.
+*/
+struct message_rom {
+    struct message super;
+    struct rom *rom;
+};
+
 struct message_audio_freq {
     struct message super;
     uint64_t refill_frequency;
@@ -103,6 +113,16 @@ struct message_device_state {
     enum device_state state;
 };
 
+struct message_skip_bios {
+    struct message super;
+    bool skip_bios;
+};
+
+struct message_ppu_worker {
+    struct message super;
+    bool enabled;
+};
+
 struct message_queue {
     struct message *messages;
     size_t length;
@@ -113,20 +133,34 @@ struct message_queue {
 
 struct game_entry;
 
+/*
+** The state of an emulated Gameboy Advance.
+**
+** The state touched by every instruction (the core, the scheduler, the IO registers
+** and the head of `struct memory`) comes first and spans a handful of contiguous
+** cache lines. The large and rarely accessed buffers (memory arrays, audio buffer,
+** framebuffers) come last.
+**
+** Use `gba_new()` to allocate it, which aligns it on a `GBA_ALLOC_ALIGN` (2MB) boundary
+** and asks for it to be backed by huge pages.
+*/
 struct gba {
-    enum gba_state state;
-    uint32_t speed;
-
+    /* Hot state */
     struct core core;
-    struct memory memory;
+    struct scheduler scheduler;
     struct io io;
+    struct gpio gpio;
+    struct memory memory;
+
+    /* Accessed once per scanline or per audio sample */
     struct ppu ppu;
     struct apu apu;
-    struct scheduler scheduler;
-    struct gpio gpio;
+
+    enum gba_state state;
+    uint32_t speed;
 
     /* Entry in the game database, if it exists. */
-    struct game_entry *game_entry;
+    struct game_entry const *game_entry;
 
     /* Set to true when the emulation is started. Used to lock some options like backup type. */
     bool started;
@@ -138,18 +172,31 @@ struct gba {
     bool rtc_auto_detect;
     bool rtc_enabled;
 
+    /* Stores if the BIOS intro is skipped on reset, see `gba_skip_bios()`. */
+    bool skip_bios;
+
     /* The message queue used by the frontend to communicate with the emulator. */
     struct message_queue message_queue;
 
+    /* The frame counter, used for FPS calculations. */
+    atomic_uint framecounter;
+
+    /* VRAM and OAM, decoded for the PPU. */
+    struct tile_cache tile_cache;
+    struct sprite_cache sprite_cache;
+
+    /*
+    ** The thread rendering the scanlines, or NULL if they are rendered as the emulation goes.
+    ** Off by default, see `MESSAGE_PPU_WORKER`.
+    */
+    struct ppu_worker *ppu_worker;
+
     /* The emulator's screen as it is being rendered. */
     uint32_t framebuffer[GBA_SCREEN_WIDTH * GBA_SCREEN_HEIGHT];
 
     /* The emulator's screen, refreshed each frame, used by the frontend */
     uint32_t framebuffer_frontend[GBA_SCREEN_WIDTH * GBA_SCREEN_HEIGHT];
     pthread_mutex_t framebuffer_frontend_mutex;
-
-    /* The frame counter, used for FPS calculations. */
-    atomic_uint framecounter;
 };
 
 # define NEW_MESSAGE_KEYINPUT(_key, _pressed)           \
@@ -216,15 +263,13 @@ struct gba {
         .cleanup = (_cleanup),                          \
     }))
 
-# define NEW_MESSAGE_LOAD_ROM(_data, _size, _cleanup)   \
-    ((struct message *)&((struct message_data){         \
+# define NEW_MESSAGE_LOAD_ROM(_rom)                     \
+    ((struct message *)&((struct message_rom){          \
         .super = (struct message){                      \
-            .size = sizeof(struct message_data),        \
+            .size = sizeof(struct message_rom),         \
             .type = MESSAGE_LOAD_ROM,                   \
         },                                              \
-        .data = (_data),                                \
-        .size = (_size),                                \
-        .cleanup = (_cleanup),                          \
+        .rom = (_rom),                                  \
     }))
 
 # define NEW_MESSAGE_BACKUP_TYPE(_type)                 \
@@ -274,9 +319,49 @@ struct gba {
         .state = (_state),                                      \
     }))
 
+# define NEW_MESSAGE_SKIP_BIOS(_skip)                           \
+    ((struct message *)&((struct message_skip_bios){            \
+        .super = (struct message){                              \
+            .size = sizeof(struct message_skip_bios),           \
+            .type = MESSAGE_SKIP_BIOS,                          \
+        },                                                      \
+        .skip_bios = (_skip),                                   \
+    }))
+
+# define NEW_MESSAGE_PPU_WORKER(_enabled)                       \
+    ((struct message *)&((struct message_ppu_worker){           \
+        .super = (struct message){                              \
+            .size = sizeof(struct message_ppu_worker),          \
+            .type = MESSAGE_PPU_WORKER,                         \
+        },                                                      \
+        .enabled = (_enabled),                                  \
+    }))
+
+/*
+** Any number of independent instances can live in the same process:
+**
+**   - `gba_new()` allocates and initializes an instance.
+**   - The frontend configures and drives it by pushing messages with `gba_message_push()`
+**     (`NEW_MESSAGE_LOAD_BIOS()`, `NEW_MESSAGE_LOAD_ROM()`, `NEW_MESSAGE_RESET()`,
+**     `NEW_MESSAGE_RUN()`, etc.).
+**   - `gba_run()` runs the instance on the calling thread until it receives `MESSAGE_EXIT`.
+**   - `gba_delete()` releases it, once `gba_run()` has returned.
+**
+** All the mutable state of an instance lives in its `struct gba`, and the tables shared
+** between instances are immutable once built. An instance must only be run by one thread
+** at a time, but `gba_message_push()` and the access to `framebuffer_frontend` (under
+** `framebuffer_frontend_mutex`) are safe from any thread.
+**
+** The logging settings (`g_verbose`, etc.) are process-wide and must be set before the
+** instances are started.
+*/
+
 /* gba/gba.c */
+struct gba *gba_new(void);
+void gba_delete(struct gba *gba);
 void gba_init(struct gba *gba);
 void gba_run(struct gba *gba);
+bool gba_run_frames(struct gba *gba, uint32_t frames);
 void gba_message_push(struct gba *gba, struct message *message);
 
 #endif /* GBA_GBA_H */
\ No newline at end of file
@@ -11,6 +11,7 @@
 # define GBA_MEMORY_H
 
 # include <stdint.h>
+# include <pthread.h>
 # include "hades.h"
 
 /*
@@ -194,44 +195,92 @@ struct prefetch_buffer {
     bool enabled;
 };
 
+/*
+** A read-only ROM image, shared by all the emulator instances running the same game.
+**
+** The image is mapped from disk whenever possible, so its pages are backed by the
+** page cache and only the parts of the ROM the game actually touches are resident.
+*/
+struct rom {
+    atomic_uint refcount;
+    uint8_t const *data;
+    size_t size;
+    bool mapped;                // `data` maps the file, which must not be truncated (see `mem_rom_open()`)
+
+    // The analysis of the instructions of the ROM (see `struct memory`), made by the first
+    // instance the ROM is loaded in and then shared with the others.
+    pthread_mutex_t analysis_lock;
+    uint8_t *thumb_insns;
+    uint8_t *arm_flags;
+};
+
 /*
 ** The overall memory of the Gameboy Advance.
 */
 struct memory {
-    // General Internal Memory
-    uint8_t bios[BIOS_SIZE];
-    uint8_t ewram[EWRAM_SIZE];
-    uint8_t iwram[IWRAM_SIZE];
+    /*
+    ** The fields accessed by most memory accesses come first, so that they share a few
+    ** cache lines with the rest of the hot state of `struct gba` instead of being lost
+    ** after the memory arrays.
+    */
 
-    // Internal Display Memory
-    uint8_t palram[PALRAM_SIZE];
-    uint8_t vram[VRAM_SIZE];
-    uint8_t oam[OAM_SIZE];
+    // Prefetch
+    struct prefetch_buffer pbuffer;
+
+    // Open Bus
+    uint32_t bios_bus;
+
+    // Set when the cartridge memory bus is in used
+    bool gamepak_bus_in_use;
+
+    // Cycles taken by a 16-bit and 32-bit access to each region, indexed by
+    // `enum access_type` and the upper byte of the address. See `mem_update_waitstates()`.
+    uint32_t access_time16[2][16];
+    uint32_t access_time32[2][16];
 
     // External Memory (Game Pak)
-    uint8_t rom[CART_SIZE];
+    // Reads past `rom_size` return the ROM open bus, see `mem_rom_openbus_read()`.
+    struct rom *rom_image;
+    uint8_t const *rom;
     size_t rom_size;
 
+    // What is known about each Thumb instruction of the ROM: the liveness of the flags
+    // it sets (bits 0-1, see `core_flags_analyze_rom()`) and the fused handler of the pair
+    // it starts (bits 2-7, see `core_thumb_fuse_rom()`).
+    // One byte per half-word of the ROM. Owned by `rom_image`.
+    uint8_t *rom_thumb_insns;
+
+    // Liveness of the flags set by each ARM instruction of the ROM, two bits per instruction.
+    // One byte per four words of the ROM. Owned by `rom_image`.
+    uint8_t *rom_arm_flags;
+
     // Backup Storage
     uint8_t *backup_storage_data;
     enum backup_storage backup_storage_type;
     enum backup_storage_source backup_storage_source;
     atomic_bool backup_storage_dirty;
 
+    // EEPROM memory
+    struct eeprom eeprom;
+
     // Flash memory
     struct flash flash;
 
-    // EEPROM memory
-    struct eeprom eeprom;
+    // General Internal Memory
+    uint8_t bios[BIOS_SIZE];
+    uint8_t ewram[EWRAM_SIZE];
+    uint8_t iwram[IWRAM_SIZE];
 
-    // Prefetch
-    struct prefetch_buffer pbuffer;
+    // Internal Display Memory
+    uint8_t palram[PALRAM_SIZE];
+    uint8_t vram[VRAM_SIZE];
+    uint8_t oam[OAM_SIZE];
 
-    // Open Bus
-    uint32_t bios_bus;
+    // One bit per 32-byte block of VRAM written since the last `ppu_tile_cache_update()`
+    uint64_t vram_dirty[VRAM_SIZE / 32 / 64];
 
-    // Set when the cartridge memory bus is in used
-    bool gamepak_bus_in_use;
+    // Set when OAM is written, until the next `ppu_sprite_cache_update()`
+    bool oam_dirty;
 };
 
 /*
@@ -262,7 +311,7 @@ void mem_io_write8(struct gba *gba, uint32_t addr, uint8_t val);
 /* gba/memory/memory.c */
 void mem_reset(struct memory *memory);
 void mem_access(struct gba *gba, uint32_t addr, uint32_t size, enum access_type access_type);
-void mem_update_waitstates(struct gba const *gba);
+void mem_update_waitstates(struct gba *gba);
 void mem_prefetch_buffer_access(struct gba *gba, uint32_t addr, uint32_t intended_cycles);
 void mem_prefetch_buffer_step(struct gba *gba, uint32_t cycles);
 uint32_t mem_openbus_read(struct gba const *gba, uint32_t addr);
@@ -274,6 +323,16 @@ uint32_t mem_read32_ror(struct gba *gba, uint32_t addr, enum access_type access_
 void mem_write8(struct gba *gba, uint32_t addr, uint8_t val, enum access_type access_type);
 void mem_write16(struct gba *gba, uint32_t addr, uint16_t val, enum access_type access_type);
 void mem_write32(struct gba *gba, uint32_t addr, uint32_t val, enum access_type access_type);
+uint32_t mem_iwram_read32_ror(struct gba *gba, uint32_t addr, enum access_type access_type);
+void mem_iwram_write32(struct gba *gba, uint32_t addr, uint32_t val, enum access_type access_type);
+uint32_t mem_rom_read32_ror(struct gba *gba, uint32_t addr, enum access_type access_type);
+uint32_t *mem_bulk_access(struct gba *gba, uint32_t addr, uint32_t count);
+
+/* gba/memory/rom.c */
+struct rom *mem_rom_open(char const *path);
+struct rom *mem_rom_ref(struct rom *rom);
+void mem_rom_unref(struct rom *rom);
+void mem_load_rom(struct gba *gba, struct rom *rom);
 
 /* gba/memory/storage/eeprom.c */
 uint8_t mem_eeprom_read8(struct gba *gba);
@@ -284,7 +343,7 @@ uint8_t mem_flash_read8(struct gba const *gba, uint32_t addr);
 void mem_flash_write8(struct gba *gba, uint32_t addr, uint8_t val);
 
 /* gba/memory/storage/storage.c */
-extern size_t backup_storage_sizes[];
+extern size_t const backup_storage_sizes[];
 void mem_backup_storage_detect(struct gba *gba);
 void mem_backup_storage_init(struct gba *gba);
 uint8_t mem_backup_storage_read8(struct gba const *gba, uint32_t addr);
@@ -293,7 +352,7 @@ void mem_backup_storage_write_to_disk(struct gba *gba);
 
 /* gba/quicksave.c */
 void quicksave(struct gba const *gba, char const *);
-void quickload(struct gba *gba, char const *);
+bool quickload(struct gba *gba, char const *);
 
 /*
 ** The following memory-accessors are used by the PPU for fast memory access
@@ -307,4 +366,7 @@ void quickload(struct gba *gba, char const *);
 # define mem_vram_read16(gba, addr)         (*(uint16_t *)((uint8_t *)(gba)->memory.vram + ((addr) & (((addr) & 0x10000) ? VRAM_MASK_1 : VRAM_MASK_2))))
 # define mem_oam_read16(gba, addr)          (*(uint16_t *)((uint8_t *)(gba)->memory.oam + ((addr) & OAM_MASK)))
 
+/* Flag the 32-byte block of VRAM containing `off` (an offset within `memory.vram`) as written. */
+# define mem_vram_mark_dirty(gba, off)      ((gba)->memory.vram_dirty[(off) >> 11] |= 1ull << (((off) >> 5) & 63))
+
 #endif /* !GBA_MEMORY_H */
\ No newline at end of file
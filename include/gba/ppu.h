@@ -11,6 +11,8 @@
 # define GBA_PPU_H
 
 # include "hades.h"
+# include "gba/memory.h"
+# include "gba/io.h"
 
 # define GBA_SCREEN_WIDTH           240
 # define GBA_SCREEN_HEIGHT          160
@@ -54,20 +56,44 @@ union color {
 
 static_assert(sizeof(union color) == sizeof(uint16_t));
 
-struct rich_color {
-    union color;
-    uint8_t idx: 6; // 0-3 for bgs, 4 for OAM, 5 for BD
-    uint8_t visible: 1;
-    uint8_t force_blend: 1; // Only useful for OAM
-} __packed;
+/*
+** Flags of each pixel of a layer.
+*/
+enum layer_flags {
+    LAYER_VISIBLE       = 1 << 0,
+    LAYER_FORCE_BLEND   = 1 << 1,   // Semi-transparent sprites only
+};
+
+/*
+** A layer of the scanline being rendered: a background, or all the sprites of a given priority.
+*/
+struct layer {
+    uint16_t color[GBA_SCREEN_WIDTH];       // BGR555
+    uint8_t flags[GBA_SCREEN_WIDTH];        // See `enum layer_flags`
+};
+
+/*
+** Layers are numbered 0-3 for backgrounds, 4 for sprites and 5 for the backdrop.
+*/
+# define LAYER_OBJ                  4
+# define LAYER_BACKDROP             5
+
+/*
+** Marks a pixel without any layer in `scanline.top` or `scanline.bot`.
+*/
+# define LAYER_NONE                 0xFF
 
 struct scanline {
-    struct rich_color bot[GBA_SCREEN_WIDTH];
-    struct rich_color bg[GBA_SCREEN_WIDTH];
-    struct rich_color oam[4][GBA_SCREEN_WIDTH];
-    struct rich_color result[GBA_SCREEN_WIDTH];
+    struct layer bg[4];
+    struct layer obj[4];                    // One per priority
     bool win_obj_mask[GBA_SCREEN_WIDTH];
-    uint32_t top_idx;
+    uint8_t win_opts[GBA_SCREEN_WIDTH];     // The layers shown by the window covering each pixel, and if it allows special effects
+
+    /* The two frontmost visible layers of each pixel, as indexes within `ppu.layers`. */
+    uint8_t top[GBA_SCREEN_WIDTH];
+    uint8_t bot[GBA_SCREEN_WIDTH];
+
+    uint16_t result[GBA_SCREEN_WIDTH];      // BGR555
 };
 
 union tile {
@@ -118,6 +144,57 @@ union oam_entry {
 
 static_assert(sizeof(union oam_entry) == 3 * sizeof(uint16_t));
 
+/*
+** The content of VRAM, decoded to one palette index per byte.
+**
+** Each 32-byte block of VRAM is decoded as if it was a 4bpp tile, in 8 rows of 8 pixels.
+** 8bpp tiles aren't cached since VRAM already stores them with one palette index per byte.
+**
+** The blocks written since the last scanline are flagged in `memory.vram_dirty` and
+** decoded again by `ppu_tile_cache_update()` before the next one is rendered.
+*/
+struct tile_cache {
+    uint8_t tiles[VRAM_SIZE / 32][8][8];
+};
+
+/* Return the decoded 4bpp tile starting at `addr`, a VRAM address relative to `VRAM_START`. */
+# define ppu_tile_4bpp(gba, addr)           ((gba)->tile_cache.tiles[((addr) & (((addr) & 0x10000) ? VRAM_MASK_1 : VRAM_MASK_2)) >> 5])
+
+/*
+** An OAM entry, with everything that can be derived from OAM alone already computed.
+*/
+struct sprite {
+    union oam_entry oam;
+    int32_t win_ox;         // Coordinates and size of the area covered by the sprite on screen,
+    int32_t win_oy;         // twice as large as the sprite itself for double-sized affine sprites.
+    int32_t win_sx;
+    int32_t win_sy;
+    int32_t sprite_sx;      // Size of the sprite itself
+    int32_t sprite_sy;
+    int16_t pa;             // Affine parameters, the identity matrix for regular sprites
+    int16_t pb;
+    int16_t pc;
+    int16_t pd;
+};
+
+/*
+** The content of OAM, decoded for the PPU.
+**
+** It is decoded again by `ppu_sprite_cache_update()`, before a scanline is rendered,
+** each time OAM was written (see `memory.oam_dirty`).
+*/
+struct sprite_cache {
+    struct sprite sprites[128];
+
+    // For each scanline, the index of the sprites covering it, from the lowest priority to the highest
+    uint8_t lines[GBA_SCREEN_HEIGHT][128];
+    uint8_t lines_len[GBA_SCREEN_HEIGHT];
+
+    // End of the furthest 4bpp tile used by a sprite, relative to `VRAM_START`, in either mapping.
+    // Can be past the end of VRAM, in which case the tiles wrap around.
+    uint32_t tiles_4bpp_end;
+};
+
 struct ppu {
     // Internal registers used for affine backgrounds
     int32_t internal_px[2];
@@ -125,29 +202,153 @@ struct ppu {
     
     bool win_masks[2][GBA_SCREEN_WIDTH];
     uint32_t win_masks_hash[2];                /* The min/max for that windows. Kept to avoid rebuilding the mask across scanlines. */ 
+
+    /*
+    ** The layers to compose, from the frontmost to the backmost.
+    ** 0-3 are backgrounds, and 4-7 are the sprites of priority 0-3.
+    **
+    ** Rebuilt by `ppu_update_layer_order()` when REG_DISPCNT or REG_BGxCNT change.
+    */
+    uint8_t layers[8];
+    uint32_t layers_len;
+};
+
+/*
+** A write to PALRAM, VRAM or OAM that the PPU worker hasn't applied to its own copy yet.
+*/
+struct ppu_write {
+    uint32_t offset;        // Within the memory region, already masked
+    uint32_t value;
+    uint8_t region;         // PALRAM_REGION, VRAM_REGION or OAM_REGION
+    uint8_t size;           // In bytes
+};
+
+# define PPU_WRITES_LEN                     (1 << 15)
+
+/*
+** Everything the PPU worker needs to render a scanline, captured when it enters HBlank.
+*/
+struct ppu_line {
+    struct io io;
+    int32_t internal_px[2];
+    int32_t internal_py[2];
+    uint8_t layers[8];
+    uint32_t layers_len;
+    bool color_correction;
+    uint64_t writes_end;    // The writes made before this scanline ends stop there
+};
+
+/*
+** A thread rendering the scanlines while the emulation goes on.
+**
+** The worker renders from its own copy of the PPU-related state, `view`. The content of
+** the IO registers and of the internal registers is captured for each scanline, while
+** the writes to PALRAM, VRAM and OAM are logged, and applied to the copy just before the
+** first scanline that follows them is rendered.
+**
+** The emulation thread only waits for the worker at the end of each frame, when it
+** copies the framebuffer to the frontend's.
+**
+** The scanlines are handed over through `lines_queued` and `lines_done` alone. The lock
+** and the condition variables are only used by a thread that has to sleep, and the other
+** one only signals it when it announced so through `worker_sleeping` or `emulation_waiting`.
+*/
+struct ppu_worker {
+    struct gba *gba;        // The emulated system, whose framebuffer the worker fills
+    struct gba *view;       // Only the PPU-related parts are used
+    pthread_t thread;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;    // Signaled when a scanline is queued while the worker sleeps, or when it must stop
+    pthread_cond_t done;    // Signaled when a scanline was rendered while the emulation thread waits for it
+    bool exit;              // Protected by `lock`
+
+    struct ppu_line lines[GBA_SCREEN_HEIGHT];
+    atomic_uint_fast64_t lines_queued;
+    atomic_uint_fast64_t lines_done;
+    atomic_bool worker_sleeping;
+    atomic_bool emulation_waiting;
+
+    // Only accessed by the emulation thread
+    bool reload;            // If set, `view` must be copied again from the emulated system
+    uint64_t writes_tail;
+
+    struct ppu_write writes[PPU_WRITES_LEN];
+    atomic_uint_fast64_t writes_head;
 };
 
 /* gba/ppu/background/bitmap.c */
-void ppu_render_background_bitmap(struct gba const *gba, struct scanline *scanline, bool palette);
-void ppu_render_background_bitmap_small(struct gba const *gba, struct scanline *scanline);
+void ppu_render_background_bitmap(struct gba const *gba, struct scanline *scanline, bool palette, uint32_t start, uint32_t end);
+void ppu_render_background_bitmap_small(struct gba const *gba, struct scanline *scanline, uint32_t start, uint32_t end);
 
 /* gba/ppu/background/text.c */
-void ppu_render_background_text(struct gba const *gba, struct scanline *scanline, uint32_t line, uint32_t bg_idx);
+void ppu_render_background_text(struct gba const *gba, struct scanline *scanline, uint32_t line, uint32_t bg_idx, uint32_t start, uint32_t end);
 
 /* gba/ppu/background/affine.c */
-void ppu_render_background_affine(struct gba *gba, struct scanline *scanline, uint32_t line, uint32_t bg_idx);
+void ppu_render_background_affine(struct gba *gba, struct scanline *scanline, uint32_t line, uint32_t bg_idx, uint32_t start, uint32_t end);
 void ppu_reload_affine_internal_registers(struct gba *gba, uint32_t idx);
 void ppu_step_affine_internal_registers(struct gba *gba);
 
+/* gba/ppu/blend.c */
+void ppu_blend_init(void);
+void ppu_blend_alpha(uint16_t *dst, uint16_t const *top, uint16_t const *bot, uint32_t eva, uint32_t evb, size_t len);
+void ppu_blend_brighten(uint16_t *dst, uint16_t const *top, uint32_t evy, size_t len);
+void ppu_blend_darken(uint16_t *dst, uint16_t const *top, uint32_t evy, size_t len);
+
+/* gba/ppu/color.c */
+void ppu_color_init(void);
+uint32_t const *ppu_color_lut(bool color_correction);
+
 /* gba/ppu/oam.c */
+void ppu_sprite_cache_update(struct gba *gba);
 void ppu_prerender_oam(struct gba *gba, struct scanline *scanline, int32_t line);
 
 /* gba/ppu/ppu.c */
 void ppu_init(struct gba *);
+void ppu_render_scanline(struct gba *gba, uint32_t *framebuffer);
 void ppu_render_black_screen(struct gba *gba);
+void ppu_update_layer_order(struct gba *gba);
+
+/* gba/ppu/tile.c */
+void ppu_tile_cache_update(struct gba *gba);
 
 /* gba/ppu/window.c */
 void ppu_window_build_masks(struct gba *gba, uint32_t y);
 uint8_t ppu_find_top_window(struct gba const *gba, struct scanline const *, uint32_t x);
 
+/* gba/ppu/worker.c */
+void ppu_worker_start(struct gba *gba);
+void ppu_worker_stop(struct gba *gba);
+void ppu_worker_queue_line(struct gba *gba);
+void ppu_worker_sync(struct gba *gba);
+void ppu_worker_reload(struct gba *gba);
+void ppu_worker_flush_writes(struct ppu_worker *worker);
+
+/*
+** Log a write to PALRAM, VRAM or OAM, to be applied to the worker's copy before it
+** renders the next scanline.
+*/
+static inline
+void
+ppu_worker_log_write(
+    struct ppu_worker *worker,
+    uint8_t region,
+    uint32_t offset,
+    uint32_t value,
+    uint8_t size
+) {
+    struct ppu_write *write;
+
+    if (worker->writes_tail - atomic_load_explicit(&worker->writes_head, memory_order_acquire) == PPU_WRITES_LEN) {
+        ppu_worker_flush_writes(worker);
+    }
+
+    write = &worker->writes[worker->writes_tail % PPU_WRITES_LEN];
+    write->offset = offset;
+    write->value = value;
+    write->region = region;
+    write->size = size;
+    ++worker->writes_tail;
+}
+
 #endif /* !GBA_PPU_H */
\ No newline at end of file
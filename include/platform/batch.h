@@ -0,0 +1,80 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+#ifndef PLATFORM_BATCH_H
+# define PLATFORM_BATCH_H
+
+# include "hades.h"
+
+/*
+** A double-ended queue of tasks, owned by one worker.
+**
+** The owner pushes and pops tasks at the tail, while the other workers steal the
+** oldest tasks from the head.
+*/
+struct pool_deque {
+    pthread_mutex_t lock;
+    void **tasks;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+};
+
+/*
+** A pool of workers executing independent tasks, balancing the load through work
+** stealing: each worker starts with its share of the tasks and, once it runs out,
+** steals the remaining tasks of the others.
+*/
+struct pool {
+    struct pool_deque *deques;
+    size_t nb_workers;
+    size_t next_deque;
+
+    void (*func)(void *ctx, void *task, size_t worker);
+    void *ctx;
+
+    atomic_size_t steals;
+};
+
+/*
+** A game to run, and what was measured once it ran.
+*/
+struct batch_job {
+    char const *rom_path;
+    char const *state_path;         // Optional savestate to load after the reset
+
+    char *error;                    // NULL on success
+
+    uint32_t frames;                // Frames actually rendered
+    uint64_t cycles;
+    uint64_t time;                  // In microseconds
+    uint64_t hash;                  // See `batch_state_hash()`
+    size_t worker;
+};
+
+/*
+** The settings shared by all the jobs.
+*/
+struct batch_config {
+    uint8_t const *bios;
+    char const *output_dir;
+    uint32_t frames;
+    bool skip_bios;
+};
+
+/* platform/batch/job.c */
+void batch_run_job(void *config, void *job, size_t worker);
+
+/* platform/batch/pool.c */
+void pool_init(struct pool *pool, size_t nb_workers);
+void pool_push(struct pool *pool, void *task);
+void pool_run(struct pool *pool, void (*func)(void *ctx, void *task, size_t worker), void *ctx);
+void pool_cleanup(struct pool *pool);
+
+#endif /* !PLATFORM_BATCH_H */
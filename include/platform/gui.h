@@ -37,6 +37,13 @@ struct emulation {
     int32_t backup_type;
     bool rtc_autodetect;
     bool rtc_enabled;
+    bool skip_bios;
+
+    /* Set by `--skip-bios`: skip the BIOS intro without changing the saved setting. */
+    bool skip_bios_override;
+
+    /* Set by `--render-thread`: render the scanlines on a separate thread. */
+    bool render_thread;
 };
 
 struct app {
@@ -89,6 +96,8 @@ void gui_game_quickload(struct app *app);
 void gui_game_set_audio_settings(struct app *app, uint64_t resample_freq);
 void gui_game_set_backup_type(struct app *app);
 void gui_game_set_color_correction(struct app *app);
+void gui_game_set_skip_bios(struct app *app);
+void gui_game_set_render_thread(struct app *app);
 
 /* game/render.c */
 void gui_render_game_fullscreen(struct app *app);
@@ -147,7 +147,7 @@ apu_resample(
     struct gba *gba,
     union event_data data
 ) {
-    static int32_t fifo_volume[2] = {2, 1};
+    static int32_t const fifo_volume[2] = {2, 1};
     int32_t sample_l;
     int32_t sample_r;
 
@@ -9,6 +9,7 @@
 
 #include "hades.h"
 #include "gba/gba.h"
+#include "gba/core/arm.h"
 
 /*
 ** Execute the Data Processing instructions (ADD, SUB, MOV, etc.).
@@ -33,6 +34,7 @@ core_arm_alu(
     cond = bitfield_get(op, 20);
 
     core = &gba->core;
+    core_flags_sync(core);
     core->prefetch_access_type = SEQUENTIAL;
     shift_carry = core->cpsr.carry;
 
@@ -232,11 +234,7 @@ core_arm_alu(
         ** in R15 and the SPSR corresponding to the current mode is moved to the CPSR.
         */
         if (cond) {
-            struct psr new_cpsr;
-
-            new_cpsr = core_spsr_get(core, core->cpsr.mode);
-            core_switch_mode(core, new_cpsr.mode);
-            core->cpsr = new_cpsr;
+            core_exception_return(gba);
         }
 
         // Read-Only operations do not flush the pipeline
@@ -257,3 +255,303 @@ core_arm_alu(
         core->pc += 4;
     }
 }
+
+
+/*
+** Compute the second operand of a data processing instruction for the given,
+** constant, operand form.
+**
+** This is the same as what `core_arm_alu()` does, but `operand` is known at
+** compile time so all the branches on the operand form and shift type go away.
+*/
+static inline __attribute__((always_inline))
+uint32_t
+core_arm_alu_operand(
+    struct core *core,
+    uint32_t op,
+    enum arm_alu_operand operand,
+    bool *carry
+) {
+    uint32_t value;
+    uint32_t bits;
+
+    if (operand == ARM_ALU_IMM) {
+        uint32_t rot;
+
+        value = bitfield_get_range(op, 0, 8);
+        rot = bitfield_get_range(op, 8, 12) * 2;
+        if (rot > 0) {
+            *carry = (value >> (rot - 1)) & 0b1;
+            value = ror32(value, rot);
+        }
+        return (value);
+    }
+
+    value = core->registers[op & 0xF];
+
+    if (operand >= ARM_ALU_REG_IMM_LSL && operand <= ARM_ALU_REG_IMM_ROR) {
+        return (core_shift_imm(core, operand - ARM_ALU_REG_IMM_LSL, (op >> 7) & 0x1F, value, carry));
+    }
+
+    bits = core->registers[(op >> 8) & 0xF] & 0xFF;
+
+    if (!bits) {
+        return (value);
+    }
+
+    switch (operand) {
+        case ARM_ALU_REG_REG_LSL: {
+            if (bits < 32) {
+                *carry = (value >> (32 - bits)) & 0b1;
+                value <<= bits;
+            } else {
+                *carry = (bits == 32) ? (value & 0b1) : false;
+                value = 0;
+            }
+            break;
+        };
+        case ARM_ALU_REG_REG_LSR: {
+            if (bits < 32) {
+                *carry = (value >> (bits - 1)) & 0b1;
+                value >>= bits;
+            } else {
+                *carry = (bits == 32) ? (value >> 31) : false;
+                value = 0;
+            }
+            break;
+        };
+        case ARM_ALU_REG_REG_ASR: {
+            if (bits < 32) {
+                *carry = (value >> (bits - 1)) & 0b1;
+                value = (int32_t)value >> bits;
+            } else {
+                *carry = value >> 31;
+                value = (int32_t)value >> 31;
+            }
+            break;
+        };
+        case ARM_ALU_REG_REG_ROR: {
+            bits = ((bits - 1) % 32) + 1;
+            *carry = (value >> (bits - 1)) & 0b1;
+            value = ror32(value, bits % 32);
+            break;
+        };
+        default: break;
+    }
+    return (value);
+}
+
+/*
+** Execute a data processing instruction writing to the PC, for the given, constant,
+** opcode, S bit and operand form.
+**
+** The flags are never updated. Instead, if S=1, the CPSR is restored from the SPSR.
+**
+** `opcode` must not be TST, TEQ, CMP or CMN, and `operand` must not use a register
+** shift amount.
+*/
+static inline __attribute__((always_inline))
+void
+core_arm_alu_pc(
+    struct gba *gba,
+    uint32_t op,
+    uint32_t opcode,
+    bool s,
+    enum arm_alu_operand operand
+) {
+    struct core *core;
+    uint32_t op1;
+    uint32_t op2;
+    bool carry;
+    bool c;
+
+    core = &gba->core;
+    core->prefetch_access_type = SEQUENTIAL;
+
+    c = core_flags_carry(core);
+    op1 = core->registers[(op >> 16) & 0xF];
+    op2 = core_arm_alu_operand(core, op, operand, &carry);
+
+    switch (opcode) {
+        case 0:  core->pc = op1 & op2; break;           // AND
+        case 1:  core->pc = op1 ^ op2; break;           // EOR
+        case 2:  core->pc = op1 - op2; break;           // SUB
+        case 3:  core->pc = op2 - op1; break;           // RSB
+        case 4:  core->pc = op1 + op2; break;           // ADD
+        case 5:  core->pc = op1 + op2 + c; break;       // ADC
+        case 6:  core->pc = op1 - op2 - !c; break;      // SBC
+        case 7:  core->pc = op2 - op1 - !c; break;      // RSC
+        case 12: core->pc = op1 | op2; break;           // ORR
+        case 13: core->pc = op2; break;                 // MOV
+        case 14: core->pc = op1 & ~op2; break;          // BIC
+        case 15: core->pc = ~op2; break;                // MVN
+    }
+
+    if (s) {
+        core_exception_return(gba);
+    }
+
+    core_reload_pipeline(gba);
+}
+
+/*
+** A version of `core_arm_alu()` specialized for the given, constant, opcode,
+** S bit and operand form.
+**
+** Instructions writing to the PC are rare and fall back to `core_arm_alu()`.
+*/
+static inline __attribute__((always_inline))
+void
+core_arm_alu_specialized(
+    struct gba *gba,
+    uint32_t op,
+    uint32_t opcode,
+    bool s,
+    enum arm_alu_operand operand
+) {
+    struct core *core;
+    uint32_t rd;
+    uint32_t op1;
+    uint32_t op2;
+    uint32_t res;
+    bool carry;
+    bool reg_shift;
+    bool c;
+
+    rd = (op >> 12) & 0xF;
+    reg_shift = (operand >= ARM_ALU_REG_REG_LSL);
+
+    /*
+    ** Writing to the PC with an immediate shift amount is the usual way of returning
+    ** from an exception (`SUBS PC, LR, #4`, `MOVS PC, LR`) and is handled here.
+    ** The other forms are rare and fall back to `core_arm_alu()`.
+    */
+    if (unlikely(rd == 15)) {
+        if (reg_shift || (opcode >= 8 && opcode <= 11)) {
+            core_arm_alu(gba, op);
+            return ;
+        }
+        core_arm_alu_pc(gba, op, opcode, s, operand);
+        return ;
+    }
+
+    core = &gba->core;
+
+    /*
+    ** If a register is used to specify the shift amount the PC is 12 bytes ahead
+    ** and the instruction takes an extra internal cycle.
+    */
+    if (reg_shift) {
+        core->pc += 4;
+        core_idle(gba);
+        core->prefetch_access_type = NON_SEQUENTIAL;
+    } else {
+        core->prefetch_access_type = SEQUENTIAL;
+    }
+
+    c = core_flags_carry(core);
+    carry = c;
+    op1 = core->registers[(op >> 16) & 0xF];
+    op2 = core_arm_alu_operand(core, op, operand, &carry);
+
+    switch (opcode) {
+        case 0:  res = op1 & op2; break;            // AND
+        case 1:  res = op1 ^ op2; break;            // EOR
+        case 2:  res = op1 - op2; break;            // SUB
+        case 3:  res = op2 - op1; break;            // RSB
+        case 4:  res = op1 + op2; break;            // ADD
+        case 5:  res = op1 + op2 + c; break;        // ADC
+        case 6:  res = op1 - op2 - !c; break;       // SBC
+        case 7:  res = op2 - op1 - !c; break;       // RSC
+        case 8:  res = op1 & op2; break;            // TST
+        case 9:  res = op1 ^ op2; break;            // TEQ
+        case 10: res = op1 - op2; break;            // CMP
+        case 11: res = op1 + op2; break;            // CMN
+        case 12: res = op1 | op2; break;            // ORR
+        case 13: res = op2; break;                  // MOV
+        case 14: res = op1 & ~op2; break;           // BIC
+        case 15: res = ~op2; break;                 // MVN
+    }
+
+    // TST, TEQ, CMP and CMN only update the flags
+    if (opcode < 8 || opcode > 11) {
+        core->registers[rd] = res;
+    }
+
+    /*
+    ** Only record the operation, the flags are computed when needed.
+    **
+    ** TST, TEQ, CMP and CMN always have S=1. Their S=0 variants are only used as
+    ** flag-free handlers when the flags are dead, see `core_flags_analyze_rom()`.
+    */
+    if (s) {
+        switch (opcode) {
+            case 2:
+            case 6:
+            case 10:
+                core_flags_sub(core, op1, op2, res);
+                break;
+            case 3:
+            case 7:
+                core_flags_sub(core, op2, op1, res);
+                break;
+            case 4:
+            case 5:
+            case 11:
+                core_flags_add(core, op1, op2, res);
+                break;
+            default:
+                core_flags_logical(core, res, carry);
+                break;
+        }
+    }
+
+    if (!reg_shift) {
+        core->pc += 4;
+    }
+}
+
+/*
+** The specialized handlers are referenced by name in `arm_lut`, see `decode_gen.c`.
+*/
+#define ALU_HANDLER(opcode, s, operand)                                     \
+    void                                                                    \
+    core_arm_alu_##opcode##_##s##_##operand(struct gba *gba, uint32_t op)   \
+    {                                                                       \
+        core_arm_alu_specialized(gba, op, opcode, s, operand);              \
+    }
+
+#define ALU_FOR_EACH_OPERAND(X, opcode, s)                                  \
+    X(opcode, s, ARM_ALU_IMM)                                               \
+    X(opcode, s, ARM_ALU_REG_IMM_LSL)                                       \
+    X(opcode, s, ARM_ALU_REG_IMM_LSR)                                       \
+    X(opcode, s, ARM_ALU_REG_IMM_ASR)                                       \
+    X(opcode, s, ARM_ALU_REG_IMM_ROR)                                       \
+    X(opcode, s, ARM_ALU_REG_REG_LSL)                                       \
+    X(opcode, s, ARM_ALU_REG_REG_LSR)                                       \
+    X(opcode, s, ARM_ALU_REG_REG_ASR)                                       \
+    X(opcode, s, ARM_ALU_REG_REG_ROR)
+
+#define ALU_FOR_EACH_S(X, opcode)                                           \
+    ALU_FOR_EACH_OPERAND(X, opcode, 0)                                      \
+    ALU_FOR_EACH_OPERAND(X, opcode, 1)
+
+#define ALU_FOR_EACH(X)                                                     \
+    ALU_FOR_EACH_S(X, 0)                                                    \
+    ALU_FOR_EACH_S(X, 1)                                                    \
+    ALU_FOR_EACH_S(X, 2)                                                    \
+    ALU_FOR_EACH_S(X, 3)                                                    \
+    ALU_FOR_EACH_S(X, 4)                                                    \
+    ALU_FOR_EACH_S(X, 5)                                                    \
+    ALU_FOR_EACH_S(X, 6)                                                    \
+    ALU_FOR_EACH_S(X, 7)                                                    \
+    ALU_FOR_EACH_S(X, 8)                                                    \
+    ALU_FOR_EACH_S(X, 9)                                                    \
+    ALU_FOR_EACH_S(X, 10)                                                   \
+    ALU_FOR_EACH_S(X, 11)                                                   \
+    ALU_FOR_EACH_S(X, 12)                                                   \
+    ALU_FOR_EACH_S(X, 13)                                                   \
+    ALU_FOR_EACH_S(X, 14)                                                   \
+    ALU_FOR_EACH_S(X, 15)
+
+ALU_FOR_EACH(ALU_HANDLER)
@@ -24,12 +24,14 @@ core_arm_bdt(
     enum arm_modes mode_old;
     bool mode_switch;
     bool pc_in_rlist;
+    bool empty_rlist;
     bool first;
     bool load;
     bool pre;
     bool s;
     bool wb;
     enum access_type access_type;
+    uint32_t *words;
 
     core = &gba->core;
     rn = bitfield_get_range(op, 16, 20);
@@ -53,7 +55,8 @@ core_arm_bdt(
     ** Edge case: if rlist is empty, transfer the pc but
     ** increment the base as if all registers were transfered.
     */
-    if (count == 0) {
+    empty_rlist = (count == 0);
+    if (empty_rlist) {
         op |= (1 << 15);
         count = 16;
     }
@@ -93,6 +96,15 @@ core_arm_bdt(
         mode_switch = false;
     }
 
+    /*
+    ** If the whole transfer lies within IWRAM, EWRAM or VRAM, the registers
+    ** are transferred directly to/from `words`.
+    **
+    ** An empty list only transfers PC, so it must not be accounted as a transfer
+    ** of 16 registers.
+    */
+    words = empty_rlist ? NULL : mem_bulk_access(gba, base + (pre ? 4 : 0), count);
+
     i = 0;
     first = true;
     access_type = NON_SEQUENTIAL;
@@ -106,9 +118,17 @@ core_arm_bdt(
                     first = false;
                 }
 
-                core->registers[i] = mem_read32(gba, base, access_type);
+                if (words) {
+                    core->registers[i] = *words++;
+                } else {
+                    core->registers[i] = mem_read32(gba, base, access_type);
+                }
             } else {
-                mem_write32(gba, base, core->registers[i], access_type);
+                if (words) {
+                    *words++ = core->registers[i];
+                } else {
+                    mem_write32(gba, base, core->registers[i], access_type);
+                }
 
                 if (first && wb) { // Write back after data is stored
                     core->registers[rn] = base_new;
@@ -127,11 +147,7 @@ core_arm_bdt(
 
         if (pc_in_rlist) {
             if (s) {
-                struct psr spsr;
-
-                spsr = core_spsr_get(core, core->cpsr.mode);
-                core_switch_mode(core, spsr.mode);
-                core->cpsr = spsr;
+                core_exception_return(gba);
             }
             core_reload_pipeline(gba);
         }
@@ -98,8 +98,7 @@ core_arm_mul(
     }
 
     if (s) {
-        core->cpsr.zero = !(core->registers[rd]);
-        core->cpsr.negative = bitfield_get(core->registers[rd], 31);
+        core_flags_nz(core, core->registers[rd]);
     }
 
     core->pc += 4;
@@ -176,6 +175,7 @@ core_arm_mull(
     core->registers[rd_hi] = (ures >> 32) & 0xFFFFFFFF;
 
     if (s) {
+        core_flags_sync(core);
         core->cpsr.zero = !(core->registers[rd_hi]) && !(core->registers[rd_lo]);
         core->cpsr.negative = bitfield_get(core->registers[rd_hi], 31);
     }
@@ -22,6 +22,7 @@ core_arm_mrs(
     struct core *core;
 
     core = &gba->core;
+    core_flags_sync(core);
     rd = bitfield_get_range(op, 12, 16);
 
     if (bitfield_get(op, 22)) { // Source PSR = SPSR_<current_mode>
@@ -47,6 +48,8 @@ core_arm_msr(
     uint32_t mask;
 
     core = &gba->core;
+    core_flags_sync(core);
+
     if (bitfield_get(op, 25)) { // Immediate
         uint32_t shift;
         uint32_t imm;
@@ -74,6 +77,7 @@ core_arm_msr(
         if (spsr.raw != core->cpsr.raw) {
             spsr.raw = (spsr.raw & ~mask) | (val & mask);
             core_spsr_set(core, core->cpsr.mode, spsr);
+            core_scan_irq(gba);
         }
     } else { // Set CPSR
         struct psr new_cpsr;
@@ -86,6 +90,7 @@ core_arm_msr(
         new_cpsr.raw = (core->cpsr.raw & ~mask) | (val & mask);
         core_switch_mode(core, new_cpsr.mode);
         core->cpsr = new_cpsr;
+        core_scan_irq(gba);
     }
 
     core->pc += 4;
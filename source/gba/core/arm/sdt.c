@@ -9,6 +9,7 @@
 
 #include "hades.h"
 #include "gba/gba.h"
+#include "gba/core/arm.h"
 
 /*
 ** Execute the Single Data Transfer kind of instructions.
@@ -228,4 +229,229 @@ core_arm_hsdt(
             core->registers[rn] = addr;
         }
     }
-}
\ No newline at end of file
+}
+
+/*
+** Generic implementation of the Single Data Transfer instructions, used to generate one
+** handler per combination of the P, U, B, W and L bits and per offset form.
+**
+** `flags` holds bits 20 to 24 of the op-code and, like `offset_type`, is known at compile
+** time so all the branches on the addressing mode go away.
+**
+** Word transfers relative to SP or PC are routed to the IWRAM and ROM fast paths.
+*/
+static inline __attribute__((always_inline))
+void
+core_arm_sdt_specialized(
+    struct gba *gba,
+    uint32_t op,
+    uint32_t flags,
+    enum arm_sdt_offset offset_type
+) {
+    struct core *core;
+    uint32_t effective_addr;
+    uint32_t base;
+    uint32_t addr;
+    uint32_t offset;
+    uint32_t rd;
+    uint32_t rn;
+    bool load;
+    bool writeback;
+    bool byte;
+    bool up;
+    bool pre;
+
+    load = bitfield_get(flags, 0);
+    writeback = bitfield_get(flags, 1);
+    byte = bitfield_get(flags, 2);
+    up = bitfield_get(flags, 3);
+    pre = bitfield_get(flags, 4);
+
+    rd = bitfield_get_range(op, 12, 16);
+    rn = bitfield_get_range(op, 16, 20);
+
+    core = &gba->core;
+    core->prefetch_access_type = NON_SEQUENTIAL;
+    base = core->registers[rn];
+
+    if (offset_type == ARM_SDT_IMM) {
+        offset = bitfield_get_range(op, 0, 12);
+    } else {
+        bool carry;
+
+        offset = core_shift_imm(
+            core,
+            offset_type - ARM_SDT_REG_LSL,
+            bitfield_get_range(op, 7, 12),
+            core->registers[op & 0xF],
+            &carry
+        );
+    }
+
+    core->pc += 4;
+
+    addr = up ? base + offset : base - offset;
+    effective_addr = pre ? addr : base;
+
+    if (load) {
+        uint32_t val;
+
+        if (byte) {
+            val = mem_read8(gba, effective_addr, NON_SEQUENTIAL);
+        } else if (rn == 13) {
+            val = mem_iwram_read32_ror(gba, effective_addr, NON_SEQUENTIAL);
+        } else if (rn == 15) {
+            val = mem_rom_read32_ror(gba, effective_addr, NON_SEQUENTIAL);
+        } else {
+            val = mem_read32_ror(gba, effective_addr, NON_SEQUENTIAL);
+        }
+
+        if (!pre || writeback) {
+            core->registers[rn] = addr;
+        }
+
+        core->registers[rd] = val;
+        core_idle(gba);
+
+        if (rd == 15) {
+            core_reload_pipeline(gba);
+        }
+    } else {
+        if (byte) {
+            mem_write8(gba, effective_addr, core->registers[rd], NON_SEQUENTIAL);
+        } else if (rn == 13) {
+            mem_iwram_write32(gba, effective_addr, core->registers[rd], NON_SEQUENTIAL);
+        } else {
+            mem_write32(gba, effective_addr, core->registers[rd], NON_SEQUENTIAL);
+        }
+
+        if (!pre || writeback) {
+            core->registers[rn] = addr;
+        }
+    }
+}
+
+/*
+** Generic implementation of the Halfword and Signed Data Transfer instructions, used to
+** generate one handler per combination of the P, U, I, W and L bits and per sub-operation.
+**
+** Like for `core_arm_sdt_specialized()`, `flags` holds bits 20 to 24 of the op-code.
+** `sh` holds bits 5 and 6. Stores are always treated as STRH.
+*/
+static inline __attribute__((always_inline))
+void
+core_arm_hsdt_specialized(
+    struct gba *gba,
+    uint32_t op,
+    uint32_t flags,
+    uint32_t sh
+) {
+    struct core *core;
+    uint32_t effective_addr;
+    uint32_t base;
+    uint32_t addr;
+    uint32_t offset;
+    uint32_t rd;
+    uint32_t rn;
+    bool load;
+    bool writeback;
+    bool imm;
+    bool up;
+    bool pre;
+
+    load = bitfield_get(flags, 0);
+    writeback = bitfield_get(flags, 1);
+    imm = bitfield_get(flags, 2);
+    up = bitfield_get(flags, 3);
+    pre = bitfield_get(flags, 4);
+
+    core = &gba->core;
+
+    rd = bitfield_get_range(op, 12, 16);
+    rn = bitfield_get_range(op, 16, 20);
+    base = core->registers[rn];
+
+    if (imm) {
+        offset = (bitfield_get_range(op, 8, 12) << 4) | bitfield_get_range(op, 0, 4);
+    } else {
+        offset = core->registers[bitfield_get_range(op, 0, 4)];
+    }
+
+    core->prefetch_access_type = NON_SEQUENTIAL;
+    core->pc += 4;
+
+    addr = up ? base + offset : base - offset;
+    effective_addr = pre ? addr : base;
+
+    if (load) {
+        uint32_t val;
+
+        switch (sh) {
+            case 0b01: // Unsigned Halfword Load
+                val = mem_read16_ror(gba, effective_addr, NON_SEQUENTIAL);
+                break;
+            case 0b10: // Signed Byte Load
+                val = (int32_t)(int8_t)mem_read8(gba, effective_addr, NON_SEQUENTIAL);
+                break;
+            default: // Signed Halfword Load
+                if (bitfield_get(addr, 0)) {
+                    val = (int32_t)(int8_t)mem_read8(gba, effective_addr, NON_SEQUENTIAL);
+                } else {
+                    val = (int32_t)(int16_t)mem_read16(gba, effective_addr, NON_SEQUENTIAL);
+                }
+                break;
+        }
+
+        core_idle(gba);
+
+        if (!pre || writeback) {
+            core->registers[rn] = addr;
+        }
+
+        core->registers[rd] = val;
+    } else {
+        mem_write16(gba, effective_addr, core->registers[rd], NON_SEQUENTIAL);
+
+        if (!pre || writeback) {
+            core->registers[rn] = addr;
+        }
+    }
+}
+
+/*
+** The specialized handlers are referenced by name in `arm_lut`, see `decode_gen.c`.
+*/
+#define SDT_HANDLER(flags, offset_type)                                     \
+    void                                                                    \
+    core_arm_sdt_##flags##_##offset_type(struct gba *gba, uint32_t op)      \
+    {                                                                       \
+        core_arm_sdt_specialized(gba, op, flags, offset_type);              \
+    }
+
+#define SDT_FOR_EACH_OFFSET(X, flags)                                       \
+    X(flags, ARM_SDT_IMM)                                                   \
+    X(flags, ARM_SDT_REG_LSL)                                               \
+    X(flags, ARM_SDT_REG_LSR)                                               \
+    X(flags, ARM_SDT_REG_ASR)                                               \
+    X(flags, ARM_SDT_REG_ROR)
+
+#define HSDT_HANDLER(flags, sh)                                             \
+    void                                                                    \
+    core_arm_hsdt_##flags##_##sh(struct gba *gba, uint32_t op)              \
+    {                                                                       \
+        core_arm_hsdt_specialized(gba, op, flags, sh);                      \
+    }
+
+#define HSDT_FOR_EACH_SH(X, flags)                                          \
+    X(flags, 1)                                                             \
+    X(flags, 2)                                                             \
+    X(flags, 3)
+
+#define SDT_FOR_EACH_FLAGS(X, Y)                                            \
+    Y(X, 0)  Y(X, 1)  Y(X, 2)  Y(X, 3)  Y(X, 4)  Y(X, 5)  Y(X, 6)  Y(X, 7)  \
+    Y(X, 8)  Y(X, 9)  Y(X, 10) Y(X, 11) Y(X, 12) Y(X, 13) Y(X, 14) Y(X, 15) \
+    Y(X, 16) Y(X, 17) Y(X, 18) Y(X, 19) Y(X, 20) Y(X, 21) Y(X, 22) Y(X, 23) \
+    Y(X, 24) Y(X, 25) Y(X, 26) Y(X, 27) Y(X, 28) Y(X, 29) Y(X, 30) Y(X, 31)
+
+SDT_FOR_EACH_FLAGS(SDT_HANDLER, SDT_FOR_EACH_OFFSET)
+SDT_FOR_EACH_FLAGS(HSDT_HANDLER, HSDT_FOR_EACH_SH)
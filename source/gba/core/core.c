@@ -42,12 +42,8 @@ core_init(
         core->registers[i] = 0;
     }
 
-    for (i = 0; i < ARRAY_LEN(core->bank_registers); ++i) {
-        core->bank_registers[i] = 0;
-    }
-
-    core->r13_irq = 0x03007FA0;
-    core->r13_svc = 0x03007FE0;
+    core->bank_r13_r14[BANK_IRQ][0] = 0x03007FA0;
+    core->bank_r13_r14[BANK_SVC][0] = 0x03007FE0;
     core->sp = 0x03007F00;
     core->cpsr.mode = MODE_SYS;
     core->prefetch_access_type = NON_SEQUENTIAL;
@@ -68,31 +64,26 @@ core_next(
     core = &gba->core;
 
     /*
-    ** Ensure all the conditions to trigger any IRQ are met, and if they are, fire that interrupt.
+    ** Fire any pending IRQ, or wake the core up if it is halted.
     **
-    ** To trigger any interrupt, we need:
-    **   * The CPSR.I flag set to 0
-    **   * The bit 0 of the IME IO register set to 1
-    **   * That interrupt enabled in both REG_IE and REG_IF
+    ** `pending_irq` and `irq_line` are only recomputed by `core_scan_irq()` when
+    ** IE, IF, IME or CPSR.I change, so this boils down to testing a single flag.
     */
-    if (gba->io.int_enabled.raw & gba->io.int_flag.raw) {
-        switch (gba->core.state) {
+    if (unlikely(core->pending_irq)) {
+        switch (core->state) {
             case CORE_RUN: {
-                if (
-                       !gba->core.cpsr.irq_disable
-                    && (gba->io.ime.raw & 0b1)
-                ) {
+                if (core->irq_line) {
                     core_interrupt(gba, VEC_IRQ, MODE_IRQ);
                 }
                 break;
             };
             case CORE_HALT: {
-                gba->core.state = CORE_RUN;
+                core->state = CORE_RUN;
                 break;
             };
             case CORE_STOP: {
                 if (gba->io.int_flag.keypad) {
-                    gba->core.state = CORE_RUN;
+                    core->state = CORE_RUN;
                 }
                 break;
             };
@@ -101,6 +92,7 @@ core_next(
 
     if (likely(core->state == CORE_RUN)) {
         if (core->cpsr.thumb) {
+            uint32_t fused;
             uint16_t op;
 
             op = core->prefetch[0];
@@ -111,7 +103,41 @@ core_next(
                 panic(HS_CORE, "Unknown Thumb op-code 0x%04x (pc=0x%08x).", op, core->pc);
             }
 
-            thumb_lut[op >> 8](gba, op);
+#ifdef WITH_THUMB_PAIR_PROFILING
+            core_thumb_profile_pair(gba, op);
+#endif
+
+            /*
+            ** Use the fused handler if this instruction and the next one form a pair
+            ** that has one. See `core_thumb_fuse_rom()`.
+            */
+            fused = core_thumb_fused(&gba->memory, core->pc - 4);
+            if (fused) {
+                thumb_fused_insns[fused - 1].op(gba, op);
+                return ;
+            }
+
+            /*
+            ** Use the flag-free variant of the handler if the flags set by this instruction
+            ** are overwritten before being read. See `core_flags_analyze_rom()`.
+            */
+            switch (core_flags_liveness(&gba->memory, core->pc - 4, true)) {
+                case FLAGS_NOT_SET: {
+                    thumb_lut[op >> 8](gba, op);
+                    break;
+                };
+                case FLAGS_LIVE: {
+                    ++core->flags_set;
+                    thumb_lut[op >> 8](gba, op);
+                    break;
+                };
+                case FLAGS_DEAD: {
+                    ++core->flags_set;
+                    ++core->flags_elided;
+                    thumb_nf_lut[op >> 8](gba, op);
+                    break;
+                };
+            }
         } else {
             size_t idx;
             uint32_t op;
@@ -125,7 +151,7 @@ core_next(
             ** Ignore instructions where the conditions aren't met.
             */
 
-            idx = (bitfield_get_range(core->cpsr.raw, 28, 32) << 4) | (bitfield_get_range(op, 28, 32));
+            idx = (core_flags_nzcv(core) << 4) | (bitfield_get_range(op, 28, 32));
             if (unlikely(!cond_lut[idx])) {
                 core->pc += 4;
                 core->prefetch_access_type = SEQUENTIAL;
@@ -138,7 +164,23 @@ core_next(
                 panic(HS_CORE, "Unknown ARM op-code 0x%08x (pc=0x%08x).", op, core->pc);
             }
 
-            arm_lut[idx](gba, op);
+            switch (core_flags_liveness(&gba->memory, core->pc - 8, false)) {
+                case FLAGS_NOT_SET: {
+                    arm_lut[idx](gba, op);
+                    break;
+                };
+                case FLAGS_LIVE: {
+                    ++core->flags_set;
+                    arm_lut[idx](gba, op);
+                    break;
+                };
+                case FLAGS_DEAD: {
+                    ++core->flags_set;
+                    ++core->flags_elided;
+                    arm_nf_lut[idx](gba, op);
+                    break;
+                };
+            }
         }
     } else if (core->state == CORE_HALT) {
         core_idle(gba);
@@ -204,77 +246,18 @@ core_reload_pipeline(
     core->prefetch_access_type = SEQUENTIAL;
 }
 
-/*
-** Get the SPSR of the given mode.
-*/
-struct psr
-core_spsr_get(
-    struct core const *core,
-    enum arm_modes mode
-) {
-    switch (mode) {
-        case MODE_USR:
-        case MODE_SYS:
-            return (core->cpsr);
-        case MODE_FIQ:
-            return (core->spsr_fiq);
-        case MODE_IRQ:
-            return (core->spsr_irq);
-        case MODE_SVC:
-            return (core->spsr_svc);
-        case MODE_ABT:
-            return (core->spsr_abt);
-        case MODE_UND:
-            return (core->spsr_und);
-        default:
-            panic(HS_CORE, "core_spsr_get(): unsupported mode (%u)", mode);
-            break;
-    }
-}
-
-/*
-** Set the SPSR of the given mode to the given value.
-*/
-void
-core_spsr_set(
-    struct core *core,
-    enum arm_modes mode,
-    struct psr psr
-) {
-    switch (mode) {
-        case MODE_USR:
-        case MODE_SYS:
-            core->cpsr.raw = psr.raw;
-            break;
-        case MODE_FIQ:
-            core->spsr_fiq.raw = psr.raw;
-            break;
-        case MODE_IRQ:
-            core->spsr_irq.raw = psr.raw;
-            break;
-        case MODE_SVC:
-            core->spsr_svc.raw = psr.raw;
-            break;
-        case MODE_ABT:
-            core->spsr_abt.raw = psr.raw;
-            break;
-        case MODE_UND:
-            core->spsr_und.raw = psr.raw;
-            break;
-        default:
-            panic(HS_CORE, "core_spsr_set(): unsupported mode (%u)", mode);
-            break;
-    }
-}
-
 /*
 ** Switch from the current mode to the given one.
 **
 ** In practice, this function saves the content of the registers
 ** to the current mode's bank and replace their value with the
-** ones from the new mode's bank. It also sets the CPSR's mode bits\
+** ones from the new mode's bank. It also sets the CPSR's mode bits
 ** to the given mode.
 **
+** Only the registers that differ between the two banks are copied:
+** none between USR and SYS, r13-r14 between most modes and r8-r14
+** when entering or leaving FIQ.
+**
 ** No SPSRs are updated.
 */
 void
@@ -282,141 +265,53 @@ core_switch_mode(
     struct core *core,
     enum arm_modes mode
 ) {
-    if (mode != core->cpsr.mode) {
-
-        logln(
-            HS_CORE,
-            "Switching from %s to %s mode.",
-            arm_modes_name[core->cpsr.mode],
-            arm_modes_name[mode]
-        );
-
-        /* Save current registers to their bank */
-        switch (core->cpsr.mode) {
-            case MODE_SYS:
-            case MODE_USR:
-                core->r8_sys = core->r8;
-                core->r9_sys = core->r9;
-                core->r10_sys = core->r10;
-                core->r11_sys = core->fp;
-                core->r12_sys = core->ip;
-                core->r13_sys = core->sp;
-                core->r14_sys = core->lr;
-                break;
-            case MODE_FIQ:
-                core->r8_fiq = core->r8;
-                core->r9_fiq = core->r9;
-                core->r10_fiq = core->r10;
-                core->r11_fiq = core->fp;
-                core->r12_fiq = core->ip;
-                core->r13_fiq = core->sp;
-                core->r14_fiq = core->lr;
-                break;
-            case MODE_IRQ:
-                core->r8_sys = core->r8;
-                core->r9_sys = core->r9;
-                core->r10_sys = core->r10;
-                core->r11_sys = core->fp;
-                core->r12_sys = core->ip;
-                core->r13_irq = core->sp;
-                core->r14_irq = core->lr;
-                break;
-            case MODE_SVC:
-                core->r8_sys = core->r8;
-                core->r9_sys = core->r9;
-                core->r10_sys = core->r10;
-                core->r11_sys = core->fp;
-                core->r12_sys = core->ip;
-                core->r13_svc = core->sp;
-                core->r14_svc = core->lr;
-                break;
-            case MODE_ABT:
-                core->r8_sys = core->r8;
-                core->r9_sys = core->r9;
-                core->r10_sys = core->r10;
-                core->r11_sys = core->fp;
-                core->r12_sys = core->ip;
-                core->r13_abt = core->sp;
-                core->r14_abt = core->lr;
-                break;
-            case MODE_UND:
-                core->r8_sys = core->r8;
-                core->r9_sys = core->r9;
-                core->r10_sys = core->r10;
-                core->r11_sys = core->fp;
-                core->r12_sys = core->ip;
-                core->r13_und = core->sp;
-                core->r14_und = core->lr;
-                break;
-            default:
-                panic(HS_CORE, "core_switch_mode(): unsupported mode (%u)", core->cpsr.mode);
-                break;
-        }
+    uint32_t old_bank;
+    uint32_t new_bank;
 
-        core->cpsr.mode = mode;
-
-        /* Restore the registers based on the bank's content */
-        switch (mode) {
-            case MODE_SYS:
-            case MODE_USR:
-                core->r8 = core->r8_sys;
-                core->r9 = core->r9_sys;
-                core->r10 = core->r10_sys;
-                core->fp = core->r11_sys;
-                core->ip = core->r12_sys;
-                core->sp = core->r13_sys;
-                core->lr = core->r14_sys;
-                break;
-            case MODE_FIQ:
-                core->r8 = core->r8_fiq;
-                core->r9 = core->r9_fiq;
-                core->r10 = core->r10_fiq;
-                core->fp = core->r11_fiq;
-                core->ip = core->r12_fiq;
-                core->sp = core->r13_fiq;
-                core->lr = core->r14_fiq;
-                break;
-            case MODE_IRQ:
-                core->r8 = core->r8_sys;
-                core->r9 = core->r9_sys;
-                core->r10 = core->r10_sys;
-                core->fp = core->r11_sys;
-                core->ip = core->r12_sys;
-                core->sp = core->r13_irq;
-                core->lr = core->r14_irq;
-                break;
-            case MODE_SVC:
-                core->r8 = core->r8_sys;
-                core->r9 = core->r9_sys;
-                core->r10 = core->r10_sys;
-                core->fp = core->r11_sys;
-                core->ip = core->r12_sys;
-                core->sp = core->r13_svc;
-                core->lr = core->r14_svc;
-                break;
-            case MODE_ABT:
-                core->r8 = core->r8_sys;
-                core->r9 = core->r9_sys;
-                core->r10 = core->r10_sys;
-                core->fp = core->r11_sys;
-                core->ip = core->r12_sys;
-                core->sp = core->r13_abt;
-                core->lr = core->r14_abt;
-                break;
-            case MODE_UND:
-                core->r8 = core->r8_sys;
-                core->r9 = core->r9_sys;
-                core->r10 = core->r10_sys;
-                core->fp = core->r11_sys;
-                core->ip = core->r12_sys;
-                core->sp = core->r13_und;
-                core->lr = core->r14_und;
-                break;
-            default:
-                panic(HS_CORE, "core_switch_mode(): unsupported mode (%u)", mode);
-                break;
-        }
+    old_bank = core_mode_banks[core->cpsr.mode];
+    new_bank = core_mode_banks[mode & 0x1F];
+
+    if (unlikely(old_bank == BANK_LEN || new_bank == BANK_LEN)) {
+        panic(HS_CORE, "core_switch_mode(): unsupported mode (%u -> %u)", core->cpsr.mode, mode);
+    }
+
+    core->cpsr.mode = mode;
+
+    if (old_bank == new_bank) {
+        return ;
     }
+
+    if (unlikely(old_bank == BANK_FIQ || new_bank == BANK_FIQ)) {
+        memcpy(core->bank_r8_r12[old_bank == BANK_FIQ], &core->r8, sizeof(core->bank_r8_r12[0]));
+        memcpy(&core->r8, core->bank_r8_r12[new_bank == BANK_FIQ], sizeof(core->bank_r8_r12[0]));
+    }
+
+    core->bank_r13_r14[old_bank][0] = core->sp;
+    core->bank_r13_r14[old_bank][1] = core->lr;
+    core->sp = core->bank_r13_r14[new_bank][0];
+    core->lr = core->bank_r13_r14[new_bank][1];
+}
+
+/*
+** Restore the CPSR from the SPSR of the current mode, switching back to the mode
+** the exception was taken from.
+**
+** This is what data processing instructions with S=1 and Rd=PC, and LDM with
+** the S bit and PC in the register list, do.
+*/
+void
+core_exception_return(
+    struct gba *gba
+) {
+    struct core *core;
+    struct psr spsr;
+
+    core = &gba->core;
+    core_flags_sync(core);
+    spsr = core_spsr_get(core, core->cpsr.mode);
+    core_switch_mode(core, spsr.mode);
+    core->cpsr = spsr;
+    core_scan_irq(gba);
 }
 
 /*
@@ -432,10 +327,11 @@ core_interrupt(
     struct psr cpsr;
 
     core = &gba->core;
+    core_flags_sync(core);
 
     cpsr = core->cpsr;
     core_switch_mode(core, mode);
-    core_spsr_set(core, mode, cpsr);
+    core->spsr[core_mode_banks[mode]] = cpsr;   // Exceptions are never taken to USR or SYS mode
 
     if (vector == VEC_SVC || vector == VEC_UND) {
         core->lr = core->pc - (core->cpsr.thumb ? 2 : 4);
@@ -447,9 +343,45 @@ core_interrupt(
     core->cpsr.irq_disable = true;
     core->cpsr.thumb = false;
 
+    // CPSR.I is now set, so no IRQ can be raised until it is cleared. IE, IF and IME are unchanged.
+    core->irq_line = false;
+
     core_reload_pipeline(gba);
 }
 
+/*
+** Recompute the IRQ line of the core.
+**
+** This must be called each time IE, IF, IME or CPSR.I may have changed.
+**
+** To trigger any interrupt, we need:
+**   * The CPSR.I flag set to 0
+**   * The bit 0 of the IME IO register set to 1
+**   * That interrupt enabled in both REG_IE and REG_IF
+*/
+void
+core_scan_irq(
+    struct gba *gba
+) {
+    struct core *core;
+
+    core = &gba->core;
+    core->pending_irq = (gba->io.int_enabled.raw & gba->io.int_flag.raw) != 0;
+    core->irq_line = core->pending_irq && !core->cpsr.irq_disable && (gba->io.ime.raw & 0b1);
+}
+
+/*
+** Raise the given IRQ in REG_IF and update the IRQ line accordingly.
+*/
+void
+core_trigger_irq(
+    struct gba *gba,
+    enum arm_irq irq
+) {
+    gba->io.int_flag.raw |= (1 << irq);
+    core_scan_irq(gba);
+}
+
 /*
 ** Compute the operand of an instruction that uses an encoded shift register.
 ** If `carry` is not NULL, this will set the value pointed by `carry` to the
@@ -505,7 +437,7 @@ core_compute_shift(
             ** LSL by more than 32 has result zero, carry out zero.
             */
             if (bits == 0) {
-                carry_out = core->cpsr.carry;
+                carry_out = core_flags_carry(core);
             } else if (bits <= 32) {
                 value <<= bits - 1;
                 carry_out = (value >> 31) & 0b1;                    // Save the carry
@@ -556,7 +488,7 @@ core_compute_shift(
             if (bits == 0) {
                 carry_out = value & 0b1;
                 value >>= 1;
-                value |= core->cpsr.carry << 31;
+                value |= core_flags_carry(core) << 31;
             } else {
                 carry_out = (value >> (bits - 1)) & 0b1;    // Save the carry
                 value = ror32(value, bits);
@@ -0,0 +1,543 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Build-time generator of the decode tables.
+**
+** This program is run by meson when the emulator is built (see `source/gba/meson.build`).
+** It decodes the masks of all the instructions listed in `arm/insns.h` and `thumb/insns.h`,
+** ensures they don't collide and writes `arm_lut`, `arm_nf_lut`, `cond_lut`, `thumb_lut`,
+** `thumb_nf_lut` and `thumb_insns_idx` as constant arrays to the first file given as argument.
+**
+** The second file holds the thunks of the threaded interpreter, one per handler, and
+** `arm_threaded_lut` and `thumb_threaded_lut`. It is included by `core/threaded.c`.
+**
+** The handlers are referenced by name, so this program never links against the emulator.
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hades.h"
+#include "gba/core/arm.h"
+
+struct insn {
+    char const *name;
+    char const *mask;
+    char const *op;
+    char const *nf_op;      // Flag-free variant of `op`
+};
+
+struct decoded_insn {
+    uint32_t mask;
+    uint32_t value;
+};
+
+static struct insn const arm_insns[] = {
+#define ARM_INSN(name, mask, op)            { name, mask, #op, #op },
+#include "gba/core/arm/insns.h"
+#undef ARM_INSN
+};
+
+static struct insn const thumb_insns[] = {
+#define THUMB_INSN(name, mask, op, nf_op)   { name, mask, #op, #nf_op },
+#include "gba/core/thumb/insns.h"
+#undef THUMB_INSN
+};
+
+/*
+** The names of the enumerators of `enum arm_alu_operand` and `enum arm_sdt_offset`,
+** used to build the names of the specialized handlers (see `ALU_HANDLER` and `SDT_HANDLER`).
+*/
+static char const * const arm_alu_operands_name[] = {
+    [ARM_ALU_IMM]           = "ARM_ALU_IMM",
+    [ARM_ALU_REG_IMM_LSL]   = "ARM_ALU_REG_IMM_LSL",
+    [ARM_ALU_REG_IMM_LSR]   = "ARM_ALU_REG_IMM_LSR",
+    [ARM_ALU_REG_IMM_ASR]   = "ARM_ALU_REG_IMM_ASR",
+    [ARM_ALU_REG_IMM_ROR]   = "ARM_ALU_REG_IMM_ROR",
+    [ARM_ALU_REG_REG_LSL]   = "ARM_ALU_REG_REG_LSL",
+    [ARM_ALU_REG_REG_LSR]   = "ARM_ALU_REG_REG_LSR",
+    [ARM_ALU_REG_REG_ASR]   = "ARM_ALU_REG_REG_ASR",
+    [ARM_ALU_REG_REG_ROR]   = "ARM_ALU_REG_REG_ROR",
+};
+
+static_assert(ARRAY_LEN(arm_alu_operands_name) == ARM_ALU_OPERAND_LEN);
+
+static char const * const arm_sdt_offsets_name[] = {
+    [ARM_SDT_IMM]           = "ARM_SDT_IMM",
+    [ARM_SDT_REG_LSL]       = "ARM_SDT_REG_LSL",
+    [ARM_SDT_REG_LSR]       = "ARM_SDT_REG_LSR",
+    [ARM_SDT_REG_ASR]       = "ARM_SDT_REG_ASR",
+    [ARM_SDT_REG_ROR]       = "ARM_SDT_REG_ROR",
+};
+
+static_assert(ARRAY_LEN(arm_sdt_offsets_name) == ARM_SDT_OFFSET_LEN);
+
+/*
+** The tables being built, holding the name of the handlers.
+*/
+static char const *gen_arm_lut[4096];
+static char const *gen_arm_nf_lut[4096];
+static bool gen_cond_lut[256];
+static char const *gen_thumb_lut[256];
+static char const *gen_thumb_nf_lut[256];
+static size_t gen_thumb_insns_idx[256];
+
+static
+void
+__noreturn
+die(
+    char const *fmt,
+    ...
+) {
+    va_list va;
+
+    va_start(va, fmt);
+    fprintf(stderr, "decode_gen: ");
+    vfprintf(stderr, fmt, va);
+    fprintf(stderr, "\n");
+    va_end(va);
+    exit(EXIT_FAILURE);
+}
+
+static
+char const *
+format(
+    char const *fmt,
+    ...
+) {
+    char buffer[128];
+    va_list va;
+    char *str;
+
+    va_start(va, fmt);
+    vsnprintf(buffer, sizeof(buffer), fmt, va);
+    va_end(va);
+
+    str = strdup(buffer);
+    if (!str) {
+        die("out of memory");
+    }
+    return (str);
+}
+
+/*
+** Decode the user-friendly string masks of `insns` into `decoded` and ensure
+** there is no collision between any of them.
+*/
+static
+void
+decode_insns(
+    struct insn const *insns,
+    struct decoded_insn *decoded,
+    size_t len,
+    size_t bits
+) {
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        size_t j;
+        size_t k;
+
+        decoded[i].mask = 0;
+        decoded[i].value = 0;
+
+        j = 0; // Iterator over all the chars of `insns[i].mask`
+        k = 0; // Counter of non-separator characters of `insns[i].mask`
+        while (insns[i].mask[j]) {
+            if (insns[i].mask[j] != '_') { // Skip separators
+                decoded[i].mask <<= 1;
+                decoded[i].value <<= 1;
+
+                if (insns[i].mask[j] == '0' || insns[i].mask[j] == '1') {
+                    decoded[i].mask |= 1;
+                    decoded[i].value |= (insns[i].mask[j] - '0');
+                }
+                ++k;
+            }
+            ++j;
+        }
+
+        if (k != bits) {
+            die("instruction \"%s\" doesn't have a length of %zu bits", insns[i].name, bits);
+        }
+
+        /*
+        ** Ensure we don't have a collision with an existing instruction.
+        **
+        ** To do that, we must verify that there's at least one difference between
+        ** the instruction we want to add and all other instructions.
+        **
+        ** By difference, we mean at least one bit in common in the mask of both
+        ** instructions that maps to different values.
+        */
+        for (j = 0; j < i; ++j) {
+            if (!(((decoded[i].value ^ decoded[j].value) & decoded[i].mask) & decoded[j].mask)) {
+                die("instruction \"%s\" collides with \"%s\".", insns[i].name, insns[j].name);
+            }
+        }
+    }
+}
+
+/*
+** Build `arm_lut` and `arm_nf_lut`, indexed by bits 20-27 and 4-7 of the op-code.
+*/
+static
+void
+build_arm_lut(void)
+{
+    struct decoded_insn decoded[ARRAY_LEN(arm_insns)];
+    uint32_t i;
+
+    decode_insns(arm_insns, decoded, ARRAY_LEN(arm_insns), 32);
+
+    for (i = 0; i < ARRAY_LEN(gen_arm_lut); ++i) {
+        uint32_t op;
+        size_t j;
+
+        op = ((i & 0xFF0) << 16) | ((i & 0xF) << 4);
+        for (j = 0; j < ARRAY_LEN(arm_insns); ++j) {
+            if ((op & decoded[j].mask & 0x0FF000F0) == (decoded[j].value & 0x0FF000F0)) {
+
+                // Check for double matches, which means the LUT is too small and ambiguous.
+                if (gen_arm_lut[i]) {
+                    die("entry 0x%03x of arm_lut is ambiguous (\"%s\").", i, arm_insns[j].name);
+                }
+                gen_arm_lut[i] = arm_insns[j].op;
+            }
+        }
+
+        if (!gen_arm_lut[i]) {
+            continue;
+        }
+
+        /*
+        ** Replace the generic data processing handler by the one specialized for
+        ** this opcode, S bit and operand form.
+        */
+        if (!strcmp(gen_arm_lut[i], "core_arm_alu")) {
+            enum arm_alu_operand operand;
+
+            if (bitfield_get(i, 9)) { // Immediate
+                operand = ARM_ALU_IMM;
+            } else if (bitfield_get(i, 0)) { // Register, shifted by a register
+                operand = ARM_ALU_REG_REG_LSL + bitfield_get_range(i, 1, 3);
+            } else { // Register, shifted by an immediate value
+                operand = ARM_ALU_REG_IMM_LSL + bitfield_get_range(i, 1, 3);
+            }
+
+            gen_arm_lut[i] = format(
+                "core_arm_alu_%u_%u_%s",
+                bitfield_get_range(i, 5, 9),
+                bitfield_get(i, 4),
+                arm_alu_operands_name[operand]
+            );
+
+            // The flag-free variant is the same instruction with S=0.
+            gen_arm_nf_lut[i] = format(
+                "core_arm_alu_%u_0_%s",
+                bitfield_get_range(i, 5, 9),
+                arm_alu_operands_name[operand]
+            );
+        }
+
+        /*
+        ** Same for single data transfers, indexed by the P, U, B, W and L bits and the
+        ** offset form.
+        **
+        ** Register offsets with bit 4 set are undefined and left to the generic handler.
+        */
+        if (!strcmp(gen_arm_lut[i], "core_arm_sdt")) {
+            if (!bitfield_get(i, 9)) { // Immediate
+                gen_arm_lut[i] = format("core_arm_sdt_%u_%s", bitfield_get_range(i, 4, 9), arm_sdt_offsets_name[ARM_SDT_IMM]);
+            } else if (!bitfield_get(i, 0)) { // Register, shifted by an immediate value
+                gen_arm_lut[i] = format(
+                    "core_arm_sdt_%u_%s",
+                    bitfield_get_range(i, 4, 9),
+                    arm_sdt_offsets_name[ARM_SDT_REG_LSL + bitfield_get_range(i, 1, 3)]
+                );
+            }
+        }
+
+        /*
+        ** Same for halfword and signed data transfers, indexed by the P, U, I, W and L bits
+        ** and the sub-operation.
+        **
+        ** Stores other than STRH aren't supported and are left to the generic handler.
+        */
+        if (!strcmp(gen_arm_lut[i], "core_arm_hsdt") && (bitfield_get(i, 4) || bitfield_get_range(i, 1, 3) == 0b01)) {
+            gen_arm_lut[i] = format("core_arm_hsdt_%u_%u", bitfield_get_range(i, 4, 9), bitfield_get_range(i, 1, 3));
+        }
+
+        if (!gen_arm_nf_lut[i]) {
+            gen_arm_nf_lut[i] = gen_arm_lut[i];
+        }
+    }
+}
+
+/*
+** Build `cond_lut`, indexed by the condition (bits 0-3) and the NZCV flags (bits 4-7).
+*/
+static
+void
+build_cond_lut(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < ARRAY_LEN(gen_cond_lut); ++i) {
+        bool o;
+        bool c;
+        bool z;
+        bool n;
+
+        o = bitfield_get(i, 4);
+        c = bitfield_get(i, 5);
+        z = bitfield_get(i, 6);
+        n = bitfield_get(i, 7);
+        switch (bitfield_get_range(i, 0, 4)) {
+            case 0b0000: gen_cond_lut[i] = z; break;                    // EQ
+            case 0b0001: gen_cond_lut[i] = !z; break;                   // NE
+            case 0b0010: gen_cond_lut[i] = c; break;                    // CS
+            case 0b0011: gen_cond_lut[i] = !c; break;                   // CC
+            case 0b0100: gen_cond_lut[i] = n; break;                    // MI
+            case 0b0101: gen_cond_lut[i] = !n; break;                   // PL
+            case 0b0110: gen_cond_lut[i] = o; break;                    // VS
+            case 0b0111: gen_cond_lut[i] = !o; break;                   // VC
+            case 0b1000: gen_cond_lut[i] = c && !z; break;              // HI
+            case 0b1001: gen_cond_lut[i] = !c || z; break;              // LS
+            case 0b1010: gen_cond_lut[i] = n == o; break;               // GE
+            case 0b1011: gen_cond_lut[i] = n != o; break;               // LT
+            case 0b1100: gen_cond_lut[i] = !z && (n == o); break;       // GT
+            case 0b1101: gen_cond_lut[i] = z || (n != o); break;        // LE
+            case 0b1110: gen_cond_lut[i] = true; break;                 // AL
+            default:     gen_cond_lut[i] = false; break;
+        }
+    }
+}
+
+/*
+** Build `thumb_lut`, `thumb_nf_lut` and `thumb_insns_idx`, indexed by the upper
+** 8 bits of the op-code.
+*/
+static
+void
+build_thumb_lut(void)
+{
+    struct decoded_insn decoded[ARRAY_LEN(thumb_insns)];
+    uint32_t i;
+
+    decode_insns(thumb_insns, decoded, ARRAY_LEN(thumb_insns), 16);
+
+    for (i = 0; i < ARRAY_LEN(gen_thumb_lut); ++i) {
+        uint16_t op;
+        size_t j;
+
+        op = i << 8;
+        for (j = 0; j < ARRAY_LEN(thumb_insns); ++j) {
+            if ((op & decoded[j].mask & 0xFF00) == (decoded[j].value & 0xFF00)) {
+
+                // Check for double matches, which means the LUT is too small and ambiguous.
+                if (gen_thumb_lut[i]) {
+                    die("entry 0x%02x of thumb_lut is ambiguous (\"%s\").", i, thumb_insns[j].name);
+                }
+                gen_thumb_lut[i] = thumb_insns[j].op;
+                gen_thumb_nf_lut[i] = thumb_insns[j].nf_op;
+                gen_thumb_insns_idx[i] = j;
+            }
+        }
+    }
+}
+
+/*
+** Return true if entry `i` of `lut` is the first one referencing its handler.
+*/
+static
+bool
+first_reference(
+    char const * const *lut,
+    size_t i
+) {
+    size_t j;
+
+    if (!lut[i]) {
+        return (false);
+    }
+
+    for (j = 0; j < i; ++j) {
+        if (lut[j] && !strcmp(lut[i], lut[j])) {
+            return (false);
+        }
+    }
+    return (true);
+}
+
+/*
+** Declare all the handlers referenced by `lut` that weren't declared yet.
+*/
+static
+void
+emit_decls(
+    FILE *file,
+    char const * const *lut,
+    size_t len,
+    char const *op_type
+) {
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        if (first_reference(lut, i)) {
+            fprintf(file, "void %s(struct gba *gba, %s op);\n", lut[i], op_type);
+        }
+    }
+}
+
+/*
+** Define the thunk of the threaded interpreter of each handler referenced by `lut`,
+** with `thunk` (`THREADED_ARM_THUNK` or `THREADED_THUMB_THUNK`), and the table
+** pointing to them.
+**
+** Missing entries point to `unknown`.
+*/
+static
+void
+emit_threaded_lut(
+    FILE *file,
+    char const *name,
+    char const * const *lut,
+    size_t len,
+    char const *thunk,
+    char const *unknown
+) {
+    size_t i;
+
+    fprintf(file, "\n");
+    for (i = 0; i < len; ++i) {
+        if (first_reference(lut, i)) {
+            fprintf(file, "%s(%s)\n", thunk, lut[i]);
+        }
+    }
+
+    fprintf(file, "\nstatic void (* const %s[%zu])(struct gba *gba, uint32_t op) = {\n", name, len);
+    for (i = 0; i < len; ++i) {
+        if (lut[i]) {
+            fprintf(file, "    [0x%03zx] = %s_threaded,\n", i, lut[i]);
+        } else {
+            fprintf(file, "    [0x%03zx] = %s,\n", i, unknown);
+        }
+    }
+    fprintf(file, "};\n");
+}
+
+static
+void
+emit_lut(
+    FILE *file,
+    char const *name,
+    char const * const *lut,
+    size_t len,
+    char const *op_type
+) {
+    size_t i;
+
+    fprintf(file, "\nvoid (* const %s[%zu])(struct gba *gba, %s op) = {\n", name, len, op_type);
+    for (i = 0; i < len; ++i) {
+        if (lut[i]) {
+            fprintf(file, "    [0x%03zx] = %s,\n", i, lut[i]);
+        }
+    }
+    fprintf(file, "};\n");
+}
+
+int
+main(
+    int argc,
+    char *argv[]
+) {
+    FILE *file;
+    size_t i;
+
+    if (argc != 3) {
+        die("usage: %s <output.c> <threaded_output.h>", argv[0]);
+    }
+
+    build_arm_lut();
+    build_cond_lut();
+    build_thumb_lut();
+
+    file = fopen(argv[1], "w");
+    if (!file) {
+        die("can't open \"%s\".", argv[1]);
+    }
+
+    fprintf(file, "/*\n** Generated by `source/gba/core/decode_gen.c`. Do not edit.\n*/\n\n");
+    fprintf(file, "#include \"gba/gba.h\"\n");
+    fprintf(file, "#include \"gba/core/arm.h\"\n");
+    fprintf(file, "#include \"gba/core/thumb.h\"\n\n");
+
+    emit_decls(file, gen_arm_lut, ARRAY_LEN(gen_arm_lut), "uint32_t");
+    emit_decls(file, gen_arm_nf_lut, ARRAY_LEN(gen_arm_nf_lut), "uint32_t");
+    emit_decls(file, gen_thumb_lut, ARRAY_LEN(gen_thumb_lut), "uint16_t");
+    emit_decls(file, gen_thumb_nf_lut, ARRAY_LEN(gen_thumb_nf_lut), "uint16_t");
+
+    emit_lut(file, "arm_lut", gen_arm_lut, ARRAY_LEN(gen_arm_lut), "uint32_t");
+    emit_lut(file, "arm_nf_lut", gen_arm_nf_lut, ARRAY_LEN(gen_arm_nf_lut), "uint32_t");
+    emit_lut(file, "thumb_lut", gen_thumb_lut, ARRAY_LEN(gen_thumb_lut), "uint16_t");
+    emit_lut(file, "thumb_nf_lut", gen_thumb_nf_lut, ARRAY_LEN(gen_thumb_nf_lut), "uint16_t");
+
+    fprintf(file, "\nbool const cond_lut[%zu] = {", ARRAY_LEN(gen_cond_lut));
+    for (i = 0; i < ARRAY_LEN(gen_cond_lut); ++i) {
+        fprintf(file, "%s%u,", (i % 16) ? " " : "\n    ", gen_cond_lut[i]);
+    }
+    fprintf(file, "\n};\n");
+
+    fprintf(file, "\nuint8_t const thumb_insns_idx[%zu] = {", ARRAY_LEN(gen_thumb_insns_idx));
+    for (i = 0; i < ARRAY_LEN(gen_thumb_insns_idx); ++i) {
+        fprintf(file, "%s%zu,", (i % 16) ? " " : "\n    ", gen_thumb_insns_idx[i]);
+    }
+    fprintf(file, "\n};\n");
+
+    if (fclose(file)) {
+        die("can't write \"%s\".", argv[1]);
+    }
+
+    file = fopen(argv[2], "w");
+    if (!file) {
+        die("can't open \"%s\".", argv[2]);
+    }
+
+    fprintf(file, "/*\n** Generated by `source/gba/core/decode_gen.c`. Do not edit.\n**\n");
+    fprintf(file, "** Included by `source/gba/core/threaded.c`.\n*/\n\n");
+
+    emit_decls(file, gen_arm_lut, ARRAY_LEN(gen_arm_lut), "uint32_t");
+    emit_decls(file, gen_thumb_lut, ARRAY_LEN(gen_thumb_lut), "uint16_t");
+
+    emit_threaded_lut(
+        file,
+        "arm_threaded_lut",
+        gen_arm_lut,
+        ARRAY_LEN(gen_arm_lut),
+        "THREADED_ARM_THUNK",
+        "core_arm_threaded_unknown"
+    );
+    emit_threaded_lut(
+        file,
+        "thumb_threaded_lut",
+        gen_thumb_lut,
+        ARRAY_LEN(gen_thumb_lut),
+        "THREADED_THUMB_THUNK",
+        "core_thumb_threaded_unknown"
+    );
+
+    if (fclose(file)) {
+        die("can't write \"%s\".", argv[2]);
+    }
+
+    return (EXIT_SUCCESS);
+}
@@ -0,0 +1,409 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Flag liveness analysis.
+**
+** A lot of flag-setting instructions have their flags overwritten by the next
+** few instructions before anything reads them (eg. an ADD followed by a CMP).
+** Because the ROM never changes, we can find those instructions once, when the
+** ROM is loaded, and dispatch them to a variant of their handler that doesn't
+** record the flags at all.
+**
+** Each halfword (Thumb) and each word (ARM) of the ROM is analyzed as if it
+** was an instruction, and the straight-line code that follows it is scanned
+** until each flag it sets is either read (live) or overwritten (dead). Anything
+** that may leave the straight-line code (branches, writes to PC, SWI, etc.) makes
+** the flags live.
+**
+** The only observable difference is the value of the condition flags saved in
+** SPSR_irq when an IRQ is taken between a flags-dead instruction and the one
+** overwriting its flags. They are restored when the handler returns and are
+** overwritten right away, so only a handler inspecting them could notice.
+*/
+
+#include <string.h>
+#include "hades.h"
+#include "gba/gba.h"
+#include "gba/core.h"
+#include "gba/core/arm.h"
+#include "gba/core/thumb.h"
+
+/*
+** The maximum amount of instructions scanned after a flag-setting instruction.
+*/
+#define LIVENESS_WINDOW         8
+#define LIVENESS_RING           16
+
+/*
+** The condition flags, as a bit mask.
+*/
+#define FLAG_N                  0b1000
+#define FLAG_Z                  0b0100
+#define FLAG_C                  0b0010
+#define FLAG_V                  0b0001
+#define FLAG_NZ                 (FLAG_N | FLAG_Z)
+#define FLAG_NZC                (FLAG_N | FLAG_Z | FLAG_C)
+#define FLAG_NZCV               (FLAG_N | FLAG_Z | FLAG_C | FLAG_V)
+
+/*
+** How an instruction interacts with the condition flags.
+**
+** `write` only holds the flags that are always overwritten. Flags that may or may
+** not be written (eg. the carry of a shift by a register, only written when the shift
+** amount isn't zero) are in `maybe_write`: they don't kill the flags set by a previous
+** instruction, but the instruction can only be flags-dead if they are dead too.
+*/
+struct flags_effect {
+    uint8_t read;
+    uint8_t write;
+    uint8_t maybe_write;
+    bool barrier;       // The instruction may leave the straight-line code
+};
+
+static
+struct flags_effect
+thumb_flags_effect(
+    uint16_t op
+) {
+    struct flags_effect effect;
+
+    effect = (struct flags_effect){ 0 };
+
+    if (!thumb_lut[op >> 8]) {
+        effect.barrier = true;
+        return (effect);
+    }
+
+    switch (op >> 11) {
+        case 0b00000: // LSL
+            effect.write = bitfield_get_range(op, 6, 11) ? FLAG_NZC : FLAG_NZ;
+            break;
+        case 0b00001: // LSR
+        case 0b00010: // ASR
+            effect.write = FLAG_NZC;
+            break;
+        case 0b00011: // ADD/SUB (low registers)
+            effect.write = FLAG_NZCV;
+            break;
+        case 0b00100: // MOV immediate
+            effect.write = FLAG_NZ;
+            break;
+        case 0b00101: // CMP immediate
+        case 0b00110: // ADD immediate
+        case 0b00111: // SUB immediate
+            effect.write = FLAG_NZCV;
+            break;
+        case 0b01000: {
+            if (!bitfield_get(op, 10)) { // ALU operations
+                switch (bitfield_get_range(op, 6, 10)) {
+                    case 0b0101: // ADC
+                    case 0b0110: // SBC
+                        effect.read = FLAG_C;
+                        effect.write = FLAG_NZCV;
+                        break;
+                    case 0b1001: // NEG
+                    case 0b1010: // CMP
+                    case 0b1011: // CMN
+                        effect.write = FLAG_NZCV;
+                        break;
+                    case 0b1101: // MUL
+                        effect.write = FLAG_NZC;
+                        break;
+                    case 0b0010: // LSL
+                    case 0b0011: // LSR
+                    case 0b0100: // ASR
+                    case 0b0111: // ROR
+                        effect.write = FLAG_NZ;
+                        effect.maybe_write = FLAG_C;
+                        break;
+                    default: // Logical operations
+                        effect.write = FLAG_NZ;
+                        break;
+                }
+            } else {
+                switch (bitfield_get_range(op, 8, 10)) {
+                    case 0b01: // CMP (high registers)
+                        effect.write = FLAG_NZCV;
+                        break;
+                    case 0b11: // BX
+                        effect.barrier = true;
+                        break;
+                    default: // ADD/MOV (high registers), a barrier when Rd is PC
+                        effect.barrier = (bitfield_get_range(op, 0, 3) + bitfield_get(op, 7) * 8) == 15;
+                        break;
+                }
+            }
+            break;
+        };
+        case 0b10110:
+        case 0b10111: {
+            // POP {..., PC} or POP {} (which loads PC), and everything that isn't ADD SP/PUSH/POP
+            if ((op & 0xF600) == 0xB400) {
+                effect.barrier = bitfield_get(op, 11) && (bitfield_get(op, 8) || !bitfield_get_range(op, 0, 8));
+            } else {
+                effect.barrier = (op & 0xFF00) != 0xB000;
+            }
+            break;
+        };
+        case 0b11001: // LDMIA, which loads PC when the register list is empty
+            effect.barrier = !bitfield_get_range(op, 0, 8);
+            break;
+        case 0b11010: // Conditional branches, SWI
+        case 0b11011:
+        case 0b11100: // B
+        case 0b11101:
+        case 0b11110: // BL
+        case 0b11111:
+            effect.barrier = true;
+            break;
+        default: // Other loads and stores, none of them can write to PC
+            break;
+    }
+    return (effect);
+}
+
+static
+struct flags_effect
+arm_flags_effect(
+    uint32_t op
+) {
+    struct flags_effect effect;
+    void (*handler)(struct gba *, uint32_t);
+
+    effect = (struct flags_effect){ 0 };
+    handler = arm_lut[((op >> 16) & 0xFF0) | ((op >> 4) & 0x00F)];
+
+    if (!handler || bitfield_get_range(op, 28, 32) == 0b1111) {
+        effect.barrier = true;
+        return (effect);
+    }
+
+    // Conditional instructions read the flags and only write them if the condition is met.
+    if (bitfield_get_range(op, 28, 32) != COND_AL) {
+        effect.read = FLAG_NZCV;
+    }
+
+    switch (bitfield_get_range(op, 25, 28)) {
+        case 0b000:
+        case 0b001: {
+            uint32_t opcode;
+
+            // BX, MSR and everything writing to PC
+            if (
+                   handler == core_arm_branch_xchg
+                || handler == core_arm_msr
+                || handler == core_arm_swp
+                || bitfield_get_range(op, 12, 16) == 15
+            ) {
+                effect.barrier = true;
+                break;
+            }
+
+            if (handler == core_arm_mrs) {
+                effect.read = FLAG_NZCV;
+                break;
+            }
+
+            if (handler == core_arm_mul || handler == core_arm_mull) {
+                if (bitfield_get(op, 20)) {
+                    effect.write = FLAG_NZ;
+                }
+                effect.barrier = bitfield_get_range(op, 16, 20) == 15;
+                break;
+            }
+
+            // Halfword and signed data transfers
+            if (!bitfield_get(op, 25) && bitfield_get(op, 4) && bitfield_get(op, 7)) {
+                break;
+            }
+
+            // Data processing
+            opcode = bitfield_get_range(op, 21, 25);
+
+            // RRX reads the carry
+            if (!bitfield_get(op, 25) && (op & 0xFF0) == 0x060) {
+                effect.read |= FLAG_C;
+            }
+
+            switch (opcode) {
+                case 5: // ADC
+                case 6: // SBC
+                case 7: // RSC
+                    effect.read |= FLAG_C;
+                    break;
+            }
+
+            if (!bitfield_get(op, 20)) {
+                break;
+            }
+
+            switch (opcode) {
+                case 2:  // SUB
+                case 3:  // RSB
+                case 4:  // ADD
+                case 5:  // ADC
+                case 6:  // SBC
+                case 7:  // RSC
+                case 10: // CMP
+                case 11: // CMN
+                    effect.write = FLAG_NZCV;
+                    break;
+                default:
+                    // The carry is only overwritten when the shifter produces one
+                    if (bitfield_get(op, 25)) {
+                        effect.write = bitfield_get_range(op, 8, 12) ? FLAG_NZC : FLAG_NZ;
+                    } else if (!bitfield_get(op, 4)) {
+                        effect.write = (op & 0xFE0) ? FLAG_NZC : FLAG_NZ;
+                    } else { // Shift by a register, the carry is only written if the amount isn't zero
+                        effect.write = FLAG_NZ;
+                        effect.maybe_write = FLAG_C;
+                    }
+                    break;
+            }
+            break;
+        };
+        case 0b010:
+        case 0b011: {
+            // Loads to PC
+            effect.barrier = bitfield_get(op, 20) && bitfield_get_range(op, 12, 16) == 15;
+
+            // RRX reads the carry
+            if (bitfield_get(op, 25) && (op & 0xFF0) == 0x060) {
+                effect.read |= FLAG_C;
+            }
+            break;
+        };
+        case 0b100: {
+            // LDM with PC or with an empty register list (which loads PC), and LDM/STM with the S bit
+            effect.barrier = bitfield_get(op, 22) || (bitfield_get(op, 20) && (bitfield_get(op, 15) || !bitfield_get_range(op, 0, 16)));
+            break;
+        };
+        default: // Branches, SWI
+            effect.barrier = true;
+            break;
+    }
+    return (effect);
+}
+
+/*
+** Return the liveness of the flags set by the instruction `effects[first]`,
+** given the effect of the `len - 1` instructions following it.
+**
+** `effects` is a ring buffer of `LIVENESS_RING` entries.
+*/
+static
+enum core_flags_liveness
+flags_liveness(
+    struct flags_effect const *effects,
+    size_t first,
+    size_t len
+) {
+    struct flags_effect const *insn;
+    uint8_t flags;
+    size_t i;
+
+    insn = &effects[first % LIVENESS_RING];
+    flags = insn->write | insn->maybe_write;
+    if (!flags || insn->barrier) {
+        return (flags ? FLAGS_LIVE : FLAGS_NOT_SET);
+    }
+
+    for (i = 1; i < len; ++i) {
+        insn = &effects[(first + i) % LIVENESS_RING];
+        if (insn->barrier || (insn->read & flags)) {
+            return (FLAGS_LIVE);
+        }
+
+        flags &= ~insn->write;
+        if (!flags) {
+            return (FLAGS_DEAD);
+        }
+    }
+    return (FLAGS_LIVE);
+}
+
+/*
+** Compute the liveness of the flags set by every instruction of the ROM.
+**
+** Called by `mem_load_rom()` the first time a ROM is loaded, on zeroed analysis arrays,
+** before `core_thumb_fuse_rom()`.
+*/
+void
+core_flags_analyze_rom(
+    struct gba *gba
+) {
+    struct memory *memory;
+    struct flags_effect effects[LIVENESS_RING];
+    size_t setters[2];
+    size_t dead[2];
+    size_t len;
+    size_t i;
+
+    memory = &gba->memory;
+    memset(setters, 0, sizeof(setters));
+    memset(dead, 0, sizeof(dead));
+
+    /* Thumb */
+    len = memory->rom_size / sizeof(uint16_t);
+    for (i = 0; i < min(LIVENESS_WINDOW, len); ++i) {
+        effects[i] = thumb_flags_effect(((uint16_t const *)memory->rom)[i]);
+    }
+
+    for (i = 0; i < len; ++i) {
+        enum core_flags_liveness liveness;
+
+        if (i + LIVENESS_WINDOW < len) {
+            effects[(i + LIVENESS_WINDOW) % LIVENESS_RING] = thumb_flags_effect(((uint16_t const *)memory->rom)[i + LIVENESS_WINDOW]);
+        }
+
+        liveness = flags_liveness(effects, i, min(LIVENESS_WINDOW + 1, len - i));
+        memory->rom_thumb_insns[i] = liveness;
+        setters[0] += (liveness != FLAGS_NOT_SET);
+        dead[0] += (liveness == FLAGS_DEAD);
+    }
+
+    /* ARM */
+    len = memory->rom_size / sizeof(uint32_t);
+    for (i = 0; i < min(LIVENESS_WINDOW, len); ++i) {
+        effects[i] = arm_flags_effect(((uint32_t const *)memory->rom)[i]);
+    }
+
+    for (i = 0; i < len; ++i) {
+        enum core_flags_liveness liveness;
+        uint32_t op;
+        size_t idx;
+
+        if (i + LIVENESS_WINDOW < len) {
+            effects[(i + LIVENESS_WINDOW) % LIVENESS_RING] = arm_flags_effect(((uint32_t const *)memory->rom)[i + LIVENESS_WINDOW]);
+        }
+
+        liveness = flags_liveness(effects, i, min(LIVENESS_WINDOW + 1, len - i));
+
+        // Only data processing instructions have a flag-free variant
+        op = ((uint32_t const *)memory->rom)[i];
+        idx = ((op >> 16) & 0xFF0) | ((op >> 4) & 0x00F);
+        if (liveness == FLAGS_DEAD && arm_nf_lut[idx] == arm_lut[idx]) {
+            liveness = FLAGS_LIVE;
+        }
+
+        memory->rom_arm_flags[i >> 2] |= liveness << ((i & 0b11) * 2);
+        setters[1] += (liveness != FLAGS_NOT_SET);
+        dead[1] += (liveness == FLAGS_DEAD);
+    }
+
+    logln(
+        HS_CORE,
+        "Flag liveness: %zu/%zu Thumb and %zu/%zu ARM flag-setting instructions are flags-dead.",
+        dead[0],
+        setters[0],
+        dead[1],
+        setters[1]
+    );
+}
@@ -0,0 +1,202 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Threaded-code interpreter.
+**
+** Instead of returning to `core_next()` after each instruction, every handler
+** is wrapped in a thunk that fetches the next instruction and tail-calls its
+** thunk directly. This removes the call/return overhead of the main loop and
+** gives each handler its own indirect branch, and therefore its own slot in
+** the host's branch predictor.
+**
+** This relies on `__attribute__((musttail))` to guarantee the stack doesn't
+** grow, and is only enabled when building with `-Dthreaded_dispatch=true` on
+** a compiler that supports it. Otherwise, `core_next()` is used as usual.
+*/
+
+#include "hades.h"
+#include "gba/gba.h"
+#include "gba/core.h"
+#include "gba/core/arm.h"
+#include "gba/core/thumb.h"
+
+#ifdef WITH_THREADED_DISPATCH
+
+# if !defined(__has_attribute) || !__has_attribute(musttail)
+#  error "The threaded interpreter requires a compiler supporting __attribute__((musttail))."
+# endif
+
+# define __musttail         __attribute__((musttail))
+
+# ifdef WITH_THUMB_PAIR_PROFILING
+#  define THREADED_PROFILE_PAIR(gba, op)    core_thumb_profile_pair((gba), (op))
+# else
+#  define THREADED_PROFILE_PAIR(gba, op)
+# endif
+
+static void (* const arm_threaded_lut[4096])(struct gba *gba, uint32_t op);
+static void (* const thumb_threaded_lut[256])(struct gba *gba, uint32_t op);
+
+/*
+** Fetch the next instruction and tail-call its handler.
+**
+** Leave the threaded interpreter when the cycle budget is consumed, when an IRQ
+** must be serviced or when the core isn't running anymore. `core_next()` takes
+** care of those cases.
+**
+** Flags-dead instructions and fused pairs call their handler directly instead of
+** getting their own thunk.
+**
+** This is a macro so that every thunk gets its own copy of the indirect jump.
+*/
+# define THREADED_DISPATCH(gba)                                                                     \
+    do {                                                                                            \
+        struct core *_core;                                                                         \
+        enum core_flags_liveness _liveness;                                                         \
+        uint32_t _fused;                                                                            \
+                                                                                                    \
+        _core = &(gba)->core;                                                                       \
+        for (;;) {                                                                                  \
+            if (unlikely(                                                                           \
+                   _core->cycles >= _core->target_cycles                                            \
+                || _core->irq_line                                                                  \
+                || _core->state != CORE_RUN                                                         \
+            )) {                                                                                    \
+                return ;                                                                            \
+            }                                                                                       \
+                                                                                                    \
+            if (_core->cpsr.thumb) {                                                                \
+                uint16_t _op;                                                                       \
+                                                                                                    \
+                _op = _core->prefetch[0];                                                           \
+                _core->prefetch[0] = _core->prefetch[1];                                            \
+                _core->prefetch[1] = mem_read16((gba), _core->pc, _core->prefetch_access_type);     \
+                                                                                                    \
+                THREADED_PROFILE_PAIR((gba), _op);                                                  \
+                _fused = core_thumb_fused(&(gba)->memory, _core->pc - 4);                           \
+                if (_fused) {                                                                       \
+                    thumb_fused_insns[_fused - 1].op((gba), _op);                                   \
+                    continue;                                                                       \
+                }                                                                                   \
+                                                                                                    \
+                _liveness = core_flags_liveness(&(gba)->memory, _core->pc - 4, true);               \
+                if (_liveness != FLAGS_NOT_SET) {                                                   \
+                    ++_core->flags_set;                                                             \
+                    if (_liveness == FLAGS_DEAD) {                                                  \
+                        ++_core->flags_elided;                                                      \
+                        thumb_nf_lut[_op >> 8]((gba), _op);                                         \
+                        continue;                                                                   \
+                    }                                                                               \
+                }                                                                                   \
+                __musttail return thumb_threaded_lut[_op >> 8]((gba), _op);                         \
+            } else {                                                                                \
+                uint32_t _op;                                                                       \
+                size_t _idx;                                                                        \
+                                                                                                    \
+                _op = _core->prefetch[0];                                                           \
+                _core->prefetch[0] = _core->prefetch[1];                                            \
+                _core->prefetch[1] = mem_read32((gba), _core->pc, _core->prefetch_access_type);     \
+                                                                                                    \
+                _idx = (core_flags_nzcv(_core) << 4)                                                \
+                     | (bitfield_get_range(_op, 28, 32))                                            \
+                ;                                                                                   \
+                if (unlikely(!cond_lut[_idx])) {                                                    \
+                    _core->pc += 4;                                                                 \
+                    _core->prefetch_access_type = SEQUENTIAL;                                       \
+                    continue;                                                                       \
+                }                                                                                   \
+                                                                                                    \
+                _idx = ((_op >> 16) & 0xFF0) | ((_op >> 4) & 0x00F);                               \
+                                                                                                    \
+                _liveness = core_flags_liveness(&(gba)->memory, _core->pc - 8, false);              \
+                if (_liveness != FLAGS_NOT_SET) {                                                   \
+                    ++_core->flags_set;                                                             \
+                    if (_liveness == FLAGS_DEAD) {                                                  \
+                        ++_core->flags_elided;                                                      \
+                        arm_nf_lut[_idx]((gba), _op);                                               \
+                        continue;                                                                   \
+                    }                                                                               \
+                }                                                                                   \
+                __musttail return arm_threaded_lut[_idx]((gba), _op);                               \
+            }                                                                                       \
+        }                                                                                           \
+    } while (0)
+
+# define THREADED_ARM_THUNK(handler)                                                                \
+    static void handler##_threaded(struct gba *gba, uint32_t op)                                    \
+    {                                                                                               \
+        handler(gba, op);                                                                           \
+        THREADED_DISPATCH(gba);                                                                     \
+    }
+
+# define THREADED_THUMB_THUNK(handler)                                                              \
+    static void handler##_threaded(struct gba *gba, uint32_t op)                                    \
+    {                                                                                               \
+        handler(gba, (uint16_t)op);                                                                 \
+        THREADED_DISPATCH(gba);                                                                     \
+    }
+
+static
+void
+core_arm_threaded_unknown(
+    struct gba *gba,
+    uint32_t op
+) {
+    panic(HS_CORE, "Unknown ARM op-code 0x%08x (pc=0x%08x).", op, gba->core.pc);
+}
+
+static
+void
+core_thumb_threaded_unknown(
+    struct gba *gba,
+    uint32_t op
+) {
+    panic(HS_CORE, "Unknown Thumb op-code 0x%04x (pc=0x%08x).", op, gba->core.pc);
+}
+
+/*
+** The thunks of all the handlers referenced by `arm_lut` and `thumb_lut`, including every
+** specialized one, and `arm_threaded_lut` and `thumb_threaded_lut` pointing to them.
+**
+** Generated at compile time by `decode_gen.c`.
+*/
+# include "threaded_tables.h"
+
+/*
+** Entry point of the threaded interpreter.
+*/
+static
+void
+core_threaded_enter(
+    struct gba *gba,
+    uint32_t op __unused
+) {
+    THREADED_DISPATCH(gba);
+}
+
+/*
+** Run the core until `target` cycles are reached, an IRQ has to be serviced or
+** the core is halted/stopped.
+**
+** The first instruction is always executed by `core_next()`, which handles IRQs
+** and the halted/stopped states.
+*/
+void
+core_run_threaded(
+    struct gba *gba,
+    uint64_t target
+) {
+    core_next(gba);
+
+    gba->core.target_cycles = target;
+    core_threaded_enter(gba, 0);
+}
+
+#endif /* WITH_THREADED_DISPATCH */
\ No newline at end of file
@@ -9,6 +9,7 @@
 
 #include "hades.h"
 #include "gba/gba.h"
+#include "gba/core/thumb.h"
 
 static
 void
@@ -40,10 +41,12 @@ core_arm_mul_idle_signed(
 /*
 ** Implement the ADD instruction (low registers).
 */
+static inline __attribute__((always_inline))
 void
-core_thumb_lo_add(
+core_thumb_lo_add_impl(
     struct gba *gba,
-    uint16_t op
+    uint16_t op,
+    bool flags
 ) {
     struct core *core;
     uint32_t res;
@@ -65,24 +68,26 @@ core_thumb_lo_add(
     }
 
     res = core->registers[rs] + rhs;
-
-    core->cpsr.zero = !res;
-    core->cpsr.negative = bitfield_get(res, 31);
-    core->cpsr.carry = uadd32(core->registers[rs], rhs, 0);
-    core->cpsr.overflow = iadd32(core->registers[rs], rhs, 0);
+    if (flags) {
+        core_flags_add(core, core->registers[rs], rhs, res);
+    }
 
     core->registers[rd] = res;
     core->pc += 2;
     core->prefetch_access_type = SEQUENTIAL;
 }
 
+THUMB_FLAGS_HANDLERS(lo_add)
+
 /*
 ** Implement the SUB instruction (low registers).
 */
+static inline __attribute__((always_inline))
 void
-core_thumb_lo_sub(
+core_thumb_lo_sub_impl(
     struct gba *gba,
-    uint16_t op
+    uint16_t op,
+    bool flags
 ) {
     struct core *core;
     uint32_t res;
@@ -104,24 +109,26 @@ core_thumb_lo_sub(
     }
 
     res = core->registers[rs] - rhs;
-
-    core->cpsr.zero = !res;
-    core->cpsr.negative = bitfield_get(res, 31);
-    core->cpsr.carry = usub32(core->registers[rs], rhs, 0);
-    core->cpsr.overflow = isub32(core->registers[rs], rhs, 0);
+    if (flags) {
+        core_flags_sub(core, core->registers[rs], rhs, res);
+    }
 
     core->registers[rd] = res;
     core->pc += 2;
     core->prefetch_access_type = SEQUENTIAL;
 }
 
+THUMB_FLAGS_HANDLERS(lo_sub)
+
 /*
 ** Implement the MOV from immediate instruction.
 */
+static inline __attribute__((always_inline))
 void
-core_thumb_mov_imm(
+core_thumb_mov_imm_impl(
     struct gba *gba,
-    uint16_t op
+    uint16_t op,
+    bool flags
 ) {
     struct core *core;
     uint16_t rd;
@@ -133,19 +140,24 @@ core_thumb_mov_imm(
     imm = bitfield_get_range(op, 0, 8);
 
     core->registers[rd] = imm;
-    core->cpsr.zero = !(core->registers[rd]);
-    core->cpsr.negative = bitfield_get(core->registers[rd], 31); // Useless ?
+    if (flags) {
+        core_flags_nz(core, imm);
+    }
     core->pc += 2;
     core->prefetch_access_type = SEQUENTIAL;
 }
 
+THUMB_FLAGS_HANDLERS(mov_imm)
+
 /*
 ** Implement the Compare Immediate instructions.
 */
+static inline __attribute__((always_inline))
 void
-core_thumb_cmp_imm(
+core_thumb_cmp_imm_impl(
     struct gba *gba,
-    uint16_t op
+    uint16_t op,
+    bool flags
 ) {
     struct core *core;
     uint16_t rd;
@@ -157,22 +169,24 @@ core_thumb_cmp_imm(
     rd = bitfield_get_range(op, 8, 11);
     imm = bitfield_get_range(op, 0, 8);
     tmp = core->registers[rd] - imm;
-
-    core->cpsr.zero = !tmp;
-    core->cpsr.negative = bitfield_get(tmp, 31);
-    core->cpsr.carry = usub32(core->registers[rd], imm, 0);
-    core->cpsr.overflow = isub32(core->registers[rd], imm, 0);
+    if (flags) {
+        core_flags_sub(core, core->registers[rd], imm, tmp);
+    }
     core->pc += 2;
     core->prefetch_access_type = SEQUENTIAL;
 }
 
+THUMB_FLAGS_HANDLERS(cmp_imm)
+
 /*
 ** Implement the ADD immediate instruction.
 */
+static inline __attribute__((always_inline))
 void
-core_thumb_add_imm(
+core_thumb_add_imm_impl(
     struct gba *gba,
-    uint16_t op
+    uint16_t op,
+    bool flags
 ) {
     struct core *core;
     uint16_t rd;
@@ -182,24 +196,25 @@ core_thumb_add_imm(
     rd = bitfield_get_range(op, 8, 11);
     imm = bitfield_get_range(op, 0, 8);
 
-    core->cpsr.carry = uadd32(core->registers[rd], imm, 0);
-    core->cpsr.overflow = iadd32(core->registers[rd], imm, 0);
-
+    if (flags) {
+        core_flags_add(core, core->registers[rd], imm, core->registers[rd] + imm);
+    }
     core->registers[rd] += imm;
-
-    core->cpsr.zero = !(core->registers[rd]);
-    core->cpsr.negative = bitfield_get(core->registers[rd], 31);
     core->pc += 2;
     core->prefetch_access_type = SEQUENTIAL;
 }
 
+THUMB_FLAGS_HANDLERS(add_imm)
+
 /*
 ** Implement the SUB immediate instruction.
 */
+static inline __attribute__((always_inline))
 void
-core_thumb_sub_imm(
+core_thumb_sub_imm_impl(
     struct gba *gba,
-    uint16_t op
+    uint16_t op,
+    bool flags
 ) {
     struct core *core;
     uint16_t rd;
@@ -210,17 +225,16 @@ core_thumb_sub_imm(
     rd = bitfield_get_range(op, 8, 11);
     imm = bitfield_get_range(op, 0, 8);
 
-    core->cpsr.carry = usub32(core->registers[rd], imm, 0);
-    core->cpsr.overflow = isub32(core->registers[rd], imm, 0);
-
+    if (flags) {
+        core_flags_sub(core, core->registers[rd], imm, core->registers[rd] - imm);
+    }
     core->registers[rd] -= imm;
-
-    core->cpsr.zero = !(core->registers[rd]);
-    core->cpsr.negative = bitfield_get(core->registers[rd], 31);
     core->pc += 2;
     core->prefetch_access_type = SEQUENTIAL;
 }
 
+THUMB_FLAGS_HANDLERS(sub_imm)
+
 /*
 ** Implement the ADD from/to High Register instruction.
 */
@@ -256,10 +270,12 @@ core_thumb_hi_add(
 /*
 ** Implement the CMP from/to High Register instruction.
 */
+static inline __attribute__((always_inline))
 void
-core_thumb_hi_cmp(
+core_thumb_hi_cmp_impl(
     struct gba *gba,
-    uint16_t op
+    uint16_t op,
+    bool flags
 ) {
     struct core *core;
     uint16_t rd;
@@ -281,14 +297,15 @@ core_thumb_hi_cmp(
 
     hs_assert(h1 | h2); // Ensure h1 != 0 && h2 != 0, or op is undefined.
 
-    core->cpsr.zero = !(op1 - op2);
-    core->cpsr.negative = bitfield_get(op1 - op2, 31);
-    core->cpsr.carry = usub32(op1, op2, 0);
-    core->cpsr.overflow = isub32(op1, op2, 0);
+    if (flags) {
+        core_flags_sub(core, op1, op2, op1 - op2);
+    }
     core->pc += 2;
     core->prefetch_access_type = SEQUENTIAL;
 }
 
+THUMB_FLAGS_HANDLERS(hi_cmp)
+
 /*
 ** Implement the MOV from/to High Register instruction.
 */
@@ -392,10 +409,12 @@ core_thumb_add_sp_s_imm(
 /*
 ** Implement a bunch of ALU instructions.
 */
+static inline __attribute__((always_inline))
 void
-core_thumb_alu(
+core_thumb_alu_impl(
     struct gba *gba,
-    uint16_t op
+    uint16_t op,
+    bool flags
 ) {
     struct core *core;
     uint16_t rd;
@@ -416,14 +435,16 @@ core_thumb_alu(
         case 0b0000:
             // AND
             core->registers[rd] = op1 & op2;
-            core->cpsr.zero = !(core->registers[rd]);
-            core->cpsr.negative = bitfield_get(core->registers[rd], 31);
+            if (flags) {
+                core_flags_nz(core, core->registers[rd]);
+            }
             break;
         case 0b0001:
             // EOR (XOR)
             core->registers[rd] = op1 ^ op2;
-            core->cpsr.zero = !(core->registers[rd]);
-            core->cpsr.negative = bitfield_get(core->registers[rd], 31);
+            if (flags) {
+                core_flags_nz(core, core->registers[rd]);
+            }
             break;
         case 0b0010:
             // LSL (Logical Shift Left)
@@ -432,7 +453,7 @@ core_thumb_alu(
 
             switch (op2) {
                 case 0:
-                    carry_out = core->cpsr.carry;
+                    carry_out = core_flags_carry(core);
                     break;
                 case 1 ... 32:
                     op1 <<= op2 - 1;
@@ -445,9 +466,9 @@ core_thumb_alu(
                     break;
             }
 
-            core->cpsr.carry = carry_out;
-            core->cpsr.zero = !op1;
-            core->cpsr.negative = bitfield_get(op1, 31);
+            if (flags) {
+                core_flags_logical(core, op1, carry_out);
+            }
 
             core->registers[rd] = op1;
             core_idle(gba);
@@ -461,7 +482,7 @@ core_thumb_alu(
 
             switch (op2) {
                 case 0:
-                    carry_out = core->cpsr.carry;
+                    carry_out = core_flags_carry(core);
                     break;
                 case 1 ... 32:
                     op1 >>= op2 - 1;
@@ -474,9 +495,9 @@ core_thumb_alu(
                     break;
             }
 
-            core->cpsr.carry = carry_out;
-            core->cpsr.zero = !op1;
-            core->cpsr.negative = bitfield_get(op1, 31);
+            if (flags) {
+                core_flags_logical(core, op1, carry_out);
+            }
 
             core->registers[rd] = op1;
 
@@ -490,7 +511,7 @@ core_thumb_alu(
 
             switch (op2) {
                 case 0:
-                    carry_out = core->cpsr.carry;
+                    carry_out = core_flags_carry(core);
                     break;
                 case 1 ... 32:
                     op1 = (int32_t)op1 >> (op2 - 1);
@@ -503,9 +524,9 @@ core_thumb_alu(
                     break;
             }
 
-            core->cpsr.carry = carry_out;
-            core->cpsr.zero = !op1;
-            core->cpsr.negative = bitfield_get(op1, 31);
+            if (flags) {
+                core_flags_logical(core, op1, carry_out);
+            }
 
             core->registers[rd] = op1;
             core_idle(gba);
@@ -517,12 +538,11 @@ core_thumb_alu(
             {
                 bool carry;
 
-                carry = core->cpsr.carry;
-                core->registers[rd] = op1 + op2 + core->cpsr.carry;
-                core->cpsr.zero = (core->registers[rd] == 0);
-                core->cpsr.negative = ((core->registers[rd] & 0x80000000) != 0);
-                core->cpsr.carry = uadd32(op1, op2, carry);
-                core->cpsr.overflow = iadd32(op1, op2, carry);
+                carry = core_flags_carry(core);
+                core->registers[rd] = op1 + op2 + carry;
+                if (flags) {
+                    core_flags_add(core, op1, op2, core->registers[rd]);
+                }
             }
             break;
         case 0b0110:
@@ -530,12 +550,11 @@ core_thumb_alu(
             {
                 bool carry;
 
-                carry = core->cpsr.carry;
-                core->registers[rd] = op1 - op2 + core->cpsr.carry - 1;
-                core->cpsr.zero = !(core->registers[rd]);
-                core->cpsr.negative = bitfield_get(core->registers[rd], 31);
-                core->cpsr.carry = usub32(op1, op2, !carry);
-                core->cpsr.overflow = isub32(op1, op2, !carry);
+                carry = core_flags_carry(core);
+                core->registers[rd] = op1 - op2 + carry - 1;
+                if (flags) {
+                    core_flags_sub(core, op1, op2, core->registers[rd]);
+                }
             }
             break;
         case 0b0111:
@@ -546,15 +565,15 @@ core_thumb_alu(
             }
 
             if (op2 == 0) {
-                carry_out = core->cpsr.carry;
+                carry_out = core_flags_carry(core);
             } else {
               carry_out = (op1 >> (op2 - 1)) & 0b1;    // Save the carry
               op1 = ror32(op1, op2);
             }
 
-            core->cpsr.carry = carry_out;
-            core->cpsr.zero = !op1;
-            core->cpsr.negative = bitfield_get(op1, 31);
+            if (flags) {
+                core_flags_logical(core, op1, carry_out);
+            }
 
             core->registers[rd] = op1;
             core_idle(gba);
@@ -563,58 +582,61 @@ core_thumb_alu(
             break;
         case 0b1000:
             // TST (as AND, but result is not written)
-            core->cpsr.zero = !(op1 & op2);
-            core->cpsr.negative = bitfield_get(op1 & op2, 31);
+            if (flags) {
+                core_flags_nz(core, op1 & op2);
+            }
             break;
         case 0b1001:
             // NEG (As 0 - op2, implemented as RSBS Rd, Rs, #0)
             core->registers[rd] = 0 - op2;
-            core->cpsr.zero = !(core->registers[rd]);
-            core->cpsr.negative = bitfield_get(core->registers[rd], 31);
-            core->cpsr.carry = usub32(0, op2, 0);
-            core->cpsr.overflow = isub32(0, op2, 0);
+            if (flags) {
+                core_flags_sub(core, 0, op2, core->registers[rd]);
+            }
             break;
         case 0b1010:
             // CMP (as SUB, but result is not written)
-            core->cpsr.zero = !(op1 - op2);
-            core->cpsr.negative = bitfield_get(op1 - op2, 31);
-            core->cpsr.carry = usub32(op1, op2, 0);
-            core->cpsr.overflow = isub32(op1, op2, 0);
+            if (flags) {
+                core_flags_sub(core, op1, op2, op1 - op2);
+            }
             break;
         case 0b1011:
             // CMN (as ADD, but result is not written)
-            core->cpsr.zero = !(op1 + op2);
-            core->cpsr.negative = bitfield_get(op1 + op2, 31);
-            core->cpsr.carry = uadd32(op1, op2, 0);
-            core->cpsr.overflow = iadd32(op1, op2, 0);
+            if (flags) {
+                core_flags_add(core, op1, op2, op1 + op2);
+            }
             break;
         case 0b1100:
             // ORR (Logical OR)
             core->registers[rd] = op1 | op2;
-            core->cpsr.zero = !(core->registers[rd]);
-            core->cpsr.negative = bitfield_get(core->registers[rd], 31);
+            if (flags) {
+                core_flags_nz(core, core->registers[rd]);
+            }
             break;
         case 0b1101:
             // MUL
             core_arm_mul_idle_signed(gba, op1);
             core->registers[rd] = op1 * op2;
-            core->cpsr.zero = !(core->registers[rd]);
-            core->cpsr.negative = bitfield_get(core->registers[rd], 31);
-            core->cpsr.carry = 0;
+            if (flags) {
+                core_flags_logical(core, core->registers[rd], false);
+            }
             core->prefetch_access_type = NON_SEQUENTIAL;
             break;
         case 0b1110:
             // BIC (op1 AND NOT op2)
             core->registers[rd] = op1 & ~op2;
-            core->cpsr.zero = !(core->registers[rd]);
-            core->cpsr.negative = bitfield_get(core->registers[rd], 31);
+            if (flags) {
+                core_flags_nz(core, core->registers[rd]);
+            }
             break;
         case 0b1111:
             // MVN (NOT op2, op1 is ignored)
             core->registers[rd] = ~op2;
-            core->cpsr.zero = !(core->registers[rd]);
-            core->cpsr.negative = bitfield_get(core->registers[rd], 31);
+            if (flags) {
+                core_flags_nz(core, core->registers[rd]);
+            }
             break;
     }
     core->pc += 2;
 }
+
+THUMB_FLAGS_HANDLERS(alu)
@@ -19,6 +19,8 @@ core_thumb_push(
     uint16_t op
 ) {
     struct core *core;
+    uint32_t *words;
+    uint32_t count;
     ssize_t i;
 
     core = &gba->core;
@@ -32,6 +34,22 @@ core_thumb_push(
         return ;
     }
 
+    /* Fast path: the stack is within IWRAM, EWRAM or VRAM */
+    count = __builtin_popcount(bitfield_get_range(op, 0, 9));
+    words = mem_bulk_access(gba, core->sp - count * 4, count);
+    if (words) {
+        core->sp -= count * 4;
+        for (i = 0; i < 8; ++i) {
+            if (bitfield_get(op, i)) {
+                *words++ = core->registers[i];
+            }
+        }
+        if (bitfield_get(op, 8)) {
+            *words = core->lr;
+        }
+        return ;
+    }
+
     /* Push LR */
     if (bitfield_get(op, 8)) {
         core->sp -= 4;
@@ -56,6 +74,8 @@ core_thumb_pop(
 ) {
     struct core *core;
     enum access_type access_type;
+    uint32_t *words;
+    uint32_t count;
     ssize_t i;
 
     core = &gba->core;
@@ -70,6 +90,26 @@ core_thumb_pop(
         return ;
     }
 
+    /* Fast path: the stack is within IWRAM, EWRAM or VRAM */
+    count = __builtin_popcount(bitfield_get_range(op, 0, 9));
+    words = mem_bulk_access(gba, core->sp, count);
+    if (words) {
+        core->sp += count * 4;
+        for (i = 0; i < 8; ++i) {
+            if (bitfield_get(op, i)) {
+                core->registers[i] = *words++;
+            }
+        }
+
+        core_idle(gba);
+
+        if (bitfield_get(op, 8)) {
+            core->pc = *words;
+            core_reload_pipeline(gba);
+        }
+        return ;
+    }
+
     access_type = NON_SEQUENTIAL;
 
     for (i = 0; i < 8; ++i) {
@@ -101,6 +141,7 @@ core_thumb_stmia(
     bool first;
     struct core *core;
     enum access_type access_type;
+    uint32_t *words;
     uint32_t count;
     uint32_t addr;
     uint32_t rb;
@@ -131,6 +172,22 @@ core_thumb_stmia(
     first = true;
     addr = core->registers[rb];
 
+    /* Fast path: the whole transfer lies within IWRAM, EWRAM or VRAM */
+    words = mem_bulk_access(gba, addr, count / 4);
+    if (words) {
+        for (i = 0; i < 8; ++i) {
+            if (bitfield_get(op, i)) {
+                *words++ = core->registers[i];
+
+                if (first) {
+                    core->registers[rb] += count;
+                    first = false;
+                }
+            }
+        }
+        return ;
+    }
+
     /*
     ** Edge case if Rb is included in the rlist:
     ** We must store the OLD base if Rb is the FIRST entry in Rlist
@@ -162,6 +219,7 @@ core_thumb_ldmia(
 ) {
     struct core *core;
     enum access_type access_type;
+    uint32_t *words;
     uint32_t count;
     uint32_t addr;
     uint32_t rb;
@@ -192,9 +250,21 @@ core_thumb_ldmia(
 
     addr = core->registers[rb];
     core->registers[rb] += count;
+
     access_type = NON_SEQUENTIAL;
     core_idle(gba);
 
+    /* Fast path: the whole transfer lies within IWRAM, EWRAM or VRAM */
+    words = mem_bulk_access(gba, addr, count / 4);
+    if (words) {
+        for (i = 0; i < 8; ++i) {
+            if (bitfield_get(op, i)) {
+                core->registers[i] = *words++;
+            }
+        }
+        return ;
+    }
+
     for (i = 0; i < 8; ++i) {
         if (bitfield_get(op, i)) {
             core->registers[i] = mem_read32(gba, addr, access_type);
@@ -72,7 +72,7 @@ core_thumb_branch_cond(
 
     core = &gba->core;
     label = (int32_t)((uint32_t)((int32_t)(int8_t)bitfield_get_range(op, 0, 8)) << 1);
-    idx = (bitfield_get_range(core->cpsr.raw, 28, 32) << 4) | bitfield_get_range(op, 8, 12);
+    idx = (core_flags_nzcv(core) << 4) | bitfield_get_range(op, 8, 12);
 
     if (cond_lut[idx]) {
         core->pc += label;
@@ -0,0 +1,147 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Superinstructions.
+**
+** Thumb code is dominated by a handful of instruction pairs (a comparison followed
+** by a conditional branch, the two halves of BL, etc.). When a ROM is loaded, the
+** pairs listed in `thumb_fused_insns` are marked, and the first instruction of each
+** of them is dispatched to a fused handler executing both instructions in a row.
+**
+** The second instruction is fetched exactly like `core_next()` would, so the cycle
+** and prefetch accounting are the same. It is only executed if the first one didn't
+** branch, and if `core_next()` wouldn't have done anything else in between (servicing
+** an IRQ, halting, etc.). Otherwise, it is left to the next dispatch.
+**
+** The most frequent pairs of a set of ROMs can be found by building with
+** `-Dthumb_pair_profiling=true`, see `core_thumb_profile_dump()`.
+*/
+
+#include <string.h>
+#include "hades.h"
+#include "gba/gba.h"
+#include "gba/core/thumb.h"
+
+/*
+** Fetch the second instruction of a pair, the same way `core_next()` does.
+**
+** Return false if it must not be executed by the fused handler.
+*/
+static inline __attribute__((always_inline))
+bool
+core_thumb_fused_fetch(
+    struct gba *gba,
+    uint32_t pc,
+    uint16_t *op
+) {
+    struct core *core;
+
+    core = &gba->core;
+
+    if (unlikely(core->pc != pc + 2 || core->irq_line || core->state != CORE_RUN)) {
+        return (false);
+    }
+
+    *op = core->prefetch[0];
+    core->prefetch[0] = core->prefetch[1];
+    core->prefetch[1] = mem_read16(gba, core->pc, core->prefetch_access_type);
+    return (true);
+}
+
+#define THUMB_FUSED_HANDLER(name, first, second)                               \
+    static void core_thumb_fused_##name(struct gba *gba, uint16_t op)           \
+    {                                                                           \
+        uint32_t pc;                                                            \
+                                                                                \
+        pc = gba->core.pc;                                                      \
+        first(gba, op);                                                         \
+        if (core_thumb_fused_fetch(gba, pc, &op)) {                             \
+            second(gba, op);                                                    \
+        }                                                                       \
+    }
+
+/*
+** When the flags set by the first instruction are always overwritten by the second
+** one, the flag-free variant of the first instruction is used.
+*/
+THUMB_FUSED_HANDLER(cmp_imm_bcond,  core_thumb_cmp_imm,         core_thumb_branch_cond)
+THUMB_FUSED_HANDLER(cmp_hi_bcond,   core_thumb_hi_cmp,          core_thumb_branch_cond)
+THUMB_FUSED_HANDLER(alu_bcond,      core_thumb_alu,             core_thumb_branch_cond)
+THUMB_FUSED_HANDLER(bl,             core_thumb_branch_link,     core_thumb_branch_link)
+THUMB_FUSED_HANDLER(lsl_lsr,        core_thumb_lsl_nf,          core_thumb_lsr)
+THUMB_FUSED_HANDLER(lsl_asr,        core_thumb_lsl_nf,          core_thumb_asr)
+THUMB_FUSED_HANDLER(lsl_add,        core_thumb_lsl_nf,          core_thumb_lo_add)
+THUMB_FUSED_HANDLER(ldr_lsl,        core_thumb_ldr_imm,         core_thumb_lsl)
+THUMB_FUSED_HANDLER(mov_add,        core_thumb_mov_imm_nf,      core_thumb_lo_add)
+THUMB_FUSED_HANDLER(add_sp_ldr_sp,  core_thumb_add_sp_imm,      core_thumb_ldr_sp)
+
+/*
+** The fused pairs, identified by the handlers of their two instructions in `thumb_lut`.
+*/
+struct hs_thumb_fused_insn const thumb_fused_insns[] = {
+    { "cmp_imm+bcond",  core_thumb_cmp_imm,         core_thumb_branch_cond,     core_thumb_fused_cmp_imm_bcond},
+    { "cmp_hi+bcond",   core_thumb_hi_cmp,          core_thumb_branch_cond,     core_thumb_fused_cmp_hi_bcond},
+    { "alu+bcond",      core_thumb_alu,             core_thumb_branch_cond,     core_thumb_fused_alu_bcond},
+    { "bl",             core_thumb_branch_link,     core_thumb_branch_link,     core_thumb_fused_bl},
+    { "lsl+lsr",        core_thumb_lsl,             core_thumb_lsr,             core_thumb_fused_lsl_lsr},
+    { "lsl+asr",        core_thumb_lsl,             core_thumb_asr,             core_thumb_fused_lsl_asr},
+    { "lsl+add",        core_thumb_lsl,             core_thumb_lo_add,          core_thumb_fused_lsl_add},
+    { "ldr_imm+lsl",    core_thumb_ldr_imm,         core_thumb_lsl,             core_thumb_fused_ldr_lsl},
+    { "mov_imm+add",    core_thumb_mov_imm,         core_thumb_lo_add,          core_thumb_fused_mov_add},
+    { "add_sp+ldr_sp",  core_thumb_add_sp_imm,      core_thumb_ldr_sp,          core_thumb_fused_add_sp_ldr_sp},
+};
+
+// The index of the pair, plus one, must fit in the 6 upper bits of `rom_thumb_insns`.
+static_assert(ARRAY_LEN(thumb_fused_insns) < (1 << 6));
+
+/*
+** Mark the first instruction of all the pairs of the ROM that have a fused handler.
+**
+** Called by `mem_load_rom()` the first time a ROM is loaded, after `core_flags_analyze_rom()`.
+*/
+void
+core_thumb_fuse_rom(
+    struct gba *gba
+) {
+    struct memory *memory;
+    uint16_t const *rom;
+    size_t fused;
+    size_t len;
+    size_t i;
+
+#ifdef WITH_THUMB_PAIR_PROFILING
+    /* The profiler only sees the instructions dispatched by `core_next()`. */
+    return ;
+#endif
+
+    memory = &gba->memory;
+    rom = (uint16_t const *)memory->rom;
+    len = memory->rom_size / sizeof(uint16_t);
+    fused = 0;
+
+    for (i = 0; i + 1 < len; ++i) {
+        void (*first)(struct gba *, uint16_t);
+        void (*second)(struct gba *, uint16_t);
+        size_t j;
+
+        first = thumb_lut[rom[i] >> 8];
+        second = thumb_lut[rom[i + 1] >> 8];
+
+        for (j = 0; j < ARRAY_LEN(thumb_fused_insns); ++j) {
+            if (thumb_fused_insns[j].first == first && thumb_fused_insns[j].second == second) {
+                memory->rom_thumb_insns[i] |= (j + 1) << 2;
+                ++fused;
+                break;
+            }
+        }
+    }
+
+    logln(HS_CORE, "Superinstructions: %zu Thumb instruction pairs fused.", fused);
+}
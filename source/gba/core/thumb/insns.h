@@ -0,0 +1,111 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** All the Thumb instructions, as `THUMB_INSN(name, mask, handler, nf_handler)`, where
+** `nf_handler` is the flag-free variant of `handler` (or `handler` itself if there
+** is none).
+**
+** This file is meant to be included with `THUMB_INSN` defined, and has no include guard.
+** It is used by `decode_gen.c` to build `thumb_lut` at compile time.
+*/
+
+// Move shifted register
+THUMB_INSN("lsl",           "00000yyyyysssddd",    core_thumb_lsl,                core_thumb_lsl_nf)
+THUMB_INSN("lsr",           "00001yyyyysssddd",    core_thumb_lsr,                core_thumb_lsr_nf)
+THUMB_INSN("asr",           "00010yyyyysssddd",    core_thumb_asr,                core_thumb_asr_nf)
+
+// Add/Subtract from/to low registers
+THUMB_INSN("add_lo_reg",    "00011i0yyysssddd",    core_thumb_lo_add,             core_thumb_lo_add_nf)
+THUMB_INSN("sub_lo_reg",    "00011i1yyysssddd",    core_thumb_lo_sub,             core_thumb_lo_sub_nf)
+
+// Move/Compare/Add/Subtract immediate
+THUMB_INSN("mov_imm",       "00100dddxxxxxxxx",    core_thumb_mov_imm,            core_thumb_mov_imm_nf)
+THUMB_INSN("cmp_imm",       "00101dddxxxxxxxx",    core_thumb_cmp_imm,            core_thumb_cmp_imm_nf)
+THUMB_INSN("add_imm",       "00110dddxxxxxxxx",    core_thumb_add_imm,            core_thumb_add_imm_nf)
+THUMB_INSN("sub_imm",       "00111dddxxxxxxxx",    core_thumb_sub_imm,            core_thumb_sub_imm_nf)
+
+// ALU operations
+THUMB_INSN("alu",           "010000xxxxsssddd",    core_thumb_alu,                core_thumb_alu_nf)
+
+// Hi register operations/Branch exchange
+THUMB_INSN("add_hi_reg",    "01000100hhsssddd",    core_thumb_hi_add,             core_thumb_hi_add)
+THUMB_INSN("cmp_hi_reg",    "01000101hhsssddd",    core_thumb_hi_cmp,             core_thumb_hi_cmp_nf)
+THUMB_INSN("mov_hi_reg",    "01000110hhsssddd",    core_thumb_hi_mov,             core_thumb_hi_mov)
+THUMB_INSN("bx",            "01000111hhsssddd",    core_thumb_branch_xchg,        core_thumb_branch_xchg)
+
+// PC-Relative loads
+THUMB_INSN("ldr_pc",        "01001dddxxxxxxxx",    core_thumb_ldr_pc,             core_thumb_ldr_pc)
+
+// Load/Store Word/Byte with register offset
+THUMB_INSN("str_regoff",    "0101000ooobbbddd",    core_thumb_str_reg,            core_thumb_str_reg)
+THUMB_INSN("strb_regoff",   "0101010ooobbbddd",    core_thumb_strb_reg,           core_thumb_strb_reg)
+THUMB_INSN("ldr_regoff",    "0101100ooobbbddd",    core_thumb_ldr_reg,            core_thumb_ldr_reg)
+THUMB_INSN("ldrb_regoff",   "0101110ooobbbddd",    core_thumb_ldrb_reg,           core_thumb_ldrb_reg)
+
+// Load/Store Sign-Extended Byte/Halfword
+THUMB_INSN("strh_reg",      "0101001ooobbbddd",    core_thumb_strh_reg,           core_thumb_strh_reg)
+THUMB_INSN("ldrsb_reg",     "0101011ooobbbddd",    core_thumb_ldrsb_reg,          core_thumb_ldrsb_reg)
+THUMB_INSN("ldrh_reg",      "0101101ooobbbddd",    core_thumb_ldrh_reg,           core_thumb_ldrh_reg)
+THUMB_INSN("ldrsh_reg",     "0101111ooobbbddd",    core_thumb_ldrsh_reg,          core_thumb_ldrsh_reg)
+
+// Load/Store with Immediate Offset
+THUMB_INSN("str_imm",       "01100ooooobbbddd",    core_thumb_str_imm,            core_thumb_str_imm)
+THUMB_INSN("ldr_imm",       "01101ooooobbbddd",    core_thumb_ldr_imm,            core_thumb_ldr_imm)
+THUMB_INSN("strb_imm",      "01110ooooobbbddd",    core_thumb_strb_imm,           core_thumb_strb_imm)
+THUMB_INSN("ldrb_imm",      "01111ooooobbbddd",    core_thumb_ldrb_imm,           core_thumb_ldrb_imm)
+
+// Load/Store Halfword with Immediate Offset
+THUMB_INSN("strh_imm",      "10000ooooobbbddd",    core_thumb_strh_imm,           core_thumb_strh_imm)
+THUMB_INSN("ldrh_imm",      "10001ooooobbbddd",    core_thumb_ldrh_imm,           core_thumb_ldrh_imm)
+
+// SP-Relative Load/Store
+THUMB_INSN("str_sp",        "10010dddiiiiiiii",    core_thumb_str_sp,             core_thumb_str_sp)
+THUMB_INSN("ldr_sp",        "10011dddiiiiiiii",    core_thumb_ldr_sp,             core_thumb_ldr_sp)
+
+// Load Address
+THUMB_INSN("add_pc_imm",    "10100dddiiiiiiii",    core_thumb_add_pc_imm,         core_thumb_add_pc_imm)
+THUMB_INSN("add_sp_imm",    "10101dddiiiiiiii",    core_thumb_add_sp_imm,         core_thumb_add_sp_imm)
+
+// Add Offset to Stack Pointer
+THUMB_INSN("add_sp_s_imm",  "10110000siiiiiii",    core_thumb_add_sp_s_imm,       core_thumb_add_sp_s_imm)
+
+// Push/Pop lo registers
+THUMB_INSN("push",          "1011010xxxxxxxxx",    core_thumb_push,               core_thumb_push)
+THUMB_INSN("pop",           "1011110xxxxxxxxx",    core_thumb_pop,                core_thumb_pop)
+
+// Multiple Load/Store
+THUMB_INSN("stmia",         "11000bbbxxxxxxxx",    core_thumb_stmia,              core_thumb_stmia)
+THUMB_INSN("ldmia",         "11001bbbxxxxxxxx",    core_thumb_ldmia,              core_thumb_ldmia)
+
+// Conditional Branch
+THUMB_INSN("beq",           "11010000xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+THUMB_INSN("bne",           "11010001xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+THUMB_INSN("bcs",           "11010010xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+THUMB_INSN("bcc",           "11010011xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+THUMB_INSN("bmi",           "11010100xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+THUMB_INSN("bpl",           "11010101xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+THUMB_INSN("bvs",           "11010110xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+THUMB_INSN("bvc",           "11010111xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+THUMB_INSN("bhi",           "11011000xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+THUMB_INSN("bls",           "11011001xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+THUMB_INSN("bge",           "11011010xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+THUMB_INSN("blt",           "11011011xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+THUMB_INSN("bgt",           "11011100xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+THUMB_INSN("ble",           "11011101xxxxxxxx",    core_thumb_branch_cond,        core_thumb_branch_cond)
+
+// Software Interrupt
+THUMB_INSN("swi",           "11011111xxxxxxxx",    core_thumb_swi,                core_thumb_swi)
+
+// Unconditional Branch (B)
+THUMB_INSN("b",             "11100xxxxxxxxxxx",    core_thumb_branch,             core_thumb_branch)
+
+// Long Branch with Link (BL)
+THUMB_INSN("bl_1",          "11110xxxxxxxxxxx",    core_thumb_branch_link,        core_thumb_branch_link)
+THUMB_INSN("bl_2",          "11111xxxxxxxxxxx",    core_thumb_branch_link,        core_thumb_branch_link)
@@ -9,20 +9,24 @@
 
 #include "hades.h"
 #include "gba/gba.h"
+#include "gba/core/thumb.h"
 
 /*
 ** Implement the Logical Shift Left instructions.
 */
+static inline __attribute__((always_inline))
 void
-core_thumb_lsl(
+core_thumb_lsl_impl(
     struct gba *gba,
-    uint16_t op
+    uint16_t op,
+    bool flags
 ) {
     struct core *core;
     uint32_t rd;
     uint32_t rs;
     uint32_t shift;
     uint32_t value;
+    bool carry;
 
     rd = bitfield_get_range(op, 0, 3);
     rs = bitfield_get_range(op, 3, 6);
@@ -33,14 +37,16 @@ core_thumb_lsl(
 
     /* LSL (Logical Shift Left) */
 
+    carry = core_flags_carry(core);
     if (shift > 0) {
         value <<= shift - 1;
-        core->cpsr.carry = value >> 31;
+        carry = value >> 31;
         value <<= 1;
     }
 
-    core->cpsr.zero = !value;
-    core->cpsr.negative = bitfield_get(value, 31);
+    if (flags) {
+        core_flags_logical(core, value, carry);
+    }
 
     core->registers[rd] = value;
 
@@ -48,19 +54,24 @@ core_thumb_lsl(
     core->prefetch_access_type = SEQUENTIAL;
 }
 
+THUMB_FLAGS_HANDLERS(lsl)
+
 /*
 ** Implement the Logical Shift Right instructions.
 */
+static inline __attribute__((always_inline))
 void
-core_thumb_lsr(
+core_thumb_lsr_impl(
     struct gba *gba,
-    uint16_t op
+    uint16_t op,
+    bool flags
 ) {
     struct core *core;
     uint32_t rd;
     uint32_t rs;
     uint32_t shift;
     uint32_t value;
+    bool carry;
 
     rd = bitfield_get_range(op, 0, 3);
     rs = bitfield_get_range(op, 3, 6);
@@ -76,11 +87,12 @@ core_thumb_lsr(
     }
 
     value >>= shift - 1;
-    core->cpsr.carry = value & 0b1;
+    carry = value & 0b1;
     value >>= 1;
 
-    core->cpsr.zero = !value;
-    core->cpsr.negative = bitfield_get(value, 31);
+    if (flags) {
+        core_flags_logical(core, value, carry);
+    }
 
     core->registers[rd] = value;
 
@@ -88,19 +100,24 @@ core_thumb_lsr(
     core->prefetch_access_type = SEQUENTIAL;
 }
 
+THUMB_FLAGS_HANDLERS(lsr)
+
 /*
 ** Implement the Arithmetic Shift Right instructions.
 */
+static inline __attribute__((always_inline))
 void
-core_thumb_asr(
+core_thumb_asr_impl(
     struct gba *gba,
-    uint16_t op
+    uint16_t op,
+    bool flags
 ) {
     struct core *core;
     uint32_t rd;
     uint32_t rs;
     uint32_t shift;
     uint32_t value;
+    bool carry;
 
     rd = bitfield_get_range(op, 0, 3);
     rs = bitfield_get_range(op, 3, 6);
@@ -116,14 +133,17 @@ core_thumb_asr(
     }
 
     value = (int32_t)value >> (shift - 1);
-    core->cpsr.carry = value & 0b1;
+    carry = value & 0b1;
     value = (int32_t)value >> 1;
 
-    core->cpsr.zero = !value;
-    core->cpsr.negative = bitfield_get(value, 31);
+    if (flags) {
+        core_flags_logical(core, value, carry);
+    }
 
     core->registers[rd] = value;
 
     core->pc += 2;
     core->prefetch_access_type = SEQUENTIAL;
 }
+
+THUMB_FLAGS_HANDLERS(asr)
@@ -11,38 +11,37 @@
 #include "gba/gba.h"
 
 /*
-** Execute the Load/Store Word/Byte With Immediate Offset instruction.
+** Load/Store a word or a byte at the given address.
+**
+** `load` and `byte` are known at compile time, so each handler below only
+** keeps the code of its own form.
 */
+static inline __attribute__((always_inline))
 void
-core_thumb_sdt_imm(
+core_thumb_sdt_wb(
     struct gba *gba,
-    uint16_t op
+    uint32_t rd,
+    uint32_t addr,
+    bool load,
+    bool byte
 ) {
     struct core *core;
-    uint32_t rd;
-    uint32_t rb;
-    uint32_t offset;
 
     core = &gba->core;
-    rd = bitfield_get_range(op, 0, 3);
-    rb = bitfield_get_range(op, 3, 6);
-    offset = bitfield_get_range(op, 6, 11);
 
-    switch ((bitfield_get(op, 11) << 1) | bitfield_get(op, 12)) {
-        case 0b00: // Store word
-            mem_write32(gba, core->registers[rb] + (offset << 2), core->registers[rd], NON_SEQUENTIAL);
-            break;
-        case 0b01: // Store byte
-            mem_write8(gba, core->registers[rb] + offset, core->registers[rd], NON_SEQUENTIAL);
-            break;
-        case 0b10: // Load word
-            core->registers[rd] = mem_read32_ror(gba, core->registers[rb] + (offset << 2), NON_SEQUENTIAL);
-            core_idle(gba);
-            break;
-        case 0b11: // Load byte
-            core->registers[rd] = mem_read8(gba, core->registers[rb] + offset, NON_SEQUENTIAL);
-            core_idle(gba);
-            break;
+    if (load) {
+        if (byte) {
+            core->registers[rd] = mem_read8(gba, addr, NON_SEQUENTIAL);
+        } else {
+            core->registers[rd] = mem_read32_ror(gba, addr, NON_SEQUENTIAL);
+        }
+        core_idle(gba);
+    } else {
+        if (byte) {
+            mem_write8(gba, addr, core->registers[rd], NON_SEQUENTIAL);
+        } else {
+            mem_write32(gba, addr, core->registers[rd], NON_SEQUENTIAL);
+        }
     }
 
     core->pc += 2;
@@ -50,132 +49,189 @@ core_thumb_sdt_imm(
 }
 
 /*
-** Execute the Load/Store Word/Byte With Register Offset instruction.
+** Execute the Load/Store Word/Byte With Immediate Offset instructions.
 */
 void
-core_thumb_sdt_wb_reg(
+core_thumb_str_imm(
     struct gba *gba,
     uint16_t op
 ) {
-    struct core *core;
-    uint32_t rd;
-    uint32_t rb;
-    uint32_t ro;
+    core_thumb_sdt_wb(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + (bitfield_get_range(op, 6, 11) << 2), false, false);
+}
 
-    core = &gba->core;
-    rd = bitfield_get_range(op, 0, 3);
-    rb = bitfield_get_range(op, 3, 6);
-    ro = bitfield_get_range(op, 6, 9);
+void
+core_thumb_ldr_imm(
+    struct gba *gba,
+    uint16_t op
+) {
+    core_thumb_sdt_wb(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + (bitfield_get_range(op, 6, 11) << 2), true, false);
+}
 
-    switch ((bitfield_get(op, 11) << 1) | bitfield_get(op, 10)) {
-        case 0b00: // Store word
-            mem_write32(gba, core->registers[rb] + core->registers[ro], core->registers[rd], NON_SEQUENTIAL);
-            break;
-        case 0b01: // Store byte
-            mem_write8(gba, core->registers[rb] + core->registers[ro], core->registers[rd], NON_SEQUENTIAL);
-            break;
-        case 0b10: // Load word
-            core->registers[rd] = mem_read32_ror(gba, core->registers[rb] + core->registers[ro], NON_SEQUENTIAL);
-            core_idle(gba);
-            break;
-        case 0b11: // Load byte
-            core->registers[rd] = mem_read8(gba, core->registers[rb] + core->registers[ro], NON_SEQUENTIAL);
-            core_idle(gba);
-            break;
-    }
+void
+core_thumb_strb_imm(
+    struct gba *gba,
+    uint16_t op
+) {
+    core_thumb_sdt_wb(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + bitfield_get_range(op, 6, 11), false, true);
+}
 
-    core->pc += 2;
-    core->prefetch_access_type = NON_SEQUENTIAL;
+void
+core_thumb_ldrb_imm(
+    struct gba *gba,
+    uint16_t op
+) {
+    core_thumb_sdt_wb(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + bitfield_get_range(op, 6, 11), true, true);
 }
 
 /*
-** Execute the Load/Store Halfword with Immediate Offset instructions
+** Execute the Load/Store Word/Byte With Register Offset instructions.
 */
 void
-core_thumb_sdt_h_imm(
+core_thumb_str_reg(
     struct gba *gba,
     uint16_t op
 ) {
-    struct core *core;
-    uint32_t offset;
-    uint32_t rd;
-    uint32_t rb;
-    bool l;
+    core_thumb_sdt_wb(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + gba->core.registers[(op >> 6) & 0x7], false, false);
+}
 
-    core = &gba->core;
-    rd = bitfield_get_range(op, 0, 3);
-    rb = bitfield_get_range(op, 3, 6);
-    offset = bitfield_get_range(op, 6, 11) << 1;
-    l = bitfield_get(op, 11);
-
-    if (l) {
-        // LDRH
-        core->registers[rd] = mem_read16_ror(gba, core->registers[rb] + offset, NON_SEQUENTIAL);
-        core_idle(gba);
-    } else {
-        // STRH
-        mem_write16(gba, core->registers[rb] + offset, (uint16_t)core->registers[rd], NON_SEQUENTIAL);
-    }
+void
+core_thumb_ldr_reg(
+    struct gba *gba,
+    uint16_t op
+) {
+    core_thumb_sdt_wb(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + gba->core.registers[(op >> 6) & 0x7], true, false);
+}
 
-    core->pc += 2;
-    core->prefetch_access_type = NON_SEQUENTIAL;
+void
+core_thumb_strb_reg(
+    struct gba *gba,
+    uint16_t op
+) {
+    core_thumb_sdt_wb(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + gba->core.registers[(op >> 6) & 0x7], false, true);
+}
+
+void
+core_thumb_ldrb_reg(
+    struct gba *gba,
+    uint16_t op
+) {
+    core_thumb_sdt_wb(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + gba->core.registers[(op >> 6) & 0x7], true, true);
 }
 
 /*
-** Execute the Load/Store Sign-Extended Byte/Halfword with Register Offset instructions.
+** The different kinds of halfword and sign-extended transfers.
+*/
+enum thumb_sdt_h_kind {
+    THUMB_STRH,
+    THUMB_LDRH,
+    THUMB_LDRSB,
+    THUMB_LDRSH,
+};
+
+/*
+** Load/Store a sign-extended byte or a halfword at the given address.
 */
+static inline __attribute__((always_inline))
 void
-core_thumb_sdt_sbh_reg(
+core_thumb_sdt_h(
     struct gba *gba,
-    uint16_t op
+    uint32_t rd,
+    uint32_t addr,
+    enum thumb_sdt_h_kind kind
 ) {
     struct core *core;
-    uint32_t rd;
-    uint32_t rb;
-    uint32_t ro;
-    uint32_t addr;
-
-    rd = bitfield_get_range(op, 0, 3);
-    rb = bitfield_get_range(op, 3, 6);
-    ro = bitfield_get_range(op, 6, 9);
 
     core = &gba->core;
-    addr = core->registers[rb] + core->registers[ro];
 
-    switch ((bitfield_get(op, 10) << 1) | bitfield_get(op, 11)) {
-        case 0b00:
-            // Store halfword
+    switch (kind) {
+        case THUMB_STRH: {
             mem_write16(gba, addr, core->registers[rd], NON_SEQUENTIAL);
             break;
-        case 0b01:
-            // Load halfword
+        };
+        case THUMB_LDRH: {
             core->registers[rd] = mem_read16_ror(gba, addr, NON_SEQUENTIAL);
             core_idle(gba);
             break;
-        case 0b10:
-            // Load sign-extended byte
+        };
+        case THUMB_LDRSB: {
             core->registers[rd] = (int32_t)(int8_t)mem_read8(gba, addr, NON_SEQUENTIAL);
             core_idle(gba);
             break;
-        case 0b11:
-            // Load sign-extended halfword
-
+        };
+        case THUMB_LDRSH: {
             // (Unligned addresses are a bitch)
             if (bitfield_get(addr, 0)) {
                 core->registers[rd] = (int32_t)(int8_t)mem_read8(gba, addr, NON_SEQUENTIAL);
             } else {
-                core->registers[rd] = (int32_t)(int16_t)(uint16_t)mem_read16_ror(gba, addr, NON_SEQUENTIAL);
+                core->registers[rd] = (int32_t)(int16_t)mem_read16(gba, addr, NON_SEQUENTIAL);
             }
-
             core_idle(gba);
             break;
+        };
     }
+
     core->pc += 2;
     core->prefetch_access_type = NON_SEQUENTIAL;
 }
 
+/*
+** Execute the Load/Store Halfword with Immediate Offset instructions
+*/
+void
+core_thumb_strh_imm(
+    struct gba *gba,
+    uint16_t op
+) {
+    core_thumb_sdt_h(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + (bitfield_get_range(op, 6, 11) << 1), THUMB_STRH);
+}
+
+void
+core_thumb_ldrh_imm(
+    struct gba *gba,
+    uint16_t op
+) {
+    core_thumb_sdt_h(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + (bitfield_get_range(op, 6, 11) << 1), THUMB_LDRH);
+}
+
+/*
+** Execute the Load/Store Sign-Extended Byte/Halfword with Register Offset instructions.
+*/
+void
+core_thumb_strh_reg(
+    struct gba *gba,
+    uint16_t op
+) {
+    core_thumb_sdt_h(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + gba->core.registers[(op >> 6) & 0x7], THUMB_STRH);
+}
+
+void
+core_thumb_ldrh_reg(
+    struct gba *gba,
+    uint16_t op
+) {
+    core_thumb_sdt_h(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + gba->core.registers[(op >> 6) & 0x7], THUMB_LDRH);
+}
+
+void
+core_thumb_ldrsb_reg(
+    struct gba *gba,
+    uint16_t op
+) {
+    core_thumb_sdt_h(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + gba->core.registers[(op >> 6) & 0x7], THUMB_LDRSB);
+}
+
+void
+core_thumb_ldrsh_reg(
+    struct gba *gba,
+    uint16_t op
+) {
+    core_thumb_sdt_h(gba, op & 0x7, gba->core.registers[(op >> 3) & 0x7] + gba->core.registers[(op >> 6) & 0x7], THUMB_LDRSH);
+}
+
 /*
 ** Execute the pc-relative load instruction
+**
+** The literal pool is almost always in the ROM, so go through its fast path.
 */
 void
 core_thumb_ldr_pc(
@@ -190,7 +246,7 @@ core_thumb_ldr_pc(
     offset = bitfield_get_range(op, 0, 8) << 2;
 
     core = &gba->core;
-    core->registers[rd] = mem_read32_ror(gba, (core->pc & 0xFFFFFFFC) + offset, NON_SEQUENTIAL);
+    core->registers[rd] = mem_rom_read32_ror(gba, (core->pc & 0xFFFFFFFC) + offset, NON_SEQUENTIAL);
     core->pc += 2;
     core->prefetch_access_type = NON_SEQUENTIAL;
     core_idle(gba);
@@ -198,29 +254,42 @@ core_thumb_ldr_pc(
 
 /*
 ** Execute the Sp-Relative Load/Store instructions
+**
+** The stack is almost always in IWRAM, so go through its fast path.
 */
 void
-core_thumb_sdt_sp(
+core_thumb_str_sp(
     struct gba *gba,
     uint16_t op
 ) {
     struct core *core;
     uint32_t rd;
     uint32_t offset;
-    bool l;
 
     rd = bitfield_get_range(op, 8, 11);
     offset = bitfield_get_range(op, 0, 8) << 2;
-    l = bitfield_get(op, 11);
+
     core = &gba->core;
+    mem_iwram_write32(gba, core->sp + offset, core->registers[rd], NON_SEQUENTIAL);
+    core->pc += 2;
+    core->prefetch_access_type = NON_SEQUENTIAL;
+}
 
-    if (l) { // LDR
-        core->registers[rd] = mem_read32_ror(gba, core->sp + offset, NON_SEQUENTIAL);
-        core_idle(gba);
-    } else { // STR
-        mem_write32(gba, core->sp + offset, core->registers[rd], NON_SEQUENTIAL);
-    }
+void
+core_thumb_ldr_sp(
+    struct gba *gba,
+    uint16_t op
+) {
+    struct core *core;
+    uint32_t rd;
+    uint32_t offset;
+
+    rd = bitfield_get_range(op, 8, 11);
+    offset = bitfield_get_range(op, 0, 8) << 2;
 
+    core = &gba->core;
+    core->registers[rd] = mem_iwram_read32_ror(gba, core->sp + offset, NON_SEQUENTIAL);
+    core_idle(gba);
     core->pc += 2;
     core->prefetch_access_type = NON_SEQUENTIAL;
-}
+}
\ No newline at end of file
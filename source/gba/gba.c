@@ -15,6 +15,117 @@
 #include "gba/db.h"
 #include "utils/time.h"
 
+#if defined (_WIN32) && !defined (__CYGWIN__)
+# include <malloc.h>
+#else
+# include <sys/mman.h>
+#endif
+
+/*
+** The alignment and size granularity of the allocation holding a `struct gba`.
+**
+** It matches the size of a huge page so that the whole emulated memory (and the
+** hot state at the start of the structure) can be covered by a single TLB entry.
+*/
+#define GBA_ALLOC_ALIGN         (2 * 1024 * 1024)
+#define GBA_ALLOC_SIZE          ((sizeof(struct gba) + GBA_ALLOC_ALIGN - 1) & ~(GBA_ALLOC_ALIGN - 1))
+
+/*
+** Allocate and initialize a new `struct gba`.
+**
+** The structure is aligned on a huge page boundary and, where available, the kernel is
+** asked to back it with huge pages.
+*/
+struct gba *
+gba_new(void)
+{
+    struct gba *gba;
+
+#if defined (_WIN32) && !defined (__CYGWIN__)
+    gba = _aligned_malloc(GBA_ALLOC_SIZE, GBA_ALLOC_ALIGN);
+#else
+    if (posix_memalign((void **)&gba, GBA_ALLOC_ALIGN, GBA_ALLOC_SIZE)) {
+        gba = NULL;
+    }
+#endif
+    hs_assert(gba);
+
+#ifdef MADV_HUGEPAGE
+    madvise(gba, GBA_ALLOC_SIZE, MADV_HUGEPAGE);
+#endif
+
+    gba_init(gba);
+    return (gba);
+}
+
+/*
+** Release the resources held by a message that will never be processed.
+*/
+static
+void
+gba_message_release(
+    struct message *message
+) {
+    switch (message->type) {
+        case MESSAGE_LOAD_ROM: {
+            mem_rom_unref(((struct message_rom *)message)->rom);
+            break;
+        };
+        case MESSAGE_LOAD_BIOS:
+        case MESSAGE_LOAD_BACKUP:
+        case MESSAGE_QUICKLOAD:
+        case MESSAGE_QUICKSAVE: {
+            struct message_data *message_data;
+
+            message_data = (struct message_data *)message;
+            if (message_data->cleanup) {
+                message_data->cleanup(message_data->data);
+            }
+            break;
+        };
+        default: {
+            break;
+        };
+    }
+}
+
+/*
+** Release a `struct gba` allocated with `gba_new()` and everything it owns,
+** including the messages still in its queue.
+**
+** `gba_run()` must have returned.
+*/
+void
+gba_delete(
+    struct gba *gba
+) {
+    struct message_queue *mqueue;
+    struct message *message;
+
+    ppu_worker_stop(gba);
+
+    mqueue = &gba->message_queue;
+    message = mqueue->messages;
+    while (mqueue->length) {
+        gba_message_release(message);
+        --mqueue->length;
+        message = (struct message *)((uint8_t *)message + message->size);
+    }
+
+    sched_cleanup(gba);
+    mem_rom_unref(gba->memory.rom_image);
+    free(gba->memory.backup_storage_data);
+    free(gba->message_queue.messages);
+    pthread_mutex_destroy(&gba->message_queue.lock);
+    pthread_mutex_destroy(&gba->framebuffer_frontend_mutex);
+
+#if defined (_WIN32) && !defined (__CYGWIN__)
+    _aligned_free(gba);
+#else
+    free(gba);
+#endif
+}
+
 /*
 ** Initialize the `gba` structure with sane, default values.
 */
@@ -24,11 +135,45 @@ gba_init(
 ) {
     memset(gba, 0, sizeof(*gba));
 
-    /* Initialize the ARM decoder */
-    core_arm_decode_insns();
-    core_thumb_decode_insns();
-
     pthread_mutex_init(&gba->message_queue.lock, NULL);
+    pthread_mutex_init(&gba->framebuffer_frontend_mutex, NULL);
+}
+
+/*
+** Put the system in the state the BIOS leaves it in when it jumps to the ROM,
+** skipping the boot animation.
+**
+** Only what the BIOS changes and that `gba_reset()` doesn't already do is set here.
+** IWRAM, in particular, is already cleared and SOUNDBIAS already set to 0x200.
+*/
+static
+void
+gba_skip_bios(
+    struct gba *gba
+) {
+    struct core *core;
+
+    core = &gba->core;
+
+    /* The reset vector left the core in SVC mode, with r13_svc and r13_irq set. */
+    core_flags_sync(core);
+    core_switch_mode(core, MODE_SYS);
+    core->cpsr.irq_disable = false;
+    core->cpsr.fiq_disable = false;
+    core->cpsr.thumb = false;
+
+    /* The last op-code fetched from the BIOS, returned by open-bus reads of it. */
+    gba->memory.bios_bus = 0xE129F000;
+
+    /* Indicates that the BIOS has already run. */
+    gba->io.postflg = 1;
+
+    core->pc = CART_0_START;
+    core_scan_irq(gba);
+    core_reload_pipeline(gba);
+    core->cycles = 0;
+
+    logln(HS_CORE, "BIOS intro skipped.");
 }
 
 /*
@@ -38,6 +183,20 @@ void
 gba_reset(
     struct gba *gba
 ) {
+    if (gba->core.flags_set) {
+        logln(
+            HS_CORE,
+            "Flag liveness: %llu/%llu flag computations elided (%.1f%%).",
+            (unsigned long long)gba->core.flags_elided,
+            (unsigned long long)gba->core.flags_set,
+            100.f * gba->core.flags_elided / gba->core.flags_set
+        );
+    }
+
+#ifdef WITH_THUMB_PAIR_PROFILING
+    core_thumb_profile_dump();
+#endif
+
     sched_cleanup(gba);
 
     sched_init(gba);
@@ -47,11 +206,16 @@ gba_reset(
     apu_init(gba);
     core_init(gba);
     gpio_init(gba);
+
+    if (gba->skip_bios) {
+        gba_skip_bios(gba);
+    }
+
     gba->started = false;
 }
 
 /*
-** Run the emulator, consuming messages that dictate what the emulator should do.
+** Consume the messages sent by the frontend.
 **
 ** Messages are used as a mono-directional communication between the frontend and the emulator.
 **
@@ -60,210 +224,243 @@ gba_reset(
 **   - The user requested a quickload/quicksave
 **   - The emulator must run until the next frame, for one instruction, etc.
 **   - The emulator must pause, reset, etc.
+**
+** Return false if the emulator must exit.
 */
-void
-gba_run(
+static
+bool
+gba_process_messages(
     struct gba *gba
 ) {
-    uint64_t last_measured_time;
-    uint64_t accumulated_time;
-    uint64_t time_per_frame;
+    struct message_queue *mqueue;
+    struct message *message;
 
-    last_measured_time = hs_tick_count();
-    accumulated_time = 0;
-    time_per_frame = 0;
-    while (true) {
-        struct message_queue *mqueue;
-        struct message *message;
-
-        pthread_mutex_lock(&gba->message_queue.lock);
-
-        mqueue = &gba->message_queue;
-        message = mqueue->messages;
-        while (mqueue->length) {
-            switch (message->type) {
-                case MESSAGE_EXIT: {
-                    pthread_mutex_unlock(&gba->message_queue.lock);
-                    return ;
-                };
-                case MESSAGE_LOAD_BIOS: {
-                    struct message_data *message_data;
-
-                    message_data = (struct message_data *)message;
-                    memset(gba->memory.bios, 0, BIOS_MASK);
-                    memcpy(gba->memory.bios, message_data->data, min(message_data->size, BIOS_MASK));
-                    if (message_data->cleanup) {
-                        message_data->cleanup(message_data->data);
-                    }
-                    break;
-                };
-                case MESSAGE_LOAD_ROM: {
-                    struct message_data *message_data;
-
-                    message_data = (struct message_data *)message;
-                    memset(gba->memory.rom, 0, CART_SIZE);
-                    gba->memory.rom_size = min(message_data->size, CART_SIZE);
-                    memcpy(gba->memory.rom, message_data->data, gba->memory.rom_size);
-                    if (message_data->cleanup) {
-                        message_data->cleanup(message_data->data);
-                    }
-                    db_lookup_game(gba);
+    pthread_mutex_lock(&gba->message_queue.lock);
+
+    mqueue = &gba->message_queue;
+    message = mqueue->messages;
+    while (mqueue->length) {
+        switch (message->type) {
+            case MESSAGE_EXIT: {
+#ifdef WITH_THUMB_PAIR_PROFILING
+                core_thumb_profile_dump();
+#endif
+                pthread_mutex_unlock(&gba->message_queue.lock);
+                return (false);
+            };
+            case MESSAGE_LOAD_BIOS: {
+                struct message_data *message_data;
+
+                message_data = (struct message_data *)message;
+                memset(gba->memory.bios, 0, BIOS_MASK);
+                memcpy(gba->memory.bios, message_data->data, min(message_data->size, BIOS_MASK));
+                if (message_data->cleanup) {
+                    message_data->cleanup(message_data->data);
+                }
+                break;
+            };
+            case MESSAGE_LOAD_ROM: {
+                struct message_rom *message_rom;
+
+                message_rom = (struct message_rom *)message;
+                mem_load_rom(gba, message_rom->rom);
+                db_lookup_game(gba);
+                break;
+            };
+            case MESSAGE_LOAD_BACKUP: {
+                struct message_data *message_data;
+
+                message_data = (struct message_data *)message;
+                memset(gba->memory.backup_storage_data, 0, backup_storage_sizes[gba->memory.backup_storage_type]);
+                memcpy(
+                    gba->memory.backup_storage_data,
+                    message_data->data,
+                    min(message_data->size, backup_storage_sizes[gba->memory.backup_storage_type])
+                );
+                if (message_data->cleanup) {
+                    message_data->cleanup(message_data->data);
+                }
+                break;
+            };
+            case MESSAGE_BACKUP_TYPE: {
+                struct message_backup_type *message_backup_type;
+
+                /* Ignore if emulation is already started. */
+                if (gba->started) {
                     break;
+                }
+
+                message_backup_type = (struct message_backup_type *)message;
+                if (message_backup_type->type == BACKUP_AUTO_DETECT) {
+                    mem_backup_storage_detect(gba);
+                } else {
+                    gba->memory.backup_storage_type = message_backup_type->type;
+                    gba->memory.backup_storage_source = BACKUP_SOURCE_MANUAL;
+                }
+                mem_backup_storage_init(gba);
+                break;
+            };
+            case MESSAGE_RESET: {
+                gba_reset(gba);
+                break;
+            };
+            case MESSAGE_RUN: {
+                struct message_run *message_run;
+
+                message_run = (struct message_run *)message;
+                gba->started = true;
+                gba->state = GBA_STATE_RUN;
+                gba->speed = message_run->speed;
+                break;
+            };
+            case MESSAGE_PAUSE: {
+                gba->state = GBA_STATE_PAUSE;
+                break;
+            };
+            case MESSAGE_KEYINPUT: {
+                struct message_keyinput *message_keyinput;
+
+                message_keyinput = (struct message_keyinput *)message;
+                switch (message_keyinput->key) {
+                    case KEY_A:         gba->io.keyinput.a = !message_keyinput->pressed; break;
+                    case KEY_B:         gba->io.keyinput.b = !message_keyinput->pressed; break;
+                    case KEY_L:         gba->io.keyinput.l = !message_keyinput->pressed; break;
+                    case KEY_R:         gba->io.keyinput.r = !message_keyinput->pressed; break;
+                    case KEY_UP:        gba->io.keyinput.up = !message_keyinput->pressed; break;
+                    case KEY_DOWN:      gba->io.keyinput.down = !message_keyinput->pressed; break;
+                    case KEY_RIGHT:     gba->io.keyinput.right = !message_keyinput->pressed; break;
+                    case KEY_LEFT:      gba->io.keyinput.left = !message_keyinput->pressed; break;
+                    case KEY_START:     gba->io.keyinput.start = !message_keyinput->pressed; break;
+                    case KEY_SELECT:    gba->io.keyinput.select = !message_keyinput->pressed; break;
                 };
-                case MESSAGE_LOAD_BACKUP: {
-                    struct message_data *message_data;
-
-                    message_data = (struct message_data *)message;
-                    memset(gba->memory.backup_storage_data, 0, backup_storage_sizes[gba->memory.backup_storage_type]);
-                    memcpy(
-                        gba->memory.backup_storage_data,
-                        message_data->data,
-                        min(message_data->size, backup_storage_sizes[gba->memory.backup_storage_type])
-                    );
-                    if (message_data->cleanup) {
-                        message_data->cleanup(message_data->data);
-                    }
+
+                io_scan_keypad_irq(gba);
+                break;
+            };
+            case MESSAGE_QUICKLOAD: {
+                struct message_data *message_data;
+
+                message_data = (struct message_data *)message;
+                quickload(gba, (char const *)message_data->data);
+                if (message_data->cleanup) {
+                    message_data->cleanup(message_data->data);
+                }
+                break;
+            };
+            case MESSAGE_QUICKSAVE: {
+                struct message_data *message_data;
+
+                message_data = (struct message_data *)message;
+                quicksave(gba, (char const *)message_data->data);
+                if (message_data->cleanup) {
+                    message_data->cleanup(message_data->data);
+                }
+                break;
+            };
+            case MESSAGE_AUDIO_RESAMPLE_FREQ: {
+                struct message_audio_freq *message_audio_freq;
+
+                message_audio_freq = (struct message_audio_freq *)message;
+                gba->apu.resample_frequency = message_audio_freq->refill_frequency;
+                break;
+            };
+            case MESSAGE_COLOR_CORRECTION: {
+                struct message_color_correction *message_color_correction;
+
+                message_color_correction = (struct message_color_correction *)message;
+                gba->color_correction = message_color_correction->color_correction;
+                break;
+            };
+            case MESSAGE_RTC: {
+                struct message_device_state *message_device_state;
+
+                /* Ignore if emulation is already started. */
+                if (gba->started) {
                     break;
-                };
-                case MESSAGE_BACKUP_TYPE: {
-                    struct message_backup_type *message_backup_type;
+                }
 
-                    /* Ignore if emulation is already started. */
-                    if (gba->started) {
+                message_device_state = (struct message_device_state *)message;
+                switch (message_device_state->state) {
+                    case DEVICE_AUTO_DETECT: {
+                        gba->rtc_auto_detect = true;
+                        gba->rtc_enabled = false;
                         break;
-                    }
-
-                    message_backup_type = (struct message_backup_type *)message;
-                    if (message_backup_type->type == BACKUP_AUTO_DETECT) {
-                        mem_backup_storage_detect(gba);
-                    } else {
-                        gba->memory.backup_storage_type = message_backup_type->type;
-                        gba->memory.backup_storage_source = BACKUP_SOURCE_MANUAL;
-                    }
-                    mem_backup_storage_init(gba);
-                    break;
-                };
-                case MESSAGE_RESET: {
-                    gba_reset(gba);
-                    break;
-                };
-                case MESSAGE_RUN: {
-                    struct message_run *message_run;
-
-                    message_run = (struct message_run *)message;
-                    gba->started = true;
-                    gba->state = GBA_STATE_RUN;
-                    gba->speed = message_run->speed;
-                    if (message_run->speed) {
-                        time_per_frame = 1.f/59.737f * 1000.f * 1000.f / (float)gba->speed;
-                        accumulated_time = 0;
-                    } else {
-                        time_per_frame = 0.f;
-                    }
-                    break;
-                };
-                case MESSAGE_PAUSE: {
-                    gba->state = GBA_STATE_PAUSE;
-                    break;
-                };
-                case MESSAGE_KEYINPUT: {
-                    struct message_keyinput *message_keyinput;
-
-                    message_keyinput = (struct message_keyinput *)message;
-                    switch (message_keyinput->key) {
-                        case KEY_A:         gba->io.keyinput.a = !message_keyinput->pressed; break;
-                        case KEY_B:         gba->io.keyinput.b = !message_keyinput->pressed; break;
-                        case KEY_L:         gba->io.keyinput.l = !message_keyinput->pressed; break;
-                        case KEY_R:         gba->io.keyinput.r = !message_keyinput->pressed; break;
-                        case KEY_UP:        gba->io.keyinput.up = !message_keyinput->pressed; break;
-                        case KEY_DOWN:      gba->io.keyinput.down = !message_keyinput->pressed; break;
-                        case KEY_RIGHT:     gba->io.keyinput.right = !message_keyinput->pressed; break;
-                        case KEY_LEFT:      gba->io.keyinput.left = !message_keyinput->pressed; break;
-                        case KEY_START:     gba->io.keyinput.start = !message_keyinput->pressed; break;
-                        case KEY_SELECT:    gba->io.keyinput.select = !message_keyinput->pressed; break;
                     };
+                    case DEVICE_ENABLED: {
+                        gba->rtc_auto_detect = false;
+                        gba->rtc_enabled = true;
+                        break;
+                    };
+                    case DEVICE_DISABLED: {
+                        gba->rtc_auto_detect = false;
+                        gba->rtc_enabled = false;
+                        break;
+                    };
+                }
+                break;
+            };
+            case MESSAGE_SKIP_BIOS: {
+                struct message_skip_bios *message_skip_bios;
+
+                /* Takes effect on the next reset. */
+                message_skip_bios = (struct message_skip_bios *)message;
+                gba->skip_bios = message_skip_bios->skip_bios;
+                break;
+            };
+            case MESSAGE_PPU_WORKER: {
+                struct message_ppu_worker *message_ppu_worker;
+
+                message_ppu_worker = (struct message_ppu_worker *)message;
+                if (message_ppu_worker->enabled) {
+                    ppu_worker_start(gba);
+                } else {
+                    ppu_worker_stop(gba);
+                }
+                break;
+            };
+        }
+        mqueue->allocated_size -= message->size;
+        --mqueue->length;
+        message = (struct message *)((uint8_t *)message + message->size);
+    }
+    free(mqueue->messages);
+    mqueue->messages = NULL;
 
-                    io_scan_keypad_irq(gba);
-                    break;
-                };
-                case MESSAGE_QUICKLOAD: {
-                    struct message_data *message_data;
-
-                    message_data = (struct message_data *)message;
-                    quickload(gba, (char const *)message_data->data);
-                    if (message_data->cleanup) {
-                        message_data->cleanup(message_data->data);
-                    }
-                    break;
-                };
-                case MESSAGE_QUICKSAVE: {
-                    struct message_data *message_data;
-
-                    message_data = (struct message_data *)message;
-                    quicksave(gba, (char const *)message_data->data);
-                    if (message_data->cleanup) {
-                        message_data->cleanup(message_data->data);
-                    }
-                    break;
-                };
-                case MESSAGE_AUDIO_RESAMPLE_FREQ: {
-                    struct message_audio_freq *message_audio_freq;
-
-                    message_audio_freq = (struct message_audio_freq *)message;
-                    gba->apu.resample_frequency = message_audio_freq->refill_frequency;
-                    break;
-                };
-                case MESSAGE_COLOR_CORRECTION: {
-                    struct message_color_correction *message_color_correction;
+    pthread_mutex_unlock(&gba->message_queue.lock);
+    return (true);
+}
 
-                    message_color_correction = (struct message_color_correction *)message;
-                    gba->color_correction = message_color_correction->color_correction;
-                    break;
-                };
-                case MESSAGE_RTC: {
-                    struct message_device_state *message_device_state;
+/*
+** Run the emulator until it receives `MESSAGE_EXIT`, consuming the messages that
+** dictate what the emulator should do, and limiting the speed to the one requested
+** by the frontend.
+*/
+void
+gba_run(
+    struct gba *gba
+) {
+    uint64_t last_measured_time;
+    uint64_t accumulated_time;
+    uint64_t time_per_frame;
+    uint32_t speed;
 
-                    /* Ignore if emulation is already started. */
-                    if (gba->started) {
-                        break;
-                    }
-
-                    message_device_state = (struct message_device_state *)message;
-                    switch (message_device_state->state) {
-                        case DEVICE_AUTO_DETECT: {
-                            gba->rtc_auto_detect = true;
-                            gba->rtc_enabled = false;
-                            break;
-                        };
-                        case DEVICE_ENABLED: {
-                            gba->rtc_auto_detect = false;
-                            gba->rtc_enabled = true;
-                            break;
-                        };
-                        case DEVICE_DISABLED: {
-                            gba->rtc_auto_detect = false;
-                            gba->rtc_enabled = false;
-                            break;
-                        };
-                    }
-                    break;
-                };
-            }
-            mqueue->allocated_size -= message->size;
-            --mqueue->length;
-            message = (struct message *)((uint8_t *)message + message->size);
+    last_measured_time = hs_tick_count();
+    accumulated_time = 0;
+    time_per_frame = 0;
+    speed = 0;
+    while (gba_process_messages(gba)) {
+        if (gba->speed != speed) {
+            speed = gba->speed;
+            time_per_frame = speed ? 1.f/59.737f * 1000.f * 1000.f / (float)speed : 0.f;
+            accumulated_time = 0;
         }
-        free(mqueue->messages);
-        mqueue->messages = NULL;
-
-        pthread_mutex_unlock(&gba->message_queue.lock);
 
         if (gba->state == GBA_STATE_RUN) {
             sched_run_for(gba, CYCLES_PER_FRAME);
         }
 
         /* Limit FPS */
-        if (gba->speed) {
+        if (speed) {
             uint64_t now;
 
             now = hs_tick_count();
@@ -284,6 +481,30 @@ gba_run(
     }
 }
 
+/*
+** Consume the pending messages and run the emulator for the given amount of frames
+** as fast as possible, on the calling thread.
+**
+** This is the entry point of headless frontends, which drive the emulator themselves
+** instead of dedicating a thread to `gba_run()`. Return false if the emulator
+** received `MESSAGE_EXIT`.
+*/
+bool
+gba_run_frames(
+    struct gba *gba,
+    uint32_t frames
+) {
+    if (!gba_process_messages(gba)) {
+        return (false);
+    }
+
+    while (frames && gba->state == GBA_STATE_RUN) {
+        sched_run_for(gba, CYCLES_PER_FRAME);
+        --frames;
+    }
+    return (true);
+}
+
 /*
 ** Put the given message in the message queue.
 */
@@ -11,9 +11,9 @@
 #include "gba/gba.h"
 #include "gba/scheduler.h"
 
-static uint32_t src_mask[4]   = {0x07FFFFFF, 0x0FFFFFFF, 0x0FFFFFFF, 0x0FFFFFFF};
-static uint32_t dst_mask[4]   = {0x07FFFFFF, 0x07FFFFFF, 0x07FFFFFF, 0x0FFFFFFF};
-static uint32_t count_mask[4] = {0x3FFF,     0x3FFF,     0x3FFF,     0xFFFF};
+static uint32_t const src_mask[4]   = {0x07FFFFFF, 0x0FFFFFFF, 0x0FFFFFFF, 0x0FFFFFFF};
+static uint32_t const dst_mask[4]   = {0x07FFFFFF, 0x07FFFFFF, 0x07FFFFFF, 0x0FFFFFFF};
+static uint32_t const count_mask[4] = {0x3FFF,     0x3FFF,     0x3FFF,     0xFFFF};
 
 void
 mem_dma_load(
@@ -137,7 +137,9 @@ dma_run_channel(
         }
     }
 
-    gba->io.int_flag.raw |= (channel->control.irq_end << (IRQ_DMA0 + channel->index));
+    if (channel->control.irq_end) {
+        core_trigger_irq(gba, IRQ_DMA0 + channel->index);
+    }
 
     if (channel->control.repeat) {
         if (channel->is_fifo) {
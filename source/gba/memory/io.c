@@ -300,19 +300,19 @@ mem_io_write8(
     switch (addr) {
 
         /* Display */
-        case IO_REG_DISPCNT:                io->dispcnt.bytes[0] = val; break;
-        case IO_REG_DISPCNT + 1:            io->dispcnt.bytes[1] = val; break;
+        case IO_REG_DISPCNT:                io->dispcnt.bytes[0] = val; ppu_update_layer_order(gba); break;
+        case IO_REG_DISPCNT + 1:            io->dispcnt.bytes[1] = val; ppu_update_layer_order(gba); break;
         case IO_REG_GREENSWP:               io->greenswp.bytes[0] = val; break;
         case IO_REG_GREENSWP + 1:           io->greenswp.bytes[1] = val; break;
         case IO_REG_DISPSTAT:               io->dispstat.bytes[0] = val; break;
         case IO_REG_DISPSTAT + 1:           io->dispstat.bytes[1] = val; break;
-        case IO_REG_BG0CNT:                 io->bgcnt[0].bytes[0] = val; break;
+        case IO_REG_BG0CNT:                 io->bgcnt[0].bytes[0] = val; ppu_update_layer_order(gba); break;
         case IO_REG_BG0CNT + 1:             io->bgcnt[0].bytes[1] = val & 0xDF; break;
-        case IO_REG_BG1CNT:                 io->bgcnt[1].bytes[0] = val; break;
+        case IO_REG_BG1CNT:                 io->bgcnt[1].bytes[0] = val; ppu_update_layer_order(gba); break;
         case IO_REG_BG1CNT + 1:             io->bgcnt[1].bytes[1] = val & 0xDF; break;
-        case IO_REG_BG2CNT:                 io->bgcnt[2].bytes[0] = val; break;
+        case IO_REG_BG2CNT:                 io->bgcnt[2].bytes[0] = val; ppu_update_layer_order(gba); break;
         case IO_REG_BG2CNT + 1:             io->bgcnt[2].bytes[1] = val; break;
-        case IO_REG_BG3CNT:                 io->bgcnt[3].bytes[0] = val; break;
+        case IO_REG_BG3CNT:                 io->bgcnt[3].bytes[0] = val; ppu_update_layer_order(gba); break;
         case IO_REG_BG3CNT + 1:             io->bgcnt[3].bytes[1] = val; break;
         case IO_REG_BG0HOFS:                io->bg_hoffset[0].bytes[0] = val; break;
         case IO_REG_BG0HOFS + 1:            io->bg_hoffset[0].bytes[1] = val & 0x1; break;
@@ -598,7 +598,7 @@ mem_io_write8(
 
             /* Stub */
             if (io->siocnt.start && io->siocnt.irq) {
-                gba->io.int_flag.serial = true;
+                core_trigger_irq(gba, IRQ_SERIAL);
             }
             io->siocnt.start = false;
             break;
@@ -627,9 +627,17 @@ mem_io_write8(
 
         /* Interrupt */
         case IO_REG_IE:
-        case IO_REG_IE + 1:                 io->int_enabled.bytes[addr - IO_REG_IE] = val; break;
-        case IO_REG_IF:                     io->int_flag.bytes[0] &= ~val; break;
-        case IO_REG_IF + 1:                 io->int_flag.bytes[1] &= ~val; break;
+        case IO_REG_IE + 1: {
+            io->int_enabled.bytes[addr - IO_REG_IE] = val;
+            core_scan_irq(gba);
+            break;
+        };
+        case IO_REG_IF:
+        case IO_REG_IF + 1: {
+            io->int_flag.bytes[addr - IO_REG_IF] &= ~val;
+            core_scan_irq(gba);
+            break;
+        };
         case IO_REG_WAITCNT:
         case IO_REG_WAITCNT + 1: {
             io->waitcnt.bytes[addr - IO_REG_WAITCNT] = val;
@@ -638,7 +646,11 @@ mem_io_write8(
             break;
         };
         case IO_REG_IME:
-        case IO_REG_IME + 1:                io->ime.bytes[addr - IO_REG_IME] = val; break;
+        case IO_REG_IME + 1: {
+            io->ime.bytes[addr - IO_REG_IME] = val;
+            core_scan_irq(gba);
+            break;
+        };
 
         /* System */
         case IO_REG_POSTFLG:                io->postflg = val; break;
@@ -670,6 +682,6 @@ io_scan_keypad_irq(
     struct gba *gba
 ) {
     if (gba->io.keycnt.irq_enable && io_evaluate_keypad_cond(gba)) {
-        gba->io.int_flag.keypad = true;
+        core_trigger_irq(gba, IRQ_KEYPAD);
     }
 }
\ No newline at end of file
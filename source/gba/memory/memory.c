@@ -36,17 +36,17 @@
 **
 ** Source: GBATek
 */
-static uint32_t access_time16[2][16] = {
+static uint32_t const default_access_time16[2][16] = {
     [NON_SEQUENTIAL]    = { 1, 1, 3, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 1 },
     [SEQUENTIAL]        = { 1, 1, 3, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 1 },
 };
 
-static uint32_t access_time32[2][16] = {
+static uint32_t const default_access_time32[2][16] = {
     [NON_SEQUENTIAL]    = { 1, 1, 6, 1, 1, 2, 2, 1, 0, 0, 0, 0, 0, 0, 0, 1 },
     [SEQUENTIAL]        = { 1, 1, 6, 1, 1, 2, 2, 1, 0, 0, 0, 0, 0, 0, 0, 1 },
 };
 
-static uint32_t gamepak_nonseq_waitstates[4] = { 4, 3, 2, 8 };
+static uint32_t const gamepak_nonseq_waitstates[4] = { 4, 3, 2, 8 };
 
 /*
 ** Initialize the memory to its initial state, before the system is up.
@@ -59,7 +59,11 @@ mem_reset(
     memset(memory->iwram, 0, sizeof(memory->iwram));
     memset(memory->palram, 0, sizeof(memory->palram));
     memset(memory->vram, 0, sizeof(memory->vram));
+    memset(memory->vram_dirty, 0xFF, sizeof(memory->vram_dirty));
     memset(memory->oam, 0, sizeof(memory->oam));
+    memory->oam_dirty = true;
+    memcpy(memory->access_time16, default_access_time16, sizeof(memory->access_time16));
+    memcpy(memory->access_time32, default_access_time32, sizeof(memory->access_time32));
     memset(&memory->pbuffer, 0, sizeof(memory->pbuffer));
     memset(&memory->flash, 0, sizeof(memory->flash));
     memory->gamepak_bus_in_use = false;
@@ -75,12 +79,16 @@ mem_reset(
 */
 void
 mem_update_waitstates(
-    struct gba const *gba
+    struct gba *gba
 ) {
+    uint32_t (*access_time16)[16];
+    uint32_t (*access_time32)[16];
     struct io const *io;
     uint32_t x;
 
     io = &gba->io;
+    access_time16 = gba->memory.access_time16;
+    access_time32 = gba->memory.access_time32;
 
     // 16 bit, non seq
     access_time16[NON_SEQUENTIAL][CART_0_REGION_1] = 1 + gamepak_nonseq_waitstates[io->waitcnt.ws0_nonseq];
@@ -128,9 +136,9 @@ mem_access(
     }
 
     if (size <= sizeof(uint16_t)) {
-        cycles = access_time16[access_type][page];
+        cycles = gba->memory.access_time16[access_type][page];
     } else {
-        cycles = access_time32[access_type][page];
+        cycles = gba->memory.access_time32[access_type][page];
     }
 
     gba->memory.gamepak_bus_in_use = (page >= CART_REGION_START && page <= CART_REGION_END);
@@ -172,11 +180,11 @@ mem_prefetch_buffer_access(
         if (gba->core.cpsr.thumb) {
             pbuffer->insn_len = sizeof(uint16_t);
             pbuffer->capacity = 8;
-            pbuffer->reload = access_time16[SEQUENTIAL][(addr >> 24) & 0xF];
+            pbuffer->reload = gba->memory.access_time16[SEQUENTIAL][(addr >> 24) & 0xF];
         } else {
             pbuffer->insn_len = sizeof(uint32_t);
             pbuffer->capacity = 4;
-            pbuffer->reload = access_time32[SEQUENTIAL][(addr >> 24) & 0xF];
+            pbuffer->reload = gba->memory.access_time32[SEQUENTIAL][(addr >> 24) & 0xF];
         }
 
         pbuffer->countdown = pbuffer->reload;
@@ -275,6 +283,27 @@ mem_openbus_read(
     return (val >> (8 * shift));
 }
 
+/*
+** Determine the value returned by a read past the end of the ROM.
+**
+** Nothing drives the cartridge bus, which still holds the address latched by the
+** Game Pak: the read returns the lower 16 bits of the address of each half-word,
+** divided by two.
+*/
+static inline
+uint32_t
+mem_rom_openbus_read(
+    uint32_t addr
+) {
+    uint32_t aligned;
+    uint32_t val;
+
+    aligned = addr & ~0x3;
+    val = (aligned >> 1) & 0xFFFF;
+    val |= (((aligned + 2) >> 1) & 0xFFFF) << 16;
+    return (val >> (8 * (addr & 0x3)));
+}
+
 /*
 ** Read the data of type T located in memory at the given address.
 **
@@ -337,8 +366,10 @@ mem_openbus_read(
                     _ret = mem_eeprom_read8(gba);                                           \
                 } else if (unlikely((addr) >= GPIO_REG_START && (addr) <= GPIO_REG_END && (gba)->gpio.readable)) { \
                     _ret = gpio_read_u8((gba), (addr));                                     \
+                } else if (likely(((addr) & CART_MASK) + sizeof(T) <= (gba)->memory.rom_size)) { \
+                    _ret = *(T const *)((gba)->memory.rom + ((addr) & CART_MASK));          \
                 } else {                                                                    \
-                    _ret = *(T *)((uint8_t *)((gba)->memory.rom) + ((addr) & CART_MASK));   \
+                    _ret = mem_rom_openbus_read((addr));                                    \
                 }                                                                           \
                 break;                                                                      \
             };                                                                              \
@@ -395,15 +426,46 @@ mem_openbus_read(
                     })                                                                          \
                 );                                                                              \
                 break;                                                                          \
-            case PALRAM_REGION:                                                                 \
-                *(T *)((uint8_t *)((gba)->memory.palram) + ((addr) & PALRAM_MASK)) = (T)(val);  \
+            case PALRAM_REGION: {                                                               \
+                uint32_t _off;                                                                  \
+                                                                                                \
+                _off = (addr) & PALRAM_MASK;                                                    \
+                *(T *)((uint8_t *)((gba)->memory.palram) + _off) = (T)(val);                    \
+                if ((gba)->ppu_worker) {                                                        \
+                    ppu_worker_log_write(                                                       \
+                        (gba)->ppu_worker, PALRAM_REGION, _off, (val), sizeof(T)                \
+                    );                                                                          \
+                }                                                                               \
                 break;                                                                          \
-            case VRAM_REGION:                                                                   \
-                *(T *)((uint8_t *)((gba)->memory.vram) + ((addr) & (((addr) & 0x10000) ? VRAM_MASK_1 : VRAM_MASK_2))) = (T)(val); \
+            };                                                                                  \
+            case VRAM_REGION: {                                                                 \
+                uint32_t _off;                                                                  \
+                                                                                                \
+                _off = (addr) & (((addr) & 0x10000) ? VRAM_MASK_1 : VRAM_MASK_2);               \
+                *(T *)((uint8_t *)((gba)->memory.vram) + _off) = (T)(val);                      \
+                if ((gba)->ppu_worker) {                                                        \
+                    ppu_worker_log_write(                                                       \
+                        (gba)->ppu_worker, VRAM_REGION, _off, (val), sizeof(T)                  \
+                    );                                                                          \
+                } else {                                                                        \
+                    mem_vram_mark_dirty((gba), _off);                                           \
+                }                                                                               \
                 break;                                                                          \
-            case OAM_REGION:                                                                    \
-                *(T *)((uint8_t *)((gba)->memory.oam) + ((addr) & OAM_MASK)) = (T)(val);        \
+            };                                                                                  \
+            case OAM_REGION: {                                                                  \
+                uint32_t _off;                                                                  \
+                                                                                                \
+                _off = (addr) & OAM_MASK;                                                       \
+                *(T *)((uint8_t *)((gba)->memory.oam) + _off) = (T)(val);                       \
+                if ((gba)->ppu_worker) {                                                        \
+                    ppu_worker_log_write(                                                       \
+                        (gba)->ppu_worker, OAM_REGION, _off, (val), sizeof(T)                   \
+                    );                                                                          \
+                } else {                                                                        \
+                    (gba)->memory.oam_dirty = true;                                             \
+                }                                                                               \
                 break;                                                                          \
+            };                                                                                  \
             case CART_REGION_START ... CART_REGION_END: {                                       \
                 if (   ((addr) & (gba)->memory.eeprom.mask) == (gba)->memory.eeprom.range       \
                     && ((gba)->memory.backup_storage_type == BACKUP_EEPROM_4K                   \
@@ -577,4 +639,176 @@ mem_write32(
 
     mem_access(gba, addr, sizeof(uint32_t), access_type);
     template_write(uint32_t, gba, addr, val);
+}
+
+/*
+** Read the word at the given address and ROR it if the address isn't aligned.
+**
+** Fast path for stack accesses: when the address is within IWRAM, the region
+** dispatch of `mem_read32_ror()` is skipped entirely.
+*/
+uint32_t
+mem_iwram_read32_ror(
+    struct gba *gba,
+    uint32_t addr,
+    enum access_type access_type
+) {
+    uint32_t rotate;
+    uint32_t value;
+
+    if (unlikely((addr >> 24) != IWRAM_REGION)) {
+        return (mem_read32_ror(gba, addr, access_type));
+    }
+
+    rotate = (addr % 4) << 3;
+    addr &= ~(sizeof(uint32_t) - 1);
+
+    gba->memory.gamepak_bus_in_use = false;
+    core_idle_for(gba, gba->memory.access_time32[access_type][IWRAM_REGION]);
+    value = *(uint32_t *)((uint8_t *)gba->memory.iwram + (addr & IWRAM_MASK));
+    return (ror32(value, rotate));
+}
+
+/*
+** Write a word at the given address.
+**
+** Fast path for stack accesses, see `mem_iwram_read32_ror()`.
+*/
+void
+mem_iwram_write32(
+    struct gba *gba,
+    uint32_t addr,
+    uint32_t val,
+    enum access_type access_type
+) {
+    if (unlikely((addr >> 24) != IWRAM_REGION)) {
+        mem_write32(gba, addr, val, access_type);
+        return ;
+    }
+
+    addr &= ~(sizeof(uint32_t) - 1);
+
+    gba->memory.gamepak_bus_in_use = false;
+    core_idle_for(gba, gba->memory.access_time32[access_type][IWRAM_REGION]);
+    *(uint32_t *)((uint8_t *)gba->memory.iwram + (addr & IWRAM_MASK)) = val;
+}
+
+/*
+** Read the word at the given address and ROR it if the address isn't aligned.
+**
+** Fast path for PC-relative loads: when the address is within the ROM and
+** doesn't map to the EEPROM or the GPIO registers, the word is read directly
+** from the ROM.
+*/
+uint32_t
+mem_rom_read32_ror(
+    struct gba *gba,
+    uint32_t addr,
+    enum access_type access_type
+) {
+    uint32_t rotate;
+    uint32_t value;
+
+    if (unlikely(
+           (addr >> 24) < CART_REGION_START
+        || (addr >> 24) > CART_REGION_END
+        || (
+               (addr & gba->memory.eeprom.mask) == gba->memory.eeprom.range
+            && (gba->memory.backup_storage_type == BACKUP_EEPROM_4K || gba->memory.backup_storage_type == BACKUP_EEPROM_64K)
+        )
+        || (addr >= GPIO_REG_START && addr <= GPIO_REG_END && gba->gpio.readable)
+        || ((addr & CART_MASK & ~(sizeof(uint32_t) - 1)) + sizeof(uint32_t) > gba->memory.rom_size)
+    )) {
+        return (mem_read32_ror(gba, addr, access_type));
+    }
+
+    rotate = (addr % 4) << 3;
+    addr &= ~(sizeof(uint32_t) - 1);
+
+    mem_access(gba, addr, sizeof(uint32_t), access_type);
+    value = *(uint32_t const *)(gba->memory.rom + (addr & CART_MASK));
+    return (ror32(value, rotate));
+}
+
+/*
+** Fast path for block data transfers (LDM/STM, PUSH/POP).
+**
+** If the `count` words starting at `addr` all lie within the same mirror of IWRAM,
+** EWRAM or VRAM, and if the transfer ends before the next scheduled event, account
+** the N+(n-1)S cycles it takes and return a pointer to the first word.
+**
+** Otherwise, return NULL and let the caller go through the usual accessors, one
+** word at a time.
+*/
+uint32_t *
+mem_bulk_access(
+    struct gba *gba,
+    uint32_t addr,
+    uint32_t count
+) {
+    uint32_t region;
+    uint32_t cycles;
+    uint32_t last;
+    uint32_t off;
+    uint8_t *ptr;
+
+    addr &= ~(sizeof(uint32_t) - 1);
+    last = addr + (count - 1) * sizeof(uint32_t);
+    region = addr >> 24;
+
+    switch (region) {
+        case EWRAM_REGION: {
+            if ((addr & ~EWRAM_MASK) != (last & ~EWRAM_MASK)) {
+                return (NULL);
+            }
+            ptr = (uint8_t *)gba->memory.ewram + (addr & EWRAM_MASK);
+            break;
+        };
+        case IWRAM_REGION: {
+            if ((addr & ~IWRAM_MASK) != (last & ~IWRAM_MASK)) {
+                return (NULL);
+            }
+            ptr = (uint8_t *)gba->memory.iwram + (addr & IWRAM_MASK);
+            break;
+        };
+        case VRAM_REGION: {
+            /*
+            ** Only consider the range that isn't mirrored within a 128KB block.
+            **
+            ** Writes made through the returned pointer couldn't be logged for the PPU
+            ** worker, so there is no fast path for VRAM when there is one.
+            */
+            if (
+                   gba->ppu_worker
+                || (addr & ~VRAM_MASK_2) != (last & ~VRAM_MASK_2)
+                || (last & VRAM_MASK_2) > VRAM_MASK_1
+            ) {
+                return (NULL);
+            }
+            ptr = (uint8_t *)gba->memory.vram + (addr & VRAM_MASK_2);
+
+            /*
+            ** The caller may be about to write there. Invalidating the tile cache on a
+            ** read is harmless, and reading VRAM through LDM/POP is rare anyway.
+            */
+            for (off = addr & VRAM_MASK_2; off <= (last & VRAM_MASK_2); off += 32) {
+                mem_vram_mark_dirty(gba, off);
+            }
+            mem_vram_mark_dirty(gba, last & VRAM_MASK_2);
+            break;
+        };
+        default: {
+            return (NULL);
+        };
+    }
+
+    cycles = gba->memory.access_time32[NON_SEQUENTIAL][region] + (count - 1) * gba->memory.access_time32[SEQUENTIAL][region];
+
+    if (gba->core.cycles + cycles >= gba->scheduler.next_event) {
+        return (NULL);
+    }
+
+    gba->memory.gamepak_bus_in_use = false;
+    core_idle_for(gba, cycles);
+    return ((uint32_t *)ptr);
 }
\ No newline at end of file
@@ -0,0 +1,210 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+#include <string.h>
+#include <errno.h>
+#include "gba/gba.h"
+#include "gba/core/thumb.h"
+
+#if !defined (_WIN32) || defined (__CYGWIN__)
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+# define WITH_ROM_MMAP
+#endif
+
+/*
+** Read the whole content of `file` in a buffer allocated with `malloc()`.
+**
+** Return false and set `errno` on failure.
+*/
+static
+bool
+mem_rom_read_file(
+    FILE *file,
+    struct rom *rom
+) {
+    uint8_t *data;
+    long len;
+
+    if (fseek(file, 0, SEEK_END) || (len = ftell(file)) < 0 || fseek(file, 0, SEEK_SET)) {
+        return (false);
+    }
+
+    data = malloc(len ? len : 1);
+    if (!data) {
+        return (false);
+    }
+
+    if (fread(data, 1, len, file) != (size_t)len) {
+        free(data);
+        errno = EIO;
+        return (false);
+    }
+
+    rom->data = data;
+    rom->size = len;
+    rom->mapped = false;
+    return (true);
+}
+
+/*
+** Open the ROM at `path`.
+**
+** The file is mapped read-only, so that all the instances running the same game share
+** the same physical pages. If mapping it isn't possible (unsupported platform, special
+** file, etc.), it is read in a heap-allocated buffer instead.
+**
+** NOTE: MAP_PRIVATE only copies the pages that are written to, so the mapping still reads
+** through to the file: if another process truncates it while the game runs, accessing the
+** missing pages raises SIGBUS and kills the emulator. Modifications of the file's content
+** can also leak into the running game. The ROM is expected to be left alone while it is
+** being played, like any other file the emulator has open.
+**
+** The returned image has a reference count of one.
+** Return NULL and set `errno` on failure.
+*/
+struct rom *
+mem_rom_open(
+    char const *path
+) {
+    struct rom *rom;
+    FILE *file;
+    int err;
+
+    rom = calloc(1, sizeof(*rom));
+    if (!rom) {
+        return (NULL);
+    }
+
+    atomic_init(&rom->refcount, 1);
+    pthread_mutex_init(&rom->analysis_lock, NULL);
+
+    file = fopen(path, "rb");
+    if (!file) {
+        goto err;
+    }
+
+#ifdef WITH_ROM_MMAP
+    {
+        struct stat st;
+
+        if (!fstat(fileno(file), &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void *data;
+
+            data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+            if (data != MAP_FAILED) {
+#ifdef MADV_HUGEPAGE
+                madvise(data, st.st_size, MADV_HUGEPAGE);
+#endif
+                rom->data = data;
+                rom->size = st.st_size;
+                rom->mapped = true;
+                fclose(file);
+                return (rom);
+            }
+        }
+    }
+#endif
+
+    if (!mem_rom_read_file(file, rom)) {
+        err = errno;
+        fclose(file);
+        errno = err;
+        goto err;
+    }
+
+    fclose(file);
+    return (rom);
+
+err:
+    err = errno;
+    pthread_mutex_destroy(&rom->analysis_lock);
+    free(rom);
+    errno = err;
+    return (NULL);
+}
+
+/*
+** Take a new reference on `rom`.
+*/
+struct rom *
+mem_rom_ref(
+    struct rom *rom
+) {
+    atomic_fetch_add_explicit(&rom->refcount, 1, memory_order_relaxed);
+    return (rom);
+}
+
+/*
+** Drop a reference on `rom`, releasing it when it was the last one.
+*/
+void
+mem_rom_unref(
+    struct rom *rom
+) {
+    if (!rom || atomic_fetch_sub_explicit(&rom->refcount, 1, memory_order_acq_rel) != 1) {
+        return ;
+    }
+
+#ifdef WITH_ROM_MMAP
+    if (rom->mapped) {
+        munmap((void *)rom->data, rom->size);
+    } else {
+        free((void *)rom->data);
+    }
+#else
+    free((void *)rom->data);
+#endif
+
+    free(rom->thumb_insns);
+    free(rom->arm_flags);
+    pthread_mutex_destroy(&rom->analysis_lock);
+    free(rom);
+}
+
+/*
+** Insert `rom` in the cartridge slot, replacing the previous one (if any).
+**
+** The reference held by the caller is transferred to `gba`. The ROM isn't copied, and
+** neither is the analysis of its instructions: it is only done by the first instance
+** the ROM is loaded in, with `core_flags_analyze_rom()` and `core_thumb_fuse_rom()`.
+*/
+void
+mem_load_rom(
+    struct gba *gba,
+    struct rom *rom
+) {
+    struct memory *memory;
+
+    memory = &gba->memory;
+
+    mem_rom_unref(memory->rom_image);
+
+    memory->rom_image = rom;
+    memory->rom = rom->data;
+    memory->rom_size = min(rom->size, CART_SIZE);
+
+    pthread_mutex_lock(&rom->analysis_lock);
+    if (!rom->thumb_insns) {
+        rom->thumb_insns = calloc((memory->rom_size + 1) / 2 + 1, sizeof(uint8_t));
+        rom->arm_flags = calloc((memory->rom_size + 15) / 16 + 1, sizeof(uint8_t));
+        hs_assert(rom->thumb_insns && rom->arm_flags);
+
+        memory->rom_thumb_insns = rom->thumb_insns;
+        memory->rom_arm_flags = rom->arm_flags;
+        core_flags_analyze_rom(gba);
+        core_thumb_fuse_rom(gba);
+    }
+    pthread_mutex_unlock(&rom->analysis_lock);
+
+    memory->rom_thumb_insns = rom->thumb_insns;
+    memory->rom_arm_flags = rom->arm_flags;
+}
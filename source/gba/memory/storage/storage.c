@@ -19,7 +19,7 @@
 #include "gba/gba.h"
 #include "gba/db.h"
 
-size_t backup_storage_sizes[] = {
+size_t const backup_storage_sizes[] = {
     [BACKUP_NONE] = 0,
     [BACKUP_EEPROM_4K] = EEPROM_4K_SIZE,
     [BACKUP_EEPROM_64K] = EEPROM_64K_SIZE,
@@ -66,22 +66,22 @@ mem_backup_storage_detect(
     gba->memory.backup_storage_source = BACKUP_SOURCE_AUTO_DETECT;
 
     /* Auto-detection algorithm are very simple: they look for a bunch of strings in the game's ROM. */
-    if (array_search(gba->memory.rom, sizeof(gba->memory.rom), "EEPROM_V", 7)) {
+    if (array_search(gba->memory.rom, gba->memory.rom_size, "EEPROM_V", 7)) {
         logln(HS_GLOBAL, "Detected EEPROM 64K memory.");
         logln(HS_WARNING, "If you are having issues with corrupted saves, try EEPROM 8K instead.");
         gba->memory.backup_storage_type = BACKUP_EEPROM_64K;
     } else if (
-           array_search(gba->memory.rom, sizeof(gba->memory.rom), "SRAM_V", 5)
-        || array_search(gba->memory.rom, sizeof(gba->memory.rom), "SRAM_F_V", 5)
+           array_search(gba->memory.rom, gba->memory.rom_size, "SRAM_V", 5)
+        || array_search(gba->memory.rom, gba->memory.rom_size, "SRAM_F_V", 5)
     ) {
         logln(HS_GLOBAL, "Detected SRAM memory");
         gba->memory.backup_storage_type = BACKUP_SRAM;
-    } else if (array_search(gba->memory.rom, sizeof(gba->memory.rom), "FLASH1M_V", 8)) {
+    } else if (array_search(gba->memory.rom, gba->memory.rom_size, "FLASH1M_V", 8)) {
         logln(HS_GLOBAL, "Detected Flash 128 kilobytes / 1 megabit");
         gba->memory.backup_storage_type = BACKUP_FLASH128;
     } else if (
-           array_search(gba->memory.rom, sizeof(gba->memory.rom), "FLASH_V", 6)
-        || array_search(gba->memory.rom, sizeof(gba->memory.rom), "FLASH512_V", 9)
+           array_search(gba->memory.rom, gba->memory.rom_size, "FLASH_V", 6)
+        || array_search(gba->memory.rom, gba->memory.rom_size, "FLASH512_V", 9)
     ) {
         logln(HS_GLOBAL, "Detected Flash 64 kilobytes / 512 kilobits");
         gba->memory.backup_storage_type = BACKUP_FLASH64;
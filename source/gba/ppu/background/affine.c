@@ -36,12 +36,17 @@ ppu_step_affine_internal_registers(
     }
 }
 
+/*
+** Render the pixels `start` to `end` (excluded) of the affine background of given index.
+*/
 void
 ppu_render_background_affine(
     struct gba *gba,
     struct scanline *scanline,
     uint32_t line,
-    uint32_t bg_idx
+    uint32_t bg_idx,
+    uint32_t start,
+    uint32_t end
 ) {
     uint32_t screen_addr;
     uint32_t chrs_addr;
@@ -52,9 +57,11 @@ ppu_render_background_affine(
     int32_t bg_size;
     uint32_t x;
     struct io const *io;
+    struct layer *layer;
 
     io = &gba->io;
-    scanline->top_idx = bg_idx;
+    layer = &scanline->bg[bg_idx];
+    memset(layer->flags, 0, sizeof(layer->flags));
 
     switch (gba->io.bgcnt[bg_idx].size) {
         case 0b00: bg_size = 128; break;
@@ -63,16 +70,16 @@ ppu_render_background_affine(
         case 0b11: bg_size = 1024; break;
     }
 
-    px = gba->ppu.internal_px[bg_idx % 2];
-    py = gba->ppu.internal_py[bg_idx % 2];
-
     pa = (int16_t)io->bg_pa[bg_idx % 2].raw;
     pc = (int16_t)io->bg_pc[bg_idx % 2].raw;
 
+    px = gba->ppu.internal_px[bg_idx % 2] + pa * (int32_t)start;
+    py = gba->ppu.internal_py[bg_idx % 2] + pc * (int32_t)start;
+
     screen_addr = (uint32_t)io->bgcnt[bg_idx].screen_base * 0x800;
     chrs_addr = (uint32_t)io->bgcnt[bg_idx].character_base * 0x4000;
 
-    for (x = 0; x < GBA_SCREEN_WIDTH; ++x, px += pa, py += pc) {
+    for (x = start; x < end; ++x, px += pa, py += pc) {
         uint32_t palette_idx;
         uint32_t tile_idx;
         int32_t tile_x;
@@ -97,13 +104,8 @@ ppu_render_background_affine(
         palette_idx = mem_vram_read8(gba, chrs_addr + tile_idx * 64 + chr_y * 8 + chr_x);
 
         if (palette_idx) {
-            struct rich_color c;
-
-            c.raw = mem_palram_read16(gba, palette_idx * sizeof(union color));
-            c.visible = true;
-            c.idx = bg_idx;
-            c.force_blend = false;
-            scanline->bg[x] = c;
+            layer->color[x] = mem_palram_read16(gba, palette_idx * sizeof(union color));
+            layer->flags[x] = LAYER_VISIBLE;
         }
     }
 }
\ No newline at end of file
@@ -11,30 +11,110 @@
 #include "gba/gba.h"
 #include "gba/ppu.h"
 
+/*
+** Return the range of pixels, within `start` to `end` (excluded), that fall inside a bitmap
+** `width` pixels wide when the first one is at `rel_x`, and the bitmap isn't transformed.
+*/
+static inline
+void
+ppu_bitmap_clip_row(
+    int32_t rel_x,
+    int32_t width,
+    uint32_t start,
+    uint32_t end,
+    int32_t *first,
+    int32_t *last
+) {
+    *first = max((int32_t)start, (int32_t)start - rel_x);
+    *last = min((int32_t)end, (int32_t)start + width - rel_x);
+}
+
+/*
+** Copy the colors of a row of a mode 3 or 5 bitmap, starting at `addr` in VRAM, to the
+** pixels `first` to `last` (excluded) of the layer.
+*/
+static inline
+void
+ppu_bitmap_copy_row(
+    struct gba const *gba,
+    struct layer *layer,
+    uint32_t addr,
+    int32_t first,
+    int32_t last
+) {
+    memcpy(layer->color + first, gba->memory.vram + addr, (last - first) * sizeof(union color));
+    memset(layer->flags + first, LAYER_VISIBLE, last - first);
+}
+
+/*
+** Render the pixels `start` to `end` (excluded) of the bitmap background of modes 3 and 4.
+*/
 void
 ppu_render_background_bitmap(
     struct gba const *gba,
     struct scanline *scanline,
-    bool palette
+    bool palette,
+    uint32_t start,
+    uint32_t end
 ) {
     int16_t pa;
     int16_t pc;
     int32_t px;
     int32_t py;
     uint32_t x;
-    struct rich_color c;
     struct io const *io;
+    struct layer *layer;
 
     io = &gba->io;
-    scanline->top_idx = 2;
-
-    px = gba->ppu.internal_px[0];
-    py = gba->ppu.internal_py[0];
+    layer = &scanline->bg[2];
+    memset(layer->flags, 0, sizeof(layer->flags));
 
     pa = (int16_t)io->bg_pa[0].raw;
     pc = (int16_t)io->bg_pc[0].raw;
 
-    for (x = 0; x < GBA_SCREEN_WIDTH; ++x, px += pa, py += pc) {
+    px = gba->ppu.internal_px[0] + pa * (int32_t)start;
+    py = gba->ppu.internal_py[0] + pc * (int32_t)start;
+
+    /*
+    ** Without any rotation or scaling, the scanline is a row of the bitmap that only
+    ** has to be clipped once.
+    */
+    if (pa == 0x100 && pc == 0) {
+        uint32_t addr;
+        int32_t rel_y;
+        int32_t first;
+        int32_t last;
+
+        rel_y = py >> 8;
+        if (rel_y < 0 || rel_y >= GBA_SCREEN_HEIGHT) {
+            return ;
+        }
+
+        ppu_bitmap_clip_row(px >> 8, GBA_SCREEN_WIDTH, start, end, &first, &last);
+        if (first >= last) {
+            return ;
+        }
+
+        addr = GBA_SCREEN_WIDTH * rel_y + (px >> 8) + (first - (int32_t)start);
+
+        if (palette) {
+            uint8_t const *row;
+            uint16_t const *palram;
+            int32_t i;
+
+            row = gba->memory.vram + 0xA000 * gba->io.dispcnt.frame + addr;
+            palram = (uint16_t const *)gba->memory.palram;
+            for (i = first; i < last; ++i, ++row) {
+                layer->color[i] = palram[*row];
+                layer->flags[i] = *row ? LAYER_VISIBLE : 0;
+            }
+        } else {
+            ppu_bitmap_copy_row(gba, layer, addr * sizeof(union color), first, last);
+        }
+        return ;
+    }
+
+    for (x = start; x < end; ++x, px += pa, py += pc) {
         int32_t rel_x;
         int32_t rel_y;
 
@@ -54,45 +134,72 @@ ppu_render_background_bitmap(
 
             palette_idx = mem_vram_read8(gba, (GBA_SCREEN_WIDTH * rel_y + rel_x) + 0xA000 * gba->io.dispcnt.frame);
             if (palette_idx) {
-                c.raw = mem_palram_read16(gba, palette_idx * sizeof(union color));
-                c.visible = true;
-                c.idx = 2;
-                c.force_blend = false;
-                scanline->bg[x] = c;
+                layer->color[x] = mem_palram_read16(gba, palette_idx * sizeof(union color));
+                layer->flags[x] = LAYER_VISIBLE;
             }
         } else {
-            c.raw = mem_vram_read16(gba, (GBA_SCREEN_WIDTH * rel_y + rel_x) * sizeof(union color));
-            c.visible = true;
-            c.idx = 2;
-            c.force_blend = false;
-            scanline->bg[x] = c;
+            layer->color[x] = mem_vram_read16(gba, (GBA_SCREEN_WIDTH * rel_y + rel_x) * sizeof(union color));
+            layer->flags[x] = LAYER_VISIBLE;
         }
     }
 }
 
+/*
+** Render the pixels `start` to `end` (excluded) of the bitmap background of mode 5.
+*/
 void
 ppu_render_background_bitmap_small(
     struct gba const *gba,
-    struct scanline *scanline
+    struct scanline *scanline,
+    uint32_t start,
+    uint32_t end
 ) {
     int16_t pa;
     int16_t pc;
     int32_t px;
     int32_t py;
     uint32_t x;
-    struct rich_color c;
     struct io const *io;
+    struct layer *layer;
 
     io = &gba->io;
-    scanline->top_idx = 2;
-
-    px = gba->ppu.internal_px[0];
-    py = gba->ppu.internal_py[0];
+    layer = &scanline->bg[2];
+    memset(layer->flags, 0, sizeof(layer->flags));
 
     pa = (int16_t)io->bg_pa[0].raw;
     pc = (int16_t)io->bg_pc[0].raw;
 
-    for (x = 0; x < GBA_SCREEN_WIDTH; ++x, px += pa, py += pc) {
+    px = gba->ppu.internal_px[0] + pa * (int32_t)start;
+    py = gba->ppu.internal_py[0] + pc * (int32_t)start;
+
+    /*
+    ** Without any rotation or scaling, the scanline is a row of the bitmap that only
+    ** has to be clipped once.
+    */
+    if (pa == 0x100 && pc == 0) {
+        int32_t rel_y;
+        int32_t first;
+        int32_t last;
+
+        rel_y = py >> 8;
+        if (rel_y < 0 || rel_y >= 160) {
+            return ;
+        }
+
+        ppu_bitmap_clip_row(px >> 8, 160, start, end, &first, &last);
+        if (first < last) {
+            ppu_bitmap_copy_row(
+                gba,
+                layer,
+                0xA000 * gba->io.dispcnt.frame + (160 * rel_y + (px >> 8) + (first - (int32_t)start)) * sizeof(union color),
+                first,
+                last
+            );
+        }
+        return ;
+    }
+
+    for (x = start; x < end; ++x, px += pa, py += pc) {
         int32_t rel_x;
         int32_t rel_y;
 
@@ -107,10 +214,7 @@ ppu_render_background_bitmap_small(
             continue;
         }
 
-        c.raw = mem_vram_read16(gba, 0xA000 * gba->io.dispcnt.frame + (160 * rel_y + rel_x) * sizeof(union color) );
-        c.visible = true;
-        c.idx = 2;
-        c.force_blend = false;
-        scanline->bg[x] = c;
+        layer->color[x] = mem_vram_read16(gba, 0xA000 * gba->io.dispcnt.frame + (160 * rel_y + rel_x) * sizeof(union color) );
+        layer->flags[x] = LAYER_VISIBLE;
     }
 }
\ No newline at end of file
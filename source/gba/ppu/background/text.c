@@ -11,124 +11,231 @@
 #include "gba/ppu.h"
 
 /*
-** Render the bitmap background of given index.
+** The parameters of a text background that don't change for the whole scanline.
 */
-void
-ppu_render_background_text(
-    struct gba const *gba,
-    struct scanline *scanline,
-    uint32_t line,
-    uint32_t bg_idx
-) {
-    struct io const *io;
-    bool mosaic;
-    bool palette_type;
-    uint32_t bg_size;
+struct text_bg {
+    uint32_t size;
     uint32_t screen_addr;
     uint32_t chrs_addr;
-    uint32_t x;
-    int32_t rel_y;          // Y coord of the pixel within the bg
+    uint32_t hoffset;
+    uint32_t rel_y;         // Y coord of the scanline within the bg, wrapped to 0-511
+};
+
+/*
+** Read the entry of the tilemap covering the pixel at `rel_x` (wrapped to 0-511) on the
+** current scanline.
+*/
+static inline __attribute__((always_inline))
+union tile
+ppu_text_read_tile(
+    struct gba const *gba,
+    struct text_bg const *bg,
+    uint32_t rel_x
+) {
+    uint32_t tile_x;        // X coord of the tile in the tilemap
     uint32_t tile_y;        // Y coord of the tile in the tilemap
-    uint32_t chr_y;         // Y coord of the pixel we want to render within the tile
+    uint32_t screen_idx;
+    bool up_x;
     bool up_y;
+    union tile tile;
 
-    io = &gba->io;
-    scanline->top_idx = bg_idx;
+    tile_x = (rel_x / 8) % 32;
+    tile_y = (bg->rel_y / 8) % 32;
+    up_x = rel_x >= 256;
+    up_y = bg->rel_y >= 256;
 
-    /* Retrieve all those before so that we don't have to read them for each pixel. */
-    mosaic = io->bgcnt[bg_idx].mosaic;
-    bg_size = io->bgcnt[bg_idx].size;
-    palette_type = io->bgcnt[bg_idx].palette_type;
-    screen_addr = (uint32_t)io->bgcnt[bg_idx].screen_base * 0x800;
-    chrs_addr = (uint32_t)io->bgcnt[bg_idx].character_base * 0x4000;
-    
-    /*
-    ** Do all the maths for the Y coordinate first, since those do not change until the next scanline.
-    */
+    switch (bg->size) {
+        case 0b00: // 256x256 (32x32)
+            screen_idx = tile_y * 32 + tile_x;
+            break;
+        case 0b01: // 512x256 (64x32)
+            screen_idx = tile_y * 32 + tile_x + up_x * 1024;
+            break;
+        case 0b10: // 256x512 (32x64)
+            screen_idx = tile_y * 32 + tile_x + up_y * 1024;
+            break;
+        case 0b11: // 512x512 (64x64)
+        default:
+            screen_idx = tile_y * 32 + tile_x + up_x * 1024 + up_y * 2048;
+            break;
+    }
 
-    if (mosaic) {
-        rel_y = line / (io->mosaic.bg_vsize + 1) * (io->mosaic.bg_vsize + 1);
+    tile.raw = mem_vram_read16(gba, bg->screen_addr + screen_idx * sizeof(union tile));
+    return (tile);
+}
+
+/*
+** Return the palette indexes of the row of `tile` that is on the current scanline,
+** one byte per pixel, from left to right, before any horizontal flip.
+*/
+static inline __attribute__((always_inline))
+uint8_t const *
+ppu_text_tile_row(
+    struct gba const *gba,
+    struct text_bg const *bg,
+    union tile tile,
+    bool palette_type
+) {
+    uint32_t chr_vy;        // Y coord of the row we want to render within the tile
+    uint32_t addr;
+
+    chr_vy = (bg->rel_y % 8) ^ (tile.vflip * 0b111);
+
+    if (palette_type) { // 256 colors, 1 palette
+        addr = bg->chrs_addr + tile.number * 64 + chr_vy * 8;
+        return (&gba->memory.vram[addr & ((addr & 0x10000) ? VRAM_MASK_1 : VRAM_MASK_2)]);
+    } else { // 16 colors, 16 palettes
+        return (ppu_tile_4bpp(gba, bg->chrs_addr + tile.number * 32)[chr_vy]);
+    }
+}
+
+static inline __attribute__((always_inline))
+void
+ppu_text_put_pixel(
+    struct gba const *gba,
+    struct layer *layer,
+    uint32_t x,
+    uint32_t palette_base,
+    uint8_t palette_idx
+) {
+    if (palette_idx) {
+        layer->color[x] = mem_palram_read16(gba, (palette_base + palette_idx) * sizeof(union color));
+        layer->flags[x] = LAYER_VISIBLE;
     } else {
-        rel_y = line;
+        layer->flags[x] = 0;
     }
-    rel_y += io->bg_voffset[bg_idx].raw;
-    tile_y = (rel_y / 8);
-    up_y = tile_y & 0b100000;
-    tile_y %= 32;
-    chr_y = rel_y % 8;
-
-    /* Now iterate for each pixels of this scanline. */
-    for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
-        int32_t rel_x;          // X coord of the pixel within the bg
-        uint32_t tile_x;        // X coord of the tile in the tilemap
-        uint32_t chr_x;         // X coord of the pixel we want to render within the tile
-        uint32_t chr_vy;        // Y coord of the pixel we want to render within the tile
-        uint32_t screen_idx;
-        uint8_t palette_idx;
-        union tile tile;
-        bool up_x;
+}
 
-        if (mosaic) {
-            rel_x = x / (io->mosaic.bg_hsize + 1) * (io->mosaic.bg_hsize + 1);
-        } else {
-            rel_x = x;
-        }
+/*
+** Render the scanline one tile at a time: the tilemap entry and the row of the tile are
+** fetched once for the (up to) 8 pixels they cover.
+**
+** Depending on the horizontal scroll, the first and last tiles are only partially visible.
+*/
+static inline __attribute__((always_inline))
+void
+ppu_render_background_text_tiles(
+    struct gba const *gba,
+    struct text_bg const *bg,
+    struct layer *layer,
+    bool palette_type,
+    uint32_t start,
+    uint32_t end
+) {
+    uint32_t rel_x;
+    uint32_t x;
+
+    x = start;
+    rel_x = bg->hoffset + start;
+    while (x < end) {
+        uint8_t const *row;
+        union tile tile;
+        uint32_t palette_base;
+        uint32_t chr_x;         // X coord of the pixel we want to render within the tile
+        uint32_t flip;
+        uint32_t tile_end;
 
-        rel_x += io->bg_hoffset[bg_idx].raw;
+        tile = ppu_text_read_tile(gba, bg, rel_x % 512);
+        row = ppu_text_tile_row(gba, bg, tile, palette_type);
+        palette_base = palette_type ? 0 : tile.palette * 16;
+        flip = tile.hflip * 0b111;
 
-        tile_x = (rel_x / 8);
-        up_x = tile_x & 0b100000; 
-        tile_x %= 32;
         chr_x = rel_x % 8;
+        tile_end = min(end, x + 8 - chr_x);
 
-        switch (bg_size) {
-            case 0b00: // 256x256 (32x32)
-                screen_idx = tile_y * 32 + tile_x;
-                break;
-            case 0b01: // 512x256 (64x32)
-                screen_idx = tile_y * 32 + tile_x + up_x * 1024;
-                break;
-            case 0b10: // 256x512 (32x64)
-                screen_idx = tile_y * 32 + tile_x + up_y * 1024;
-                break;
-            case 0b11: // 512x512 (64x64)
-                screen_idx = tile_y * 32 + tile_x + up_x * 1024 + up_y * 2048;
-                break;
+        for (; x < tile_end; ++x, ++chr_x) {
+            ppu_text_put_pixel(gba, layer, x, palette_base, row[chr_x ^ flip]);
         }
 
-        tile.raw = mem_vram_read16(gba, screen_addr + screen_idx * sizeof(union tile));
-        chr_vy = chr_y ^ tile.vflip * 0b111;
-        chr_x ^= tile.hflip * 0b111;
+        rel_x = (rel_x & ~7u) + 8;
+    }
+}
 
-        if (palette_type) { // 256 colors, 1 palette
-            palette_idx = mem_vram_read8(gba, chrs_addr + tile.number * 64 + chr_vy * 8 + chr_x);
-        } else { // 16 colors, 16 palettes
+/*
+** Render the scanline one mosaic block at a time: only the first pixel of each block
+** is fetched, and then repeated for the whole block.
+*/
+static
+void
+ppu_render_background_text_mosaic(
+    struct gba const *gba,
+    struct text_bg const *bg,
+    struct layer *layer,
+    bool palette_type,
+    uint32_t start,
+    uint32_t end
+) {
+    uint32_t block_size;
+    uint32_t x;
 
-            /*
-            ** In this mode, each byte represents two pixels:
-            **   * The lower 4 bits define the color of the left pixel
-            **   * The upper 4 bits define the color of the right pixel
-            */
+    block_size = gba->io.mosaic.bg_hsize + 1;
 
-            palette_idx = mem_vram_read8(gba, chrs_addr + tile.number * 32 + chr_vy * 4 + (chr_x >> 1));
-            palette_idx >>= (chr_x % 2) * 4;
-            palette_idx &= 0xF;
-        }
+    for (x = start - start % block_size; x < end; x += block_size) {
+        uint8_t const *row;
+        union tile tile;
+        uint32_t rel_x;
+        uint32_t chr_x;
+        uint32_t block_end;
+        uint32_t i;
+
+        rel_x = (x + bg->hoffset) % 512;
+        tile = ppu_text_read_tile(gba, bg, rel_x);
+        row = ppu_text_tile_row(gba, bg, tile, palette_type);
+        chr_x = (rel_x % 8) ^ (tile.hflip * 0b111);
 
-        if (palette_idx) {
-            struct rich_color c;
-        
-            c.raw = mem_palram_read16(
-                gba,
-                (tile.palette * 16 * !palette_type + palette_idx) * sizeof(union color)
-            );
-        
-            c.visible = true;
-            c.idx = bg_idx;
-            c.force_blend = false;
-            scanline->bg[x] = c;
-        } else {
-            scanline->bg[x].visible = false;
+        ppu_text_put_pixel(gba, layer, x, palette_type ? 0 : tile.palette * 16, row[chr_x]);
+
+        block_end = min(GBA_SCREEN_WIDTH, x + block_size);
+        for (i = x + 1; i < block_end; ++i) {
+            layer->color[i] = layer->color[x];
+            layer->flags[i] = layer->flags[x];
         }
     }
-}
\ No newline at end of file
+}
+
+/*
+** Render the pixels `start` to `end` (excluded) of the text background of given index.
+*/
+void
+ppu_render_background_text(
+    struct gba const *gba,
+    struct scanline *scanline,
+    uint32_t line,
+    uint32_t bg_idx,
+    uint32_t start,
+    uint32_t end
+) {
+    struct io const *io;
+    struct layer *layer;
+    struct text_bg bg;
+    uint32_t rel_y;
+
+    io = &gba->io;
+    layer = &scanline->bg[bg_idx];
+
+    /* Retrieve all those before so that we don't have to read them for each pixel. */
+    bg.size = io->bgcnt[bg_idx].size;
+    bg.screen_addr = (uint32_t)io->bgcnt[bg_idx].screen_base * 0x800;
+    bg.chrs_addr = (uint32_t)io->bgcnt[bg_idx].character_base * 0x4000;
+    bg.hoffset = io->bg_hoffset[bg_idx].raw;
+
+    /*
+    ** Do all the maths for the Y coordinate first, since those do not change until the next scanline.
+    */
+
+    if (io->bgcnt[bg_idx].mosaic) {
+        rel_y = line / (io->mosaic.bg_vsize + 1) * (io->mosaic.bg_vsize + 1);
+    } else {
+        rel_y = line;
+    }
+    rel_y += io->bg_voffset[bg_idx].raw;
+    bg.rel_y = rel_y % 512;
+
+    if (io->bgcnt[bg_idx].mosaic) {
+        ppu_render_background_text_mosaic(gba, &bg, layer, io->bgcnt[bg_idx].palette_type, start, end);
+    } else if (io->bgcnt[bg_idx].palette_type) {
+        ppu_render_background_text_tiles(gba, &bg, layer, true, start, end);
+    } else {
+        ppu_render_background_text_tiles(gba, &bg, layer, false, start, end);
+    }
+}
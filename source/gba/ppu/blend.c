@@ -0,0 +1,608 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Color special effects (REG_BLDCNT), applied to whole runs of BGR555 colors.
+**
+** Each effect has a scalar implementation and, when the host supports it, a vectorized
+** one processing 8 (SSE2, NEON) or 16 (AVX2) pixels at once. All of them are bit-exact:
+** the 5-bit channels are unpacked in 16-bit lanes, where none of the intermediate
+** results can overflow (31 * 16 + 31 * 16 < 2^16).
+**
+** The best implementation is selected once, at runtime, by `ppu_blend_init()`.
+*/
+
+#include "gba/gba.h"
+#include "gba/ppu.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+# include <immintrin.h>
+# define WITH_BLEND_SSE2
+# define WITH_BLEND_AVX2
+#elif defined(__aarch64__)
+# include <arm_neon.h>
+# define WITH_BLEND_NEON
+#endif
+
+typedef void (*blend_alpha_fn)(uint16_t *, uint16_t const *, uint16_t const *, uint32_t, uint32_t, size_t);
+typedef void (*blend_fade_fn)(uint16_t *, uint16_t const *, uint32_t, size_t);
+
+static blend_alpha_fn blend_alpha;
+static blend_fade_fn blend_brighten;
+static blend_fade_fn blend_darken;
+static pthread_once_t blend_once = PTHREAD_ONCE_INIT;
+
+/*
+** Scalar implementation, also used for the pixels left once the vectorized loops are done.
+*/
+
+static inline
+uint16_t
+blend_alpha_px(
+    uint16_t top,
+    uint16_t bot,
+    uint32_t eva,
+    uint32_t evb
+) {
+    uint32_t r;
+    uint32_t g;
+    uint32_t b;
+
+    r = min(31, (((top >>  0) & 0x1F) * eva + ((bot >>  0) & 0x1F) * evb) >> 4);
+    g = min(31, (((top >>  5) & 0x1F) * eva + ((bot >>  5) & 0x1F) * evb) >> 4);
+    b = min(31, (((top >> 10) & 0x1F) * eva + ((bot >> 10) & 0x1F) * evb) >> 4);
+    return (r | (g << 5) | (b << 10));
+}
+
+static inline
+uint16_t
+blend_brighten_px(
+    uint16_t top,
+    uint32_t evy
+) {
+    uint32_t r;
+    uint32_t g;
+    uint32_t b;
+
+    r = (top >>  0) & 0x1F;
+    g = (top >>  5) & 0x1F;
+    b = (top >> 10) & 0x1F;
+    r += ((31 - r) * evy) >> 4;
+    g += ((31 - g) * evy) >> 4;
+    b += ((31 - b) * evy) >> 4;
+    return (r | (g << 5) | (b << 10));
+}
+
+static inline
+uint16_t
+blend_darken_px(
+    uint16_t top,
+    uint32_t evy
+) {
+    uint32_t r;
+    uint32_t g;
+    uint32_t b;
+
+    r = (top >>  0) & 0x1F;
+    g = (top >>  5) & 0x1F;
+    b = (top >> 10) & 0x1F;
+    r -= (r * evy) >> 4;
+    g -= (g * evy) >> 4;
+    b -= (b * evy) >> 4;
+    return (r | (g << 5) | (b << 10));
+}
+
+static
+void
+blend_alpha_scalar(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint16_t const *bot,
+    uint32_t eva,
+    uint32_t evb,
+    size_t len
+) {
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        dst[i] = blend_alpha_px(top[i], bot[i], eva, evb);
+    }
+}
+
+static
+void
+blend_brighten_scalar(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint32_t evy,
+    size_t len
+) {
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        dst[i] = blend_brighten_px(top[i], evy);
+    }
+}
+
+static
+void
+blend_darken_scalar(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint32_t evy,
+    size_t len
+) {
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        dst[i] = blend_darken_px(top[i], evy);
+    }
+}
+
+#ifdef WITH_BLEND_SSE2
+
+static
+void
+blend_alpha_sse2(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint16_t const *bot,
+    uint32_t eva,
+    uint32_t evb,
+    size_t len
+) {
+    __m128i mask;
+    __m128i max;
+    __m128i va;
+    __m128i vb;
+    size_t i;
+
+    mask = _mm_set1_epi16(0x1F);
+    max = _mm_set1_epi16(31);
+    va = _mm_set1_epi16(eva);
+    vb = _mm_set1_epi16(evb);
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m128i t;
+        __m128i b;
+        __m128i r;
+        __m128i g;
+        __m128i bl;
+
+        t = _mm_loadu_si128((__m128i const *)(top + i));
+        b = _mm_loadu_si128((__m128i const *)(bot + i));
+
+        r = _mm_add_epi16(_mm_mullo_epi16(_mm_and_si128(t, mask), va), _mm_mullo_epi16(_mm_and_si128(b, mask), vb));
+        g = _mm_add_epi16(
+            _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(t, 5), mask), va),
+            _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(b, 5), mask), vb)
+        );
+        bl = _mm_add_epi16(
+            _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(t, 10), mask), va),
+            _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi16(b, 10), mask), vb)
+        );
+
+        r = _mm_min_epi16(_mm_srli_epi16(r, 4), max);
+        g = _mm_min_epi16(_mm_srli_epi16(g, 4), max);
+        bl = _mm_min_epi16(_mm_srli_epi16(bl, 4), max);
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(r, _mm_or_si128(_mm_slli_epi16(g, 5), _mm_slli_epi16(bl, 10))));
+    }
+
+    blend_alpha_scalar(dst + i, top + i, bot + i, eva, evb, len - i);
+}
+
+static
+void
+blend_brighten_sse2(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint32_t evy,
+    size_t len
+) {
+    __m128i mask;
+    __m128i vy;
+    size_t i;
+
+    mask = _mm_set1_epi16(0x1F);
+    vy = _mm_set1_epi16(evy);
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m128i t;
+        __m128i r;
+        __m128i g;
+        __m128i b;
+
+        t = _mm_loadu_si128((__m128i const *)(top + i));
+        r = _mm_and_si128(t, mask);
+        g = _mm_and_si128(_mm_srli_epi16(t, 5), mask);
+        b = _mm_and_si128(_mm_srli_epi16(t, 10), mask);
+
+        /* 31 - x <=> x ^ 31 for 5-bit values */
+        r = _mm_add_epi16(r, _mm_srli_epi16(_mm_mullo_epi16(_mm_xor_si128(r, mask), vy), 4));
+        g = _mm_add_epi16(g, _mm_srli_epi16(_mm_mullo_epi16(_mm_xor_si128(g, mask), vy), 4));
+        b = _mm_add_epi16(b, _mm_srli_epi16(_mm_mullo_epi16(_mm_xor_si128(b, mask), vy), 4));
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(r, _mm_or_si128(_mm_slli_epi16(g, 5), _mm_slli_epi16(b, 10))));
+    }
+
+    blend_brighten_scalar(dst + i, top + i, evy, len - i);
+}
+
+static
+void
+blend_darken_sse2(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint32_t evy,
+    size_t len
+) {
+    __m128i mask;
+    __m128i vy;
+    size_t i;
+
+    mask = _mm_set1_epi16(0x1F);
+    vy = _mm_set1_epi16(evy);
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        __m128i t;
+        __m128i r;
+        __m128i g;
+        __m128i b;
+
+        t = _mm_loadu_si128((__m128i const *)(top + i));
+        r = _mm_and_si128(t, mask);
+        g = _mm_and_si128(_mm_srli_epi16(t, 5), mask);
+        b = _mm_and_si128(_mm_srli_epi16(t, 10), mask);
+
+        r = _mm_sub_epi16(r, _mm_srli_epi16(_mm_mullo_epi16(r, vy), 4));
+        g = _mm_sub_epi16(g, _mm_srli_epi16(_mm_mullo_epi16(g, vy), 4));
+        b = _mm_sub_epi16(b, _mm_srli_epi16(_mm_mullo_epi16(b, vy), 4));
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(r, _mm_or_si128(_mm_slli_epi16(g, 5), _mm_slli_epi16(b, 10))));
+    }
+
+    blend_darken_scalar(dst + i, top + i, evy, len - i);
+}
+
+#endif /* WITH_BLEND_SSE2 */
+
+#ifdef WITH_BLEND_AVX2
+
+static __attribute__((target("avx2")))
+void
+blend_alpha_avx2(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint16_t const *bot,
+    uint32_t eva,
+    uint32_t evb,
+    size_t len
+) {
+    __m256i mask;
+    __m256i max;
+    __m256i va;
+    __m256i vb;
+    size_t i;
+
+    mask = _mm256_set1_epi16(0x1F);
+    max = _mm256_set1_epi16(31);
+    va = _mm256_set1_epi16(eva);
+    vb = _mm256_set1_epi16(evb);
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m256i t;
+        __m256i b;
+        __m256i r;
+        __m256i g;
+        __m256i bl;
+
+        t = _mm256_loadu_si256((__m256i const *)(top + i));
+        b = _mm256_loadu_si256((__m256i const *)(bot + i));
+
+        r = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_and_si256(t, mask), va), _mm256_mullo_epi16(_mm256_and_si256(b, mask), vb));
+        g = _mm256_add_epi16(
+            _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi16(t, 5), mask), va),
+            _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi16(b, 5), mask), vb)
+        );
+        bl = _mm256_add_epi16(
+            _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi16(t, 10), mask), va),
+            _mm256_mullo_epi16(_mm256_and_si256(_mm256_srli_epi16(b, 10), mask), vb)
+        );
+
+        r = _mm256_min_epi16(_mm256_srli_epi16(r, 4), max);
+        g = _mm256_min_epi16(_mm256_srli_epi16(g, 4), max);
+        bl = _mm256_min_epi16(_mm256_srli_epi16(bl, 4), max);
+
+        _mm256_storeu_si256(
+            (__m256i *)(dst + i),
+            _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi16(g, 5), _mm256_slli_epi16(bl, 10)))
+        );
+    }
+
+    blend_alpha_sse2(dst + i, top + i, bot + i, eva, evb, len - i);
+}
+
+static __attribute__((target("avx2")))
+void
+blend_brighten_avx2(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint32_t evy,
+    size_t len
+) {
+    __m256i mask;
+    __m256i vy;
+    size_t i;
+
+    mask = _mm256_set1_epi16(0x1F);
+    vy = _mm256_set1_epi16(evy);
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m256i t;
+        __m256i r;
+        __m256i g;
+        __m256i b;
+
+        t = _mm256_loadu_si256((__m256i const *)(top + i));
+        r = _mm256_and_si256(t, mask);
+        g = _mm256_and_si256(_mm256_srli_epi16(t, 5), mask);
+        b = _mm256_and_si256(_mm256_srli_epi16(t, 10), mask);
+
+        r = _mm256_add_epi16(r, _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_xor_si256(r, mask), vy), 4));
+        g = _mm256_add_epi16(g, _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_xor_si256(g, mask), vy), 4));
+        b = _mm256_add_epi16(b, _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_xor_si256(b, mask), vy), 4));
+
+        _mm256_storeu_si256(
+            (__m256i *)(dst + i),
+            _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi16(g, 5), _mm256_slli_epi16(b, 10)))
+        );
+    }
+
+    blend_brighten_sse2(dst + i, top + i, evy, len - i);
+}
+
+static __attribute__((target("avx2")))
+void
+blend_darken_avx2(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint32_t evy,
+    size_t len
+) {
+    __m256i mask;
+    __m256i vy;
+    size_t i;
+
+    mask = _mm256_set1_epi16(0x1F);
+    vy = _mm256_set1_epi16(evy);
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m256i t;
+        __m256i r;
+        __m256i g;
+        __m256i b;
+
+        t = _mm256_loadu_si256((__m256i const *)(top + i));
+        r = _mm256_and_si256(t, mask);
+        g = _mm256_and_si256(_mm256_srli_epi16(t, 5), mask);
+        b = _mm256_and_si256(_mm256_srli_epi16(t, 10), mask);
+
+        r = _mm256_sub_epi16(r, _mm256_srli_epi16(_mm256_mullo_epi16(r, vy), 4));
+        g = _mm256_sub_epi16(g, _mm256_srli_epi16(_mm256_mullo_epi16(g, vy), 4));
+        b = _mm256_sub_epi16(b, _mm256_srli_epi16(_mm256_mullo_epi16(b, vy), 4));
+
+        _mm256_storeu_si256(
+            (__m256i *)(dst + i),
+            _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi16(g, 5), _mm256_slli_epi16(b, 10)))
+        );
+    }
+
+    blend_darken_sse2(dst + i, top + i, evy, len - i);
+}
+
+#endif /* WITH_BLEND_AVX2 */
+
+#ifdef WITH_BLEND_NEON
+
+static
+void
+blend_alpha_neon(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint16_t const *bot,
+    uint32_t eva,
+    uint32_t evb,
+    size_t len
+) {
+    uint16x8_t mask;
+    uint16x8_t max;
+    size_t i;
+
+    mask = vdupq_n_u16(0x1F);
+    max = vdupq_n_u16(31);
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        uint16x8_t t;
+        uint16x8_t b;
+        uint16x8_t r;
+        uint16x8_t g;
+        uint16x8_t bl;
+
+        t = vld1q_u16(top + i);
+        b = vld1q_u16(bot + i);
+
+        r = vmlaq_n_u16(vmulq_n_u16(vandq_u16(t, mask), eva), vandq_u16(b, mask), evb);
+        g = vmlaq_n_u16(vmulq_n_u16(vandq_u16(vshrq_n_u16(t, 5), mask), eva), vandq_u16(vshrq_n_u16(b, 5), mask), evb);
+        bl = vmlaq_n_u16(vmulq_n_u16(vandq_u16(vshrq_n_u16(t, 10), mask), eva), vandq_u16(vshrq_n_u16(b, 10), mask), evb);
+
+        r = vminq_u16(vshrq_n_u16(r, 4), max);
+        g = vminq_u16(vshrq_n_u16(g, 4), max);
+        bl = vminq_u16(vshrq_n_u16(bl, 4), max);
+
+        vst1q_u16(dst + i, vorrq_u16(r, vorrq_u16(vshlq_n_u16(g, 5), vshlq_n_u16(bl, 10))));
+    }
+
+    blend_alpha_scalar(dst + i, top + i, bot + i, eva, evb, len - i);
+}
+
+static
+void
+blend_brighten_neon(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint32_t evy,
+    size_t len
+) {
+    uint16x8_t mask;
+    size_t i;
+
+    mask = vdupq_n_u16(0x1F);
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        uint16x8_t t;
+        uint16x8_t r;
+        uint16x8_t g;
+        uint16x8_t b;
+
+        t = vld1q_u16(top + i);
+        r = vandq_u16(t, mask);
+        g = vandq_u16(vshrq_n_u16(t, 5), mask);
+        b = vandq_u16(vshrq_n_u16(t, 10), mask);
+
+        r = vaddq_u16(r, vshrq_n_u16(vmulq_n_u16(veorq_u16(r, mask), evy), 4));
+        g = vaddq_u16(g, vshrq_n_u16(vmulq_n_u16(veorq_u16(g, mask), evy), 4));
+        b = vaddq_u16(b, vshrq_n_u16(vmulq_n_u16(veorq_u16(b, mask), evy), 4));
+
+        vst1q_u16(dst + i, vorrq_u16(r, vorrq_u16(vshlq_n_u16(g, 5), vshlq_n_u16(b, 10))));
+    }
+
+    blend_brighten_scalar(dst + i, top + i, evy, len - i);
+}
+
+static
+void
+blend_darken_neon(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint32_t evy,
+    size_t len
+) {
+    uint16x8_t mask;
+    size_t i;
+
+    mask = vdupq_n_u16(0x1F);
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        uint16x8_t t;
+        uint16x8_t r;
+        uint16x8_t g;
+        uint16x8_t b;
+
+        t = vld1q_u16(top + i);
+        r = vandq_u16(t, mask);
+        g = vandq_u16(vshrq_n_u16(t, 5), mask);
+        b = vandq_u16(vshrq_n_u16(t, 10), mask);
+
+        r = vsubq_u16(r, vshrq_n_u16(vmulq_n_u16(r, evy), 4));
+        g = vsubq_u16(g, vshrq_n_u16(vmulq_n_u16(g, evy), 4));
+        b = vsubq_u16(b, vshrq_n_u16(vmulq_n_u16(b, evy), 4));
+
+        vst1q_u16(dst + i, vorrq_u16(r, vorrq_u16(vshlq_n_u16(g, 5), vshlq_n_u16(b, 10))));
+    }
+
+    blend_darken_scalar(dst + i, top + i, evy, len - i);
+}
+
+#endif /* WITH_BLEND_NEON */
+
+static
+void
+blend_select(
+    void
+) {
+    blend_alpha = blend_alpha_scalar;
+    blend_brighten = blend_brighten_scalar;
+    blend_darken = blend_darken_scalar;
+
+#ifdef WITH_BLEND_SSE2
+    blend_alpha = blend_alpha_sse2;
+    blend_brighten = blend_brighten_sse2;
+    blend_darken = blend_darken_sse2;
+#endif
+
+#ifdef WITH_BLEND_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        blend_alpha = blend_alpha_avx2;
+        blend_brighten = blend_brighten_avx2;
+        blend_darken = blend_darken_avx2;
+    }
+#endif
+
+#ifdef WITH_BLEND_NEON
+    blend_alpha = blend_alpha_neon;
+    blend_brighten = blend_brighten_neon;
+    blend_darken = blend_darken_neon;
+#endif
+}
+
+/*
+** Select the implementation of the color special effects best suited for the host.
+**
+** Can be called any number of times, from any thread.
+*/
+void
+ppu_blend_init(
+    void
+) {
+    pthread_once(&blend_once, blend_select);
+}
+
+/*
+** Blend `top` and `bot` with the coefficients `eva` and `evb` (0-16) and store the `len`
+** resulting colors in `dst`.
+*/
+void
+ppu_blend_alpha(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint16_t const *bot,
+    uint32_t eva,
+    uint32_t evb,
+    size_t len
+) {
+    blend_alpha(dst, top, bot, eva, evb, len);
+}
+
+/*
+** Brighten `top` with the coefficient `evy` (0-16) and store the `len` resulting colors in `dst`.
+*/
+void
+ppu_blend_brighten(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint32_t evy,
+    size_t len
+) {
+    blend_brighten(dst, top, evy, len);
+}
+
+/*
+** Darken `top` with the coefficient `evy` (0-16) and store the `len` resulting colors in `dst`.
+*/
+void
+ppu_blend_darken(
+    uint16_t *dst,
+    uint16_t const *top,
+    uint32_t evy,
+    size_t len
+) {
+    blend_darken(dst, top, evy, len);
+}
@@ -0,0 +1,102 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Conversion of the BGR555 colors of the GBA to the RGBA8888 colors of the framebuffer.
+**
+** There are only 32768 BGR555 colors, so both conversions (with and without color
+** correction) are done once for all of them by `ppu_color_init()`, and the PPU then
+** converts a pixel with a single lookup.
+*/
+
+#include <math.h>
+#include "gba/gba.h"
+#include "gba/ppu.h"
+
+static uint32_t color_luts[2][1 << 15];
+static pthread_once_t color_once = PTHREAD_ONCE_INIT;
+
+/*
+** Expand each 5-bit channel to 8 bits, copying the highest bits in the lowest ones.
+*/
+static
+uint32_t
+color_convert(
+    union color c
+) {
+    return (0xFF000000
+        | (((uint32_t)c.red   << 3 ) | (((uint32_t)c.red   >> 2) & 0b111)) << 0
+        | (((uint32_t)c.green << 3 ) | (((uint32_t)c.green >> 2) & 0b111)) << 8
+        | (((uint32_t)c.blue  << 3 ) | (((uint32_t)c.blue  >> 2) & 0b111)) << 16
+    );
+}
+
+/*
+** Convert the color while applying a color correction.
+**
+** NOTE: lcd_gamma is 4.0, out_gamma is 2.0.
+** Reference:
+**   - https://near.sh/articles/video/color-emulation
+*/
+static
+uint32_t
+color_convert_corrected(
+    union color c
+) {
+    float r;
+    float g;
+    float b;
+
+    r = c.red * c.red * c.red * c.red           / (31.0 * 31.0 * 31.0 * 31.0);  // <=> pow(c.red   / 31.0, lcd_gamma);
+    g = c.green * c.green * c.green * c.green   / (31.0 * 31.0 * 31.0 * 31.0);  // <=> pow(c.green / 31.0, lcd_gamma);
+    b = c.blue * c.blue * c.blue * c.blue       / (31.0 * 31.0 * 31.0 * 31.0);  // <=> pow(c.blue  / 31.0, lcd_gamma);
+
+    return (0xFF000000
+        | (uint32_t)(sqrt(            0.196 * g + 1.000 * r) * 213.0) << 0      // <=> pow(r, 1.0 / out_gamma);
+        | (uint32_t)(sqrt(0.118 * b + 0.902 * g + 0.039 * r) * 240.0) << 8      // <=> pow(g, 1.0 / out_gamma);
+        | (uint32_t)(sqrt(0.863 * b + 0.039 * g + 0.196 * r) * 232.0) << 16     // <=> pow(b, 1.0 / out_gamma);
+    );
+}
+
+static
+void
+color_build_luts(
+    void
+) {
+    uint32_t i;
+
+    for (i = 0; i < ARRAY_LEN(color_luts[0]); ++i) {
+        union color c;
+
+        c.raw = i;
+        color_luts[false][i] = color_convert(c);
+        color_luts[true][i] = color_convert_corrected(c);
+    }
+}
+
+/*
+** Fill the conversion tables. They are shared by all the instances and never change
+** afterwards, so this only does something the first time it is called.
+*/
+void
+ppu_color_init(
+    void
+) {
+    pthread_once(&color_once, color_build_luts);
+}
+
+/*
+** Return the table converting a BGR555 color (without its unused 16th bit) to RGBA8888.
+*/
+uint32_t const *
+ppu_color_lut(
+    bool color_correction
+) {
+    return (color_luts[color_correction]);
+}
@@ -21,8 +21,311 @@
 **  0110: 32 x 16        1110: Not used
 **  0111: 64 x 32        1111: Not used
 */
-int32_t sprite_size_x[16] = { 8, 16, 32, 64, 16, 32, 32, 64, 8, 8, 16, 32, 0, 0, 0, 0};
-int32_t sprite_size_y[16] = { 8, 16, 32, 64, 8, 8, 16, 32, 16, 32, 32, 64, 0, 0, 0, 0};
+int32_t const sprite_size_x[16] = { 8, 16, 32, 64, 16, 32, 32, 64, 8, 8, 16, 32, 0, 0, 0, 0};
+int32_t const sprite_size_y[16] = { 8, 16, 32, 64, 8, 8, 16, 32, 16, 32, 32, 64, 0, 0, 0, 0};
+
+/*
+** Decode OAM again if it was written since the last call, and sort the sprites in the
+** scanlines they cover.
+*/
+void
+ppu_sprite_cache_update(
+    struct gba *gba
+) {
+    struct sprite_cache *cache;
+    int32_t oam_idx;
+
+    if (!gba->memory.oam_dirty) {
+        return ;
+    }
+
+    gba->memory.oam_dirty = false;
+    cache = &gba->sprite_cache;
+    memset(cache->lines_len, 0, sizeof(cache->lines_len));
+    cache->tiles_4bpp_end = 0;
+
+    /*
+    ** Sprites are sorted from the last OAM entry to the first one, so that the ones with
+    ** the lowest index are drawn last, on top of the others.
+    */
+    for (oam_idx = 127; oam_idx >= 0; --oam_idx) {
+        struct sprite *sprite;
+        union oam_entry oam;
+        int32_t first;
+        int32_t last;
+        int32_t line;
+
+        sprite = &cache->sprites[oam_idx];
+
+        oam.raw[0] = mem_oam_read16(gba, (oam_idx * 4 + 0) * 2);
+        oam.raw[1] = mem_oam_read16(gba, (oam_idx * 4 + 1) * 2);
+        oam.raw[2] = mem_oam_read16(gba, (oam_idx * 4 + 2) * 2);
+
+        // Skip OAM entries that should'nt be displayed
+        if (!oam.affine && oam.virt_dsize) {
+            continue;
+        }
+
+        sprite->oam = oam;
+        sprite->win_oy = oam.coord_y;
+        sprite->win_ox = sign_extend9(oam.coord_x);
+        sprite->sprite_sx = sprite_size_x[(oam.size_high << 2) | oam.size_low];
+        sprite->sprite_sy = sprite_size_y[(oam.size_high << 2) | oam.size_low];
+        sprite->win_sx = sprite->sprite_sx;
+        sprite->win_sy = sprite->sprite_sy;
+
+        if (oam.affine && oam.virt_dsize) {
+            sprite->win_sx *= 2;
+            sprite->win_sy *= 2;
+        }
+
+        if (sprite->win_oy + sprite->win_sy >= 255) { // TODO Improve this for super large sprite
+            sprite->win_oy -= 256;
+        }
+
+        if (oam.affine) {
+            sprite->pa = (int16_t)mem_oam_read16(gba, oam.affine_data_idx * 32 + 0x6);
+            sprite->pb = (int16_t)mem_oam_read16(gba, oam.affine_data_idx * 32 + 0xe);
+            sprite->pc = (int16_t)mem_oam_read16(gba, oam.affine_data_idx * 32 + 0x16);
+            sprite->pd = (int16_t)mem_oam_read16(gba, oam.affine_data_idx * 32 + 0x1e);
+        } else { // Identity matrix
+            sprite->pa = 0x100;
+            sprite->pb = 0;
+            sprite->pc = 0;
+            sprite->pd = 0x100;
+        }
+
+        if (!oam.color_256) {
+            uint32_t start;
+
+            start = 0x10000 + oam.tile_idx * 32;
+            cache->tiles_4bpp_end = max(cache->tiles_4bpp_end, start + (sprite->sprite_sy / 8) * (sprite->sprite_sx / 8) * 32); // 1D
+            cache->tiles_4bpp_end = max(cache->tiles_4bpp_end, start + (sprite->sprite_sy / 8 - 1) * 32 * 32 + sprite->sprite_sx / 8 * 32); // 2D
+        }
+
+        first = max(sprite->win_oy, 0);
+        last = min(sprite->win_oy + sprite->win_sy, GBA_SCREEN_HEIGHT);
+        for (line = first; line < last; ++line) {
+            cache->lines[line][cache->lines_len[line]++] = oam_idx;
+        }
+    }
+}
+
+/*
+** Return the VRAM address of the tile at the given coordinates within the sprite.
+*/
+static inline __attribute__((always_inline))
+uint32_t
+ppu_sprite_tile_offset(
+    struct gba const *gba,
+    struct sprite const *sprite,
+    uint32_t tile_x,
+    uint32_t tile_y
+) {
+    uint32_t tile_offset;
+    uint32_t tile_size;     // In bytes
+
+    tile_size = sprite->oam.color_256 ? 64 : 32;
+    tile_offset = 0x10000 + sprite->oam.tile_idx * 32;
+
+    if (gba->io.dispcnt.obj_dim) { // 1 Dimension
+        tile_offset += tile_y * (sprite->sprite_sx / 8) * tile_size + tile_x * tile_size;
+    } else { // 2 Dimension
+        tile_offset += tile_y * 32 * 32 + tile_x * tile_size;
+    }
+    return (tile_offset);
+}
+
+static inline __attribute__((always_inline))
+void
+ppu_sprite_put_pixel(
+    struct gba const *gba,
+    struct scanline *scanline,
+    union oam_entry oam,
+    uint32_t x,
+    uint32_t palette_idx
+) {
+    struct layer *layer;
+
+    if (!palette_idx) {
+        return ;
+    }
+
+    if (oam.mode == OAM_MODE_WINDOW) {
+        scanline->win_obj_mask[x] = true;
+        return ;
+    }
+
+    // 16-bits palette mode
+    if (!oam.color_256) {
+        palette_idx += oam.palette_num * 16;
+    }
+
+    layer = &scanline->obj[oam.priority];
+    layer->color[x] = mem_palram_read16(gba, 0x200 + palette_idx * sizeof(union color));
+    layer->flags[x] = LAYER_VISIBLE | (oam.mode == OAM_MODE_BLEND ? LAYER_FORCE_BLEND : 0);
+}
+
+/*
+** Render the visible part of a sprite that is neither affine nor mosaic.
+**
+** Such a sprite is only clipped by the edges of the screen, so the visible part is
+** computed once and then drawn one tile at a time: the row of each tile is fetched once
+** for the (up to) 8 pixels it covers.
+*/
+static
+void
+ppu_render_sprite_regular(
+    struct gba const *gba,
+    struct scanline *scanline,
+    struct sprite const *sprite,
+    int32_t line
+) {
+    union oam_entry oam;
+    uint32_t chr_y;         // Y coordinate of the row within the tile (0-7)
+    uint32_t tile_y;        // Y coordinate of the tile within the sprite
+    uint32_t flip;
+    int32_t rel_x;          // X coordinate of the pixel within the sprite
+    int32_t rel_y;          // Y coordinate of the row within the sprite
+    int32_t end;
+
+    oam = sprite->oam;
+    rel_y = line - sprite->win_oy;
+    tile_y = rel_y / 8;
+    chr_y = rel_y % 8;
+
+    if (oam.vflip) {
+        tile_y = (sprite->sprite_sy / 8) - 1 - tile_y;
+        chr_y ^= 0b111;
+    }
+
+    flip = oam.hflip * 0b111;
+    rel_x = max(0, -sprite->win_ox);
+    end = min(sprite->sprite_sx, GBA_SCREEN_WIDTH - sprite->win_ox);
+
+    while (rel_x < end) {
+        uint8_t const *row;
+        uint32_t tile_offset;
+        uint32_t tile_x;    // X coordinate of the tile within the sprite
+        int32_t tile_end;
+
+        tile_x = rel_x / 8;
+        if (oam.hflip) {
+            tile_x = (sprite->sprite_sx / 8) - 1 - tile_x;
+        }
+
+        tile_offset = ppu_sprite_tile_offset(gba, sprite, tile_x, tile_y);
+
+        if (oam.color_256) { // 256 colors, 1 palette
+            tile_offset += chr_y * 8;
+            row = &gba->memory.vram[tile_offset & ((tile_offset & 0x10000) ? VRAM_MASK_1 : VRAM_MASK_2)];
+        } else { // 16 colors, 16 palettes
+            row = ppu_tile_4bpp(gba, tile_offset)[chr_y];
+        }
+
+        tile_end = min(end, (rel_x & ~7) + 8);
+        for (; rel_x < tile_end; ++rel_x) {
+            ppu_sprite_put_pixel(gba, scanline, oam, sprite->win_ox + rel_x, row[(rel_x % 8) ^ flip]);
+        }
+    }
+}
+
+/*
+** Render the visible part of an affine or mosaic sprite, one pixel at a time.
+**
+** Regular sprites with mosaic go through here too, with the identity matrix.
+** The pixels outside of the screen are clipped before the loop starts.
+*/
+static
+void
+ppu_render_sprite_affine(
+    struct gba const *gba,
+    struct scanline *scanline,
+    struct sprite const *sprite,
+    int32_t line
+) {
+    struct io const *io;
+    union oam_entry oam;
+    int32_t win_ox;
+    int32_t win_oy;
+    int32_t sprite_sx;
+    int32_t sprite_sy;
+    int32_t start;
+    int32_t end;
+    int32_t px;
+    int32_t py;
+    int32_t x;
+
+    io = &gba->io;
+    oam = sprite->oam;
+    win_ox = sprite->win_ox;
+    win_oy = sprite->win_oy;
+    sprite_sx = sprite->sprite_sx;
+    sprite_sy = sprite->sprite_sy;
+
+    start = max(0, -win_ox);
+    end = min(sprite->win_sx, GBA_SCREEN_WIDTH - win_ox);
+
+    /*
+    ** We pre-compute PX and PY for the first visible pixel and simply add the difference when X is increased.
+    */
+    px = sprite->pa * (start - sprite->win_sx / 2) + sprite->pb * ((line - win_oy) - (sprite->win_sy / 2)) + ((sprite_sx / 2) << 8);
+    py = sprite->pc * (start - sprite->win_sx / 2) + sprite->pd * ((line - win_oy) - (sprite->win_sy / 2)) + ((sprite_sy / 2) << 8);
+
+    for (x = start; x < end; ++x, px += sprite->pa, py += sprite->pc) {
+        uint32_t palette_idx;
+        int32_t rel_x;          // X coordinate of the pixel within the sprite
+        int32_t rel_y;          // Y coordinate of the pixel within the sprite
+        uint32_t chr_x;         // X coordinate of the pixel within the tile (0-7)
+        uint32_t chr_y;         // Y coordinate of the pixel within the tile (0-7)
+        uint32_t tile_x;        // X coordinate of the tile within the sprite
+        uint32_t tile_y;        // Y coordinate of the tile within the sprite
+        uint32_t tile_offset;   // Within VRAM
+
+        rel_x = (px >> 8);
+        rel_y = (py >> 8);
+
+        if (oam.mosaic) {
+            rel_x = (win_ox + rel_x) / (io->mosaic.obj_hsize + 1) * (io->mosaic.obj_hsize + 1) - win_ox;
+            rel_y = (win_oy + rel_y) / (io->mosaic.obj_vsize + 1) * (io->mosaic.obj_vsize + 1) - win_oy;
+        }
+
+        tile_x = rel_x / 8;
+        tile_y = rel_y / 8;
+        chr_x = rel_x % 8;
+        chr_y = rel_y % 8;
+
+        // Filter out pixels that are rotated/shred/scaled outside of their sprite.
+        if (
+               rel_x < 0 || tile_x >= sprite_sx / 8
+            || rel_y < 0 || tile_y >= sprite_sy / 8
+        ) {
+            continue;
+        }
+
+        // Flip horizontally
+        if (!oam.affine && oam.hflip) {
+            tile_x = (sprite_sx / 8) - 1 - tile_x;
+            chr_x ^= 0b111;
+        }
+
+        // Flip vertically
+        if (!oam.affine && oam.vflip) {
+            tile_y = (sprite_sy / 8) - 1 - tile_y;
+            chr_y ^= 0b111;
+        }
+
+        tile_offset = ppu_sprite_tile_offset(gba, sprite, tile_x, tile_y);
+
+        if (oam.color_256) { // 256 colors, 1 palette
+            palette_idx = mem_vram_read8(gba, tile_offset + chr_y * 8 + chr_x);
+        } else { // 16 colors, 16 palettes
+            palette_idx = ppu_tile_4bpp(gba, tile_offset)[chr_y][chr_x];
+        }
+
+        ppu_sprite_put_pixel(gba, scanline, oam, win_ox + x, palette_idx);
+    }
+}
 
 /*
 ** Pre-render all visible sprites.
@@ -33,176 +336,41 @@ ppu_prerender_oam(
     struct scanline *scanline,
     int32_t line
 ) {
+    struct sprite_cache const *cache;
     uint32_t bg_mode;
     struct io const *io;
-    int32_t oam_idx;
+    uint32_t i;
 
     io = &gba->io;
     bg_mode = io->dispcnt.bg_mode;
 
+    memset(scanline->win_obj_mask, 0, sizeof(scanline->win_obj_mask));
+
     if (!io->dispcnt.obj) {
         return ;
     }
 
-    for (oam_idx = 127; oam_idx >= 0; --oam_idx) {
-        union oam_entry oam;
-        int32_t x;
+    for (i = 0; i < 4; ++i) {
+        memset(scanline->obj[i].flags, 0, sizeof(scanline->obj[i].flags));
+    }
 
-        int32_t win_oy;
-        int32_t win_ox;
-        int32_t win_sx;
-        int32_t win_sy;
-        int32_t sprite_sx;
-        int32_t sprite_sy;
+    ppu_sprite_cache_update(gba);
+    cache = &gba->sprite_cache;
 
-        oam.raw[0] = mem_oam_read16(gba, (oam_idx * 4 + 0) * 2);
-        oam.raw[1] = mem_oam_read16(gba, (oam_idx * 4 + 1) * 2);
-        oam.raw[2] = mem_oam_read16(gba, (oam_idx * 4 + 2) * 2);
+    for (i = 0; i < cache->lines_len[line]; ++i) {
+        struct sprite const *sprite;
 
-        // Skip OAM entries that should'nt be displayed
-        if (!oam.affine && oam.virt_dsize) {
-            continue;
-        }
+        sprite = &cache->sprites[cache->lines[line][i]];
 
         // Skip OAM entries of index < 512 for BG mode 3-5
-        if (bg_mode >= 3 && bg_mode <= 5 && oam.tile_idx < 512) {
+        if (bg_mode >= 3 && bg_mode <= 5 && sprite->oam.tile_idx < 512) {
             continue;
         }
 
-        win_oy = oam.coord_y;
-        win_ox = sign_extend9(oam.coord_x);
-        sprite_sx = sprite_size_x[(oam.size_high << 2) | oam.size_low];
-        sprite_sy = sprite_size_y[(oam.size_high << 2) | oam.size_low];
-        win_sx = sprite_sx;
-        win_sy = sprite_sy;
-
-        if (oam.affine && oam.virt_dsize) {
-            win_sx *= 2;
-            win_sy *= 2;
-        }
-
-        if (win_oy + win_sy >= 255) { // TODO Improve this for super large sprite
-            win_oy -= 256;
-        }
-
-        if (line >= win_oy && line < win_oy + win_sy) {
-            int32_t px;
-            int32_t py;
-            int16_t pa;
-            int16_t pb;
-            int16_t pc;
-            int16_t pd;
-
-            if (oam.affine) {
-                pa = (int16_t)mem_oam_read16(gba, oam.affine_data_idx * 32 + 0x6);
-                pb = (int16_t)mem_oam_read16(gba, oam.affine_data_idx * 32 + 0xe);
-                pc = (int16_t)mem_oam_read16(gba, oam.affine_data_idx * 32 + 0x16);
-                pd = (int16_t)mem_oam_read16(gba, oam.affine_data_idx * 32 + 0x1e);
-            } else { // Identity matrix
-                pa = 0x100;
-                pb = 0;
-                pc = 0;
-                pd = 0x100;
-            }
-
-            /*
-            ** We pre-compute PX and PY for x=0 and simply add the difference when X is increased.
-            */
-            px = pa * -(win_sx / 2) + pb * ((line - win_oy) - (win_sy / 2)) + ((sprite_sx / 2) << 8);
-            py = pc * -(win_sx / 2) + pd * ((line - win_oy) - (win_sy / 2)) + ((sprite_sy / 2) << 8);
-
-            for (x = 0; x < win_sx; ++x, px += pa, py += pc) {
-                uint32_t palette_idx;
-                int32_t rel_x;          // X coordinate of the pixel within the sprite
-                int32_t rel_y;          // Y coordinate of the pixel within the sprite
-                uint32_t chr_x;         // X coordinate of the pixel within the tile (0-7)
-                uint32_t chr_y;         // Y coordinate of the pixel within the tile (0-7)
-                uint32_t tile_x;        // X coordinate of the tile within the sprite
-                uint32_t tile_y;        // Y coordinate of the tile within the sprite
-                uint32_t tile_offset;   // Within VRAM
-                uint32_t tile_size;     // In bytes
-
-                // Filter-out pixels that are outside of the screen
-                if (win_ox + x < 0 || win_ox + x >= GBA_SCREEN_WIDTH) {
-                    continue;
-                }
-
-                rel_x = (px >> 8);
-                rel_y = (py >> 8);
-
-                if (oam.mosaic) {
-                    rel_x = (win_ox + rel_x) / (io->mosaic.obj_hsize + 1) * (io->mosaic.obj_hsize + 1) - win_ox;
-                    rel_y = (win_oy + rel_y) / (io->mosaic.obj_vsize + 1) * (io->mosaic.obj_vsize + 1) - win_oy;
-                }
-
-                tile_x = rel_x / 8;
-                tile_y = rel_y / 8;
-                chr_x = rel_x % 8;
-                chr_y = rel_y % 8;
-
-                // Filter out pixels that are rotated/shred/scaled outside of their sprite.
-                if (
-                       rel_x < 0 || tile_x >= sprite_sx / 8
-                    || rel_y < 0 || tile_y >= sprite_sy / 8
-                ) {
-                    continue;
-                }
-
-                // Flip horizontally
-                if (!oam.affine && oam.hflip) {
-                    tile_x = (sprite_sx / 8) - 1 - tile_x;
-                    chr_x ^= 0b111;
-                }
-
-                // Flip vertically
-                if (!oam.affine && oam.vflip) {
-                    tile_y = (sprite_sy / 8) - 1 - tile_y;
-                    chr_y ^= 0b111;
-                }
-
-                tile_size = oam.color_256 ? 64 : 32;
-                tile_offset = 0x10000 + oam.tile_idx * 32;
-
-                if (io->dispcnt.obj_dim) { // 1 Dimension
-                    tile_offset += tile_y * (sprite_sx / 8) * tile_size + tile_x * tile_size;
-                } else { // 2 Dimension
-                    tile_offset += tile_y * 32 * 32 + tile_x * tile_size;
-                }
-
-                if (oam.color_256) { // 256 colors, 1 palette
-                    palette_idx = mem_vram_read8(gba, tile_offset + chr_y * 8 + chr_x);
-                } else { // 16 colors, 16 palettes
-
-                    /*
-                    ** In this mode, each byte represents two pixels:
-                    **   * The lower 4 bits define the color for the left pixel
-                    **   * The upper 4 bits define the color for the right pixel
-                    */
-
-                    palette_idx = mem_vram_read8(gba, tile_offset + chr_y * 4 + (chr_x >> 1));
-                    palette_idx >>= (chr_x % 2) * 4;
-                    palette_idx &= 0xF;
-                }
-
-                if (palette_idx) {
-                    if (oam.mode == OAM_MODE_WINDOW) {
-                        scanline->win_obj_mask[win_ox + x] = true;
-                    } else {
-                        struct rich_color c;
-
-                        // 16-bits palette mode
-                        if (!oam.color_256) {
-                            palette_idx += oam.palette_num * 16;
-                        }
-
-                        c.raw = mem_palram_read16(gba, 0x200 + palette_idx * sizeof(union color));
-                        c.visible = true;
-                        c.idx = 4;
-                        c.force_blend = (oam.mode == OAM_MODE_BLEND);
-                        scanline->oam[oam.priority][win_ox + x] = c;
-                    }
-                }
-            }
+        if (sprite->oam.affine || sprite->oam.mosaic) {
+            ppu_render_sprite_affine(gba, scanline, sprite, line);
+        } else {
+            ppu_render_sprite_regular(gba, scanline, sprite, line);
         }
     }
-}
\ No newline at end of file
+}
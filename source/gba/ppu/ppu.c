@@ -8,331 +8,426 @@
 \******************************************************************************/
 
 #include <string.h>
-#include <math.h>
 #include "gba/gba.h"
 #include "gba/ppu.h"
 
-static void ppu_merge_layer(struct gba const *gba, struct scanline *scanline, struct rich_color *layer);
+/*
+** The special effect to apply to a pixel, see `ppu_compose_scanline()`.
+*/
+enum merge_op {
+    MERGE_COPY = 0,
+    MERGE_ALPHA,
+    MERGE_BRIGHTEN,
+    MERGE_DARKEN,
+};
 
 /*
-** Initialize the content of the given `scanline` to a default, sane and working value.
+** Rebuild the list of layers to compose, from the frontmost to the backmost.
+**
+** Within a given priority, sprites are in front of the backgrounds, and backgrounds of
+** lower index are in front of those of higher index.
 */
-static
 void
-ppu_initialize_scanline(
-    struct gba const *gba,
-    struct scanline *scanline
+ppu_update_layer_order(
+    struct gba *gba
 ) {
-    struct rich_color backdrop;
-    uint32_t x;
+    struct io const *io;
+    uint32_t prio;
+    uint32_t idx;
+    uint32_t len;
+    uint32_t bgs;
 
-    memset(scanline, 0x00, sizeof(*scanline));
+    io = &gba->io;
 
-    backdrop.visible = true;
-    backdrop.idx = 5;
-    backdrop.raw = (gba->io.dispcnt.blank ? 0x7fff : mem_palram_read16(gba, PALRAM_START));
+    /* The backgrounds that exist in the current mode */
+    switch (io->dispcnt.bg_mode) {
+        case 0:     bgs = 0b1111; break;
+        case 1:     bgs = 0b0111; break;
+        case 2:     bgs = 0b1100; break;
+        case 3:
+        case 4:
+        case 5:     bgs = 0b0100; break;
+        default: {
+
+            /* Invalid modes only display the backdrop. */
+            gba->ppu.layers_len = 0;
+            return ;
+        };
+    }
 
-    for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
-        scanline->result[x] = backdrop;
+    bgs &= io->dispcnt.bg;
+
+    len = 0;
+    for (prio = 0; prio < 4; ++prio) {
+        if (io->dispcnt.obj) {
+            gba->ppu.layers[len++] = LAYER_OBJ + prio;
+        }
+
+        for (idx = 0; idx < 4; ++idx) {
+            if (bitfield_get(bgs, idx) && io->bgcnt[idx].priority == prio) {
+                gba->ppu.layers[len++] = idx;
+            }
+        }
     }
 
-    /*
-    ** The only layer that `ppu_merge_layer` will never merge is the backdrop layer so we force
-    ** it here instead (if that's useful).
-    */
+    gba->ppu.layers_len = len;
+}
 
-    if (gba->io.bldcnt.mode == BLEND_LIGHT || gba->io.bldcnt.mode == BLEND_DARK) {
-        scanline->top_idx = 5;
-        memcpy(scanline->bg, scanline->result, sizeof(scanline->bg));
-        memcpy(scanline->bot, scanline->result, sizeof(scanline->bot));
-        ppu_merge_layer(gba, scanline, scanline->bg);
-        scanline->top_idx = 0;
+/*
+** Render the pixels `start` to `end` (excluded) of the background of given index.
+*/
+static
+void
+ppu_render_background(
+    struct gba *gba,
+    struct scanline *scanline,
+    uint32_t y,
+    uint32_t bg_idx,
+    uint32_t start,
+    uint32_t end
+) {
+    switch (gba->io.dispcnt.bg_mode) {
+        case 0: {
+            ppu_render_background_text(gba, scanline, y, bg_idx, start, end);
+            break;
+        };
+        case 1: {
+            if (bg_idx == 2) {
+                ppu_render_background_affine(gba, scanline, y, bg_idx, start, end);
+            } else {
+                ppu_render_background_text(gba, scanline, y, bg_idx, start, end);
+            }
+            break;
+        };
+        case 2: {
+            ppu_render_background_affine(gba, scanline, y, bg_idx, start, end);
+            break;
+        };
+        case 3: {
+            ppu_render_background_bitmap(gba, scanline, false, start, end);
+            break;
+        };
+        case 4: {
+            ppu_render_background_bitmap(gba, scanline, true, start, end);
+            break;
+        };
+        case 5: {
+            if (y < 128) {
+                ppu_render_background_bitmap_small(gba, scanline, start, end);
+            } else {
+                memset(scanline->bg[bg_idx].flags, 0, sizeof(scanline->bg[bg_idx].flags));
+            }
+            break;
+        };
     }
 }
 
 /*
-** Merge the current layer with any previous ones (using alpha blending) as stated in REG_BLDCNT.
+** Find the two frontmost visible layers of each pixel, rendering the backgrounds on the way.
+**
+** The layers are walked from front to back. A pixel is resolved once all the layers
+** its color depends on are found: only the top one, unless it may be alpha-blended with
+** the one below. Each background is only rendered over the span of pixels that are
+** still unresolved, and not at all once they all are (eg. behind an opaque HUD).
+**
+** The sprites must have been pre-rendered already.
 */
 static
 void
-ppu_merge_layer(
-    struct gba const *gba,
+ppu_render_layers(
+    struct gba *gba,
     struct scanline *scanline,
-    struct rich_color *layer
+    uint32_t y
 ) {
-    uint32_t eva;
-    uint32_t evb;
-    uint32_t evy;
     struct io const *io;
+    bool resolved[GBA_SCREEN_WIDTH];
+    uint32_t unresolved;
+    uint32_t start;
+    uint32_t end;
+    uint32_t i;
     uint32_t x;
 
     io = &gba->io;
-    eva = min(16, io->bldalpha.top_coef);
-    evb = min(16, io->bldalpha.bot_coef);
-    evy = min(16, io->bldy.coef);
 
-    for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
-        bool bot_enabled;
-        struct rich_color topc;
-        struct rich_color botc;
-        uint32_t mode;
+    memset(scanline->top, LAYER_NONE, sizeof(scanline->top));
+    memset(scanline->bot, LAYER_NONE, sizeof(scanline->bot));
 
-        topc = layer[x];
-        botc = scanline->bot[x];
+    if (io->dispcnt.blank) {
+        return ;
+    }
 
-        /* Skip transparent pixels */
-        if (!topc.visible) {
-            continue;
+    if (io->dispcnt.win0 || io->dispcnt.win1 || io->dispcnt.winobj) {
+        for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
+            scanline->win_opts[x] = ppu_find_top_window(gba, scanline, x);
         }
+    } else {
+        memset(scanline->win_opts, 0x3F, sizeof(scanline->win_opts));
+    }
 
-        mode = gba->io.bldcnt.mode;
-        bot_enabled = bitfield_get(io->bldcnt.raw, botc.idx + 8);
+    memset(resolved, false, sizeof(resolved));
+    unresolved = GBA_SCREEN_WIDTH;
+    start = 0;
+    end = GBA_SCREEN_WIDTH;
 
-        /* Apply windowing, if any */
-        if (scanline->top_idx <= 4 && (io->dispcnt.win0 || io->dispcnt.win1 || io->dispcnt.winobj)) {
-            uint8_t win_opts;
+    for (i = 0; i < gba->ppu.layers_len && unresolved; ++i) {
+        struct layer const *layer;
+        uint32_t layer_idx;
+        uint32_t id;
+        bool alpha_top;
 
-            win_opts = ppu_find_top_window(gba, scanline, x);
+        layer_idx = gba->ppu.layers[i];
 
-            /* Hide pixels that belong to a layer that this window doesn't show. */
-            if (!bitfield_get(win_opts, scanline->top_idx)) {
-                continue;
-            }
-
-            /* Windows can disable blending */
-            if (!bitfield_get(win_opts, 5)) {
-                mode = BLEND_OFF;
-            }
+        if (layer_idx < LAYER_OBJ) {
+            id = layer_idx;
+            layer = &scanline->bg[layer_idx];
+            ppu_render_background(gba, scanline, y, layer_idx, start, end);
+        } else {
+            id = LAYER_OBJ;
+            layer = &scanline->obj[layer_idx - LAYER_OBJ];
         }
 
-        /* Sprite can force blending no matter what BLDCNT says */
-        if (topc.force_blend && bot_enabled) {
-            mode = BLEND_ALPHA;
-        }
+        /* Whether this layer, when on top, is alpha-blended with the one below (windows permitting). */
+        alpha_top = io->bldcnt.mode == BLEND_ALPHA && bitfield_get(io->bldcnt.raw, id);
 
-        scanline->bot[x] = layer[x];
+        for (x = start; x < end; ++x) {
+            if (resolved[x] || !(layer->flags[x] & LAYER_VISIBLE) || !bitfield_get(scanline->win_opts[x], id)) {
+                continue;
+            }
 
-        switch (mode) {
-            case BLEND_OFF: {
-                scanline->result[x] = topc;
-                break;
-            };
-            case BLEND_ALPHA: {
-                bool top_enabled;
+            if (scanline->top[x] == LAYER_NONE) {
+                scanline->top[x] = i;
 
                 /*
-                ** If both the top and bot layers are enabled, blend the colors.
-                ** Otherwise, the top layer takes priority.
+                ** Semi-transparent sprites may be blended even if BLDCNT and the windows
+                ** say otherwise, depending on the layer below.
                 */
-
-                top_enabled = bitfield_get(io->bldcnt.raw, scanline->top_idx) || topc.force_blend;
-                if (top_enabled && bot_enabled && botc.visible) {
-                    scanline->result[x].red = min(31, ((uint32_t)topc.red * eva + (uint32_t)botc.red * evb) >> 4);
-                    scanline->result[x].green = min(31, ((uint32_t)topc.green * eva + (uint32_t)botc.green * evb) >> 4);
-                    scanline->result[x].blue = min(31, ((uint32_t)topc.blue * eva + (uint32_t)botc.blue * evb) >> 4);
-                    scanline->result[x].visible = true;
-                    scanline->result[x].idx = scanline->top_idx;
-                } else {
-                    scanline->result[x] = topc;
-                }
-                break;
-            };
-            case BLEND_LIGHT: {
-                if (bitfield_get(io->bldcnt.raw, scanline->top_idx)) {
-                    scanline->result[x].red = topc.red + (((31 - topc.red) * evy) >> 4);
-                    scanline->result[x].green = topc.green + (((31 - topc.green) * evy) >> 4);
-                    scanline->result[x].blue = topc.blue + (((31 - topc.blue) * evy) >> 4);
-                    scanline->result[x].idx = topc.idx;
-                    scanline->result[x].visible = true;
-                } else {
-                    scanline->result[x] = topc;
+                if ((layer->flags[x] & LAYER_FORCE_BLEND) || (alpha_top && bitfield_get(scanline->win_opts[x], 5))) {
+                    continue;
                 }
-                break;
-            };
-            case BLEND_DARK: {
-                if (bitfield_get(io->bldcnt.raw, scanline->top_idx)) {
-                    scanline->result[x].red = topc.red - ((topc.red * evy) >> 4);
-                    scanline->result[x].green = topc.green - ((topc.green * evy) >> 4);
-                    scanline->result[x].blue = topc.blue - ((topc.blue * evy) >> 4);
-                    scanline->result[x].idx = topc.idx;
-                    scanline->result[x].visible = true;
-                } else {
-                    scanline->result[x] = topc;
-                }
-                break;
-            };
+            } else {
+                scanline->bot[x] = i;
+            }
+
+            resolved[x] = true;
+            --unresolved;
+        }
+
+        /* Shrink the span of pixels left to the unresolved ones */
+        while (start < end && resolved[start]) {
+            ++start;
+        }
+        while (end > start && resolved[end - 1]) {
+            --end;
         }
     }
 }
 
 /*
-** Render the current scanline and write the result in `gba->framebuffer`.
+** Compose the layers of the scanline and write the result in `scanline->result`.
+**
+** The special effect selected by REG_BLDCNT for each pixel depends on its two frontmost
+** layers, found by `ppu_render_layers()`. It is then applied once, using the vectorized
+** kernels of `blend.c` on the span of pixels that need it.
+**
+** When no other layer is under the top one, it is blended with the backdrop if
+** brightness effects are enabled, and with nothing otherwise.
 */
 static
 void
-ppu_render_scanline(
-    struct gba *gba,
+ppu_compose_scanline(
+    struct gba const *gba,
     struct scanline *scanline
 ) {
+    uint16_t top[GBA_SCREEN_WIDTH];
+    uint16_t bot[GBA_SCREEN_WIDTH];
+    uint16_t blended[GBA_SCREEN_WIDTH];
+    uint16_t faded[GBA_SCREEN_WIDTH];
+    uint8_t ops[GBA_SCREEN_WIDTH];
+    enum merge_op backdrop_op;
+    enum merge_op fade_op;
+    uint16_t backdrop;
+    uint32_t used;
+    uint32_t first;
+    uint32_t last;
+    uint32_t eva;
+    uint32_t evb;
+    uint32_t evy;
     struct io const *io;
-    int32_t prio;
-    uint32_t y;
+    uint32_t x;
 
     io = &gba->io;
-    y = gba->io.vcount.raw;
-    
-    switch (io->dispcnt.bg_mode) {
-        case 0: {
-            for (prio = 3; prio >= 0; --prio) {
-                int32_t bg_idx;
- 
-                for (bg_idx = 3; bg_idx >= 0; --bg_idx) {
-                    if (bitfield_get((uint8_t)io->dispcnt.bg, bg_idx) && io->bgcnt[bg_idx].priority == prio) {
-                        ppu_render_background_text(gba, scanline, y, bg_idx);
-                        ppu_merge_layer(gba, scanline, scanline->bg);
-                    }
-                }
-                scanline->top_idx = 4;
-                ppu_merge_layer(gba, scanline, scanline->oam[prio]);
-            }
-            break;
-        };
-        case 1: {
-            for (prio = 3; prio >= 0; --prio) {
-                int32_t bg_idx;
-
-                for (bg_idx = 2; bg_idx >= 0; --bg_idx) {
-                    if (bitfield_get((uint8_t)io->dispcnt.bg, bg_idx) && io->bgcnt[bg_idx].priority == prio) {
-                        if (bg_idx == 2) {
-                            memset(scanline->bg, 0x00, sizeof(scanline->bg));
-                            ppu_render_background_affine(gba, scanline, y, bg_idx);
-                        } else {
-                            ppu_render_background_text(gba, scanline, y, bg_idx);
-                        }
-                        ppu_merge_layer(gba, scanline, scanline->bg);
-                    }
-                }
-                scanline->top_idx = 4;
-                ppu_merge_layer(gba, scanline, scanline->oam[prio]);
-            }
-            break;
-        };
-        case 2: {
-            for (prio = 3; prio >= 0; --prio) {
-                int32_t bg_idx;
-
-                for (bg_idx = 3; bg_idx >= 2; --bg_idx) {
-                    if (bitfield_get((uint8_t)io->dispcnt.bg, bg_idx) && io->bgcnt[bg_idx].priority == prio) {
-                        memset(scanline->bg, 0x00, sizeof(scanline->bg));
-                        ppu_render_background_affine(gba, scanline, y, bg_idx);
-                        ppu_merge_layer(gba, scanline, scanline->bg);
-                    }
-                }
-                scanline->top_idx = 4;
-                ppu_merge_layer(gba, scanline, scanline->oam[prio]);
+    eva = min(16, io->bldalpha.top_coef);
+    evb = min(16, io->bldalpha.bot_coef);
+    evy = min(16, io->bldy.coef);
+
+    switch (io->bldcnt.mode) {
+        case BLEND_LIGHT:   fade_op = MERGE_BRIGHTEN; break;
+        case BLEND_DARK:    fade_op = MERGE_DARKEN; break;
+        default:            fade_op = MERGE_COPY; break;
+    }
+
+    backdrop = io->dispcnt.blank ? 0x7fff : mem_palram_read16(gba, PALRAM_START);
+    backdrop_op = bitfield_get(io->bldcnt.raw, LAYER_BACKDROP) ? fade_op : MERGE_COPY;
+
+    used = 0;
+    first = GBA_SCREEN_WIDTH;
+    last = 0;
+
+    for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
+        struct layer const *layer;
+        uint32_t top_flags;
+        uint32_t top_idx;
+        uint32_t bot_idx;
+        bool bot_visible;
+        bool bot_enabled;
+        enum merge_op op;
+        uint32_t mode;
+
+        if (scanline->top[x] == LAYER_NONE) {
+            top[x] = backdrop;
+            bot[x] = 0;
+            op = backdrop_op;
+        } else {
+            top_idx = gba->ppu.layers[scanline->top[x]];
+            layer = top_idx < LAYER_OBJ ? &scanline->bg[top_idx] : &scanline->obj[top_idx - LAYER_OBJ];
+            top[x] = layer->color[x];
+            top_flags = layer->flags[x];
+            top_idx = min(top_idx, LAYER_OBJ);
+
+            if (scanline->bot[x] != LAYER_NONE) {
+                bot_idx = gba->ppu.layers[scanline->bot[x]];
+                layer = bot_idx < LAYER_OBJ ? &scanline->bg[bot_idx] : &scanline->obj[bot_idx - LAYER_OBJ];
+                bot[x] = layer->color[x];
+                bot_idx = min(bot_idx, LAYER_OBJ);
+                bot_visible = true;
+            } else if (fade_op != MERGE_COPY) {
+                bot[x] = backdrop;
+                bot_idx = LAYER_BACKDROP;
+                bot_visible = true;
+            } else {
+                bot[x] = 0;
+                bot_idx = 0;
+                bot_visible = false;
             }
-            break;
-        };
-        case 3: {
-            for (prio = 3; prio >= 0; --prio) {
-                if (bitfield_get((uint8_t)io->dispcnt.bg, 2) && io->bgcnt[2].priority == prio) {
-                    memset(scanline->bg, 0x00, sizeof(scanline->bg));
-                    ppu_render_background_bitmap(gba, scanline, false);
-                    ppu_merge_layer(gba, scanline, scanline->bg);
-                }
-                scanline->top_idx = 4;
-                ppu_merge_layer(gba, scanline, scanline->oam[prio]);
+
+            mode = io->bldcnt.mode;
+            bot_enabled = bitfield_get(io->bldcnt.raw, bot_idx + 8);
+
+            /* Windows can disable blending */
+            if (!bitfield_get(scanline->win_opts[x], 5)) {
+                mode = BLEND_OFF;
             }
-            break;
-        };
-        case 4: {
-            for (prio = 3; prio >= 0; --prio) {
-                if (bitfield_get((uint8_t)io->dispcnt.bg, 2) && io->bgcnt[2].priority == prio) {
-                    memset(scanline->bg, 0x00, sizeof(scanline->bg));
-                    ppu_render_background_bitmap(gba, scanline, true);
-                    ppu_merge_layer(gba, scanline, scanline->bg);
-                }
-                scanline->top_idx = 4;
-                ppu_merge_layer(gba, scanline, scanline->oam[prio]);
+
+            /* Sprite can force blending no matter what BLDCNT says */
+            if ((top_flags & LAYER_FORCE_BLEND) && bot_enabled) {
+                mode = BLEND_ALPHA;
             }
-            break;
-        };
-        case 5: {
-            for (prio = 3; prio >= 0; --prio) {
-                if (bitfield_get((uint8_t)io->dispcnt.bg, 2) && io->bgcnt[2].priority == prio && y < 128) {
-                    memset(scanline->bg, 0x00, sizeof(scanline->bg));
-                    ppu_render_background_bitmap_small(gba, scanline);
-                    ppu_merge_layer(gba, scanline, scanline->bg);
-                }
-                scanline->top_idx = 4;
-                ppu_merge_layer(gba, scanline, scanline->oam[prio]);
+
+            switch (mode) {
+                case BLEND_ALPHA: {
+                    bool top_enabled;
+
+                    /*
+                    ** If both the top and bot layers are enabled, blend the colors.
+                    ** Otherwise, the top layer takes priority.
+                    */
+
+                    top_enabled = bitfield_get(io->bldcnt.raw, top_idx) || (top_flags & LAYER_FORCE_BLEND);
+                    op = (top_enabled && bot_enabled && bot_visible) ? MERGE_ALPHA : MERGE_COPY;
+                    break;
+                };
+                case BLEND_LIGHT:
+                case BLEND_DARK: {
+                    op = bitfield_get(io->bldcnt.raw, top_idx) ? fade_op : MERGE_COPY;
+                    break;
+                };
+                case BLEND_OFF:
+                default: {
+                    op = MERGE_COPY;
+                    break;
+                };
             }
-            break;
-        };
+        }
+
+        ops[x] = op;
+        scanline->result[x] = top[x];
+
+        if (op != MERGE_COPY) {
+            used |= 1 << op;
+            first = min(first, x);
+            last = x;
+        }
+    }
+
+    if (!used) {
+        return ;
+    }
+
+    if (used & (1 << MERGE_ALPHA)) {
+        ppu_blend_alpha(blended + first, top + first, bot + first, eva, evb, last - first + 1);
+    }
+
+    /* Only one of those two can be used, depending on REG_BLDCNT. */
+    if (used & (1 << MERGE_BRIGHTEN)) {
+        ppu_blend_brighten(faded + first, top + first, evy, last - first + 1);
+    } else if (used & (1 << MERGE_DARKEN)) {
+        ppu_blend_darken(faded + first, top + first, evy, last - first + 1);
+    }
+
+    for (x = first; x <= last; ++x) {
+        switch (ops[x]) {
+            case MERGE_ALPHA:       scanline->result[x] = blended[x]; break;
+            case MERGE_BRIGHTEN:
+            case MERGE_DARKEN:      scanline->result[x] = faded[x]; break;
+            default:                break;
+        }
     }
 }
 
 /*
-** Compose the content of the framebuffer based on the content of `scanline->result` and/or the backdrop color.
+** Convert the content of `scanline->result` to RGBA8888 and copy it to `dst`.
 */
 static
 void
 ppu_draw_scanline(
-    struct gba *gba,
-    struct scanline const *scanline
+    struct gba const *gba,
+    struct scanline const *scanline,
+    uint32_t *dst
 ) {
+    uint32_t const *lut;
     uint32_t x;
-    uint32_t y;
 
-    y = gba->io.vcount.raw;
+    lut = ppu_color_lut(gba->color_correction);
     for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
-        struct rich_color c;
-
-        c = scanline->result[x];
-        gba->framebuffer[GBA_SCREEN_WIDTH * y + x] = 0xFF000000
-            | (((uint32_t)c.red   << 3 ) | (((uint32_t)c.red   >> 2) & 0b111)) << 0
-            | (((uint32_t)c.green << 3 ) | (((uint32_t)c.green >> 2) & 0b111)) << 8
-            | (((uint32_t)c.blue  << 3 ) | (((uint32_t)c.blue  >> 2) & 0b111)) << 16
-        ;
+        dst[x] = lut[scanline->result[x] & 0x7FFF];
     }
 }
 
 /*
-** Compose the content of the framebuffer based on the content of `scanline->result` and/or the backdrop color.
-** This algorithm applies a color correction.
+** Render the current scanline in the matching row of `framebuffer`.
 **
-** NOTE: lcd_gamma is 4.0, out_gamma is 2.0.
-** Reference:
-**   - https://near.sh/articles/video/color-emulation
+** Called either when the scanline enters HBlank, or later by the PPU worker, in which
+** case `gba` is the worker's copy of the state at that time.
 */
-static
 void
-ppu_draw_scanline_color_correction(
+ppu_render_scanline(
     struct gba *gba,
-    struct scanline const *scanline
+    uint32_t *framebuffer
 ) {
-    uint32_t x;
+    struct scanline scanline;
     uint32_t y;
 
     y = gba->io.vcount.raw;
-    for (x = 0; x < GBA_SCREEN_WIDTH; ++x) {
-        struct rich_color c;
-        float r;
-        float g;
-        float b;
-
-        c = scanline->result[x];
-
-        r = c.red * c.red * c.red * c.red           / (31.0 * 31.0 * 31.0 * 31.0);  // <=> pow(c.red   / 31.0, lcd_gamma);
-        g = c.green * c.green * c.green * c.green   / (31.0 * 31.0 * 31.0 * 31.0);  // <=> pow(c.green / 31.0, lcd_gamma);
-        b = c.blue * c.blue * c.blue * c.blue       / (31.0 * 31.0 * 31.0 * 31.0);  // <=> pow(c.blue  / 31.0, lcd_gamma);
-
-        gba->framebuffer[GBA_SCREEN_WIDTH * y + x] = 0xFF000000
-            | (uint32_t)(sqrt(            0.196 * g + 1.000 * r) * 213.0) << 0      // <=> pow(r, 1.0 / out_gamma);
-            | (uint32_t)(sqrt(0.118 * b + 0.902 * g + 0.039 * r) * 240.0) << 8      // <=> pow(g, 1.0 / out_gamma);
-            | (uint32_t)(sqrt(0.863 * b + 0.039 * g + 0.196 * r) * 232.0) << 16     // <=> pow(b, 1.0 / out_gamma);
-        ;
+
+    if (!gba->io.dispcnt.blank) {
+        ppu_tile_cache_update(gba);
+        ppu_window_build_masks(gba, y);
+        ppu_prerender_oam(gba, &scanline, y);
     }
+
+    ppu_render_layers(gba, &scanline, y);
+    ppu_compose_scanline(gba, &scanline);
+    ppu_draw_scanline(gba, &scanline, framebuffer + GBA_SCREEN_WIDTH * y);
 }
 
 /*
@@ -362,6 +457,10 @@ ppu_hdraw(
         **
         ** Doing it now will avoid tearing.
         */
+        if (gba->ppu_worker) {
+            ppu_worker_sync(gba);
+        }
+
         pthread_mutex_lock(&gba->framebuffer_frontend_mutex);
         memcpy(gba->framebuffer_frontend, gba->framebuffer, sizeof(gba->framebuffer));
         pthread_mutex_unlock(&gba->framebuffer_frontend_mutex);
@@ -374,7 +473,7 @@ ppu_hdraw(
     /* Trigger the VBLANK IRQ & DMA transfer */
     if (io->vcount.raw == GBA_SCREEN_HEIGHT) {
         if (io->dispstat.vblank_irq) {
-            gba->io.int_flag.vblank = true;
+            core_trigger_irq(gba, IRQ_VBLANK);
         }
         mem_schedule_dma_transfers(gba, DMA_TIMING_VBLANK);
         ppu_reload_affine_internal_registers(gba, 0);
@@ -383,7 +482,7 @@ ppu_hdraw(
 
     /* Trigger the VCOUNT IRQ */
     if (io->dispstat.vcount_eq && io->dispstat.vcount_irq) {
-        gba->io.int_flag.vcounter = true;
+        core_trigger_irq(gba, IRQ_VCOUNTER);
     }
 }
 
@@ -402,20 +501,10 @@ ppu_hblank(
     io = &gba->io;
 
     if (io->vcount.raw < GBA_SCREEN_HEIGHT) {
-        struct scanline scanline;
-
-        ppu_initialize_scanline(gba, &scanline);
-        
-        if (!gba->io.dispcnt.blank) {
-            ppu_window_build_masks(gba, io->vcount.raw);
-            ppu_prerender_oam(gba, &scanline, io->vcount.raw);
-            ppu_render_scanline(gba, &scanline);
-        }
-        
-        if (gba->color_correction) {
-            ppu_draw_scanline_color_correction(gba, &scanline);
+        if (gba->ppu_worker) {
+            ppu_worker_queue_line(gba);
         } else {
-            ppu_draw_scanline(gba, &scanline);
+            ppu_render_scanline(gba, gba->framebuffer);
         }
 
         ppu_step_affine_internal_registers(gba);
@@ -428,7 +517,7 @@ ppu_hblank(
     */
 
     if (io->dispstat.hblank_irq) {
-        gba->io.int_flag.hblank = true;
+        core_trigger_irq(gba, IRQ_HBLANK);
     }
 
     if (io->vcount.raw < GBA_SCREEN_HEIGHT) {
@@ -447,6 +536,11 @@ void
 ppu_init(
     struct gba *gba
 ) {
+    ppu_blend_init();
+    ppu_color_init();
+    ppu_update_layer_order(gba);
+    ppu_worker_reload(gba);
+
     // HDraw
     sched_add_event(
         gba,
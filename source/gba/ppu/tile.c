@@ -0,0 +1,74 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+#include "gba/gba.h"
+#include "gba/ppu.h"
+
+/*
+** Decode the 32-byte block of VRAM `src` as a 4bpp tile.
+**
+** In this mode, each byte represents two pixels:
+**   * The lower 4 bits define the color of the left pixel
+**   * The upper 4 bits define the color of the right pixel
+*/
+static
+void
+ppu_tile_decode_4bpp(
+    uint8_t *dst,
+    uint8_t const *src
+) {
+    uint32_t i;
+
+    for (i = 0; i < 32; ++i) {
+        dst[i * 2 + 0] = src[i] & 0xF;
+        dst[i * 2 + 1] = src[i] >> 4;
+    }
+}
+
+/*
+** Decode again all the blocks of VRAM written since the last call.
+**
+** Most scanlines don't follow any write to VRAM, in which case this is only a
+** scan of `memory.vram_dirty`.
+**
+** In the bitmap modes (3-5), the backgrounds aren't made of tiles and only the upper half
+** of the sprite tiles (0x14000 onwards) can be displayed. The rest of VRAM is a framebuffer
+** that games may rewrite every frame, so its blocks are left dirty and only decoded once
+** a tiled mode is back, or once a sprite's tiles wrap around the end of VRAM.
+*/
+void
+ppu_tile_cache_update(
+    struct gba *gba
+) {
+    uint32_t i;
+
+    i = 0;
+    if (gba->io.dispcnt.bg_mode >= 3 && gba->io.dispcnt.bg_mode <= 5) {
+        ppu_sprite_cache_update(gba);
+        if (gba->sprite_cache.tiles_4bpp_end <= VRAM_SIZE) {
+            i = 0x14000 / 32 / 64;
+        }
+    }
+
+    for (; i < ARRAY_LEN(gba->memory.vram_dirty); ++i) {
+        uint64_t dirty;
+
+        dirty = gba->memory.vram_dirty[i];
+        gba->memory.vram_dirty[i] = 0;
+
+        while (dirty) {
+            uint32_t block;
+
+            block = i * 64 + __builtin_ctzll(dirty);
+            dirty &= dirty - 1;
+
+            ppu_tile_decode_4bpp(&gba->tile_cache.tiles[block][0][0], gba->memory.vram + block * 32);
+        }
+    }
+}
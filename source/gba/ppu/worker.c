@@ -0,0 +1,339 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Rendering of the scanlines on a dedicated thread, see `struct ppu_worker`.
+**
+** The scanlines are rendered in order, from exactly the state the emulated system was in
+** when they entered HBlank, so the output is the same as if they were rendered by
+** `ppu_hblank()` itself.
+*/
+
+#include <string.h>
+#include "gba/gba.h"
+#include "gba/ppu.h"
+
+/*
+** Apply the logged writes up to `end` (excluded) to the worker's copy.
+**
+** Must only be called by the thread that currently owns `view`: the worker itself, or
+** the emulation thread while the worker is idle.
+*/
+static
+void
+ppu_worker_apply_writes(
+    struct ppu_worker *worker,
+    uint64_t end
+) {
+    struct gba *view;
+    uint64_t i;
+
+    view = worker->view;
+    for (i = atomic_load_explicit(&worker->writes_head, memory_order_relaxed); i < end; ++i) {
+        struct ppu_write const *write;
+        uint8_t *dst;
+
+        write = &worker->writes[i % PPU_WRITES_LEN];
+        switch (write->region) {
+            case PALRAM_REGION: {
+                dst = view->memory.palram + write->offset;
+                break;
+            };
+            case VRAM_REGION: {
+                dst = view->memory.vram + write->offset;
+                mem_vram_mark_dirty(view, write->offset);
+                break;
+            };
+            case OAM_REGION:
+            default: {
+                dst = view->memory.oam + write->offset;
+                view->memory.oam_dirty = true;
+                break;
+            };
+        }
+
+        switch (write->size) {
+            case 1:     *(uint8_t *)dst = (uint8_t)write->value; break;
+            case 2:     *(uint16_t *)dst = (uint16_t)write->value; break;
+            case 4:     *(uint32_t *)dst = write->value; break;
+        }
+    }
+
+    atomic_store_explicit(&worker->writes_head, end, memory_order_release);
+}
+
+/*
+** Sleep until a scanline is queued after the `done` first ones.
+**
+** Return false if the worker must stop instead.
+*/
+static
+bool
+ppu_worker_wait_line(
+    struct ppu_worker *worker,
+    uint64_t done
+) {
+    bool exit;
+
+    pthread_mutex_lock(&worker->lock);
+
+    /*
+    ** Announce we are about to sleep before checking one last time for a new scanline.
+    ** `ppu_worker_queue_line()` does the opposite, so either we see its scanline, or it
+    ** sees we are sleeping and wakes us up.
+    */
+    atomic_store(&worker->worker_sleeping, true);
+    while (!worker->exit && atomic_load(&worker->lines_queued) == done) {
+        pthread_cond_wait(&worker->wake, &worker->lock);
+    }
+    atomic_store_explicit(&worker->worker_sleeping, false, memory_order_relaxed);
+
+    exit = worker->exit && atomic_load(&worker->lines_queued) == done;
+    pthread_mutex_unlock(&worker->lock);
+
+    return (!exit);
+}
+
+static
+void *
+ppu_worker_main(
+    void *raw_worker
+) {
+    struct ppu_worker *worker;
+
+    worker = raw_worker;
+
+    while (true) {
+        struct ppu_line const *line;
+        struct gba *view;
+        uint64_t done;
+
+        done = atomic_load_explicit(&worker->lines_done, memory_order_relaxed);
+        if (
+               atomic_load_explicit(&worker->lines_queued, memory_order_acquire) == done
+            && !ppu_worker_wait_line(worker, done)
+        ) {
+            break;
+        }
+
+        line = &worker->lines[done % GBA_SCREEN_HEIGHT];
+        view = worker->view;
+        ppu_worker_apply_writes(worker, line->writes_end);
+        view->io = line->io;
+        memcpy(view->ppu.internal_px, line->internal_px, sizeof(view->ppu.internal_px));
+        memcpy(view->ppu.internal_py, line->internal_py, sizeof(view->ppu.internal_py));
+        memcpy(view->ppu.layers, line->layers, sizeof(view->ppu.layers));
+        view->ppu.layers_len = line->layers_len;
+        view->color_correction = line->color_correction;
+
+        ppu_render_scanline(view, worker->gba->framebuffer);
+
+        // See `ppu_worker_wait()`.
+        atomic_store(&worker->lines_done, done + 1);
+        if (atomic_load(&worker->emulation_waiting)) {
+            pthread_mutex_lock(&worker->lock);
+            pthread_cond_signal(&worker->done);
+            pthread_mutex_unlock(&worker->lock);
+        }
+    }
+
+    return (NULL);
+}
+
+/*
+** Wait until the worker rendered the `target` first scanlines.
+*/
+static
+void
+ppu_worker_wait(
+    struct ppu_worker *worker,
+    uint64_t target
+) {
+    if (atomic_load_explicit(&worker->lines_done, memory_order_acquire) >= target) {
+        return ;
+    }
+
+    pthread_mutex_lock(&worker->lock);
+
+    // Same as `ppu_worker_wait_line()`, the other way around.
+    atomic_store(&worker->emulation_waiting, true);
+    while (atomic_load(&worker->lines_done) < target) {
+        pthread_cond_wait(&worker->done, &worker->lock);
+    }
+    atomic_store_explicit(&worker->emulation_waiting, false, memory_order_relaxed);
+
+    pthread_mutex_unlock(&worker->lock);
+}
+
+/*
+** Start a worker rendering the scanlines of `gba`, if there isn't one already.
+**
+** While it runs, the caches of the PPU of `gba` itself are left outdated: only the
+** worker's copy is kept up to date.
+*/
+void
+ppu_worker_start(
+    struct gba *gba
+) {
+    struct ppu_worker *worker;
+
+    if (gba->ppu_worker) {
+        return ;
+    }
+
+    worker = calloc(1, sizeof(*worker));
+    hs_assert(worker);
+
+    worker->view = calloc(1, sizeof(*worker->view));
+    hs_assert(worker->view);
+
+    worker->gba = gba;
+    worker->reload = true;
+    atomic_init(&worker->lines_queued, 0);
+    atomic_init(&worker->lines_done, 0);
+    atomic_init(&worker->worker_sleeping, false);
+    atomic_init(&worker->emulation_waiting, false);
+    atomic_init(&worker->writes_head, 0);
+    pthread_mutex_init(&worker->lock, NULL);
+    pthread_cond_init(&worker->wake, NULL);
+    pthread_cond_init(&worker->done, NULL);
+
+    hs_assert(!pthread_create(&worker->thread, NULL, ppu_worker_main, worker));
+
+    gba->ppu_worker = worker;
+}
+
+/*
+** Stop the worker once it rendered all the queued scanlines, and release it.
+**
+** The scanlines are then rendered by `ppu_hblank()` again, from caches that have to be
+** rebuilt.
+*/
+void
+ppu_worker_stop(
+    struct gba *gba
+) {
+    struct ppu_worker *worker;
+
+    worker = gba->ppu_worker;
+    if (!worker) {
+        return ;
+    }
+
+    pthread_mutex_lock(&worker->lock);
+    worker->exit = true;
+    pthread_cond_signal(&worker->wake);
+    pthread_mutex_unlock(&worker->lock);
+
+    pthread_join(worker->thread, NULL);
+
+    pthread_cond_destroy(&worker->done);
+    pthread_cond_destroy(&worker->wake);
+    pthread_mutex_destroy(&worker->lock);
+    free(worker->view);
+    free(worker);
+
+    gba->ppu_worker = NULL;
+
+    memset(gba->memory.vram_dirty, 0xFF, sizeof(gba->memory.vram_dirty));
+    gba->memory.oam_dirty = true;
+}
+
+/*
+** Wait until the worker rendered all the queued scanlines.
+*/
+void
+ppu_worker_sync(
+    struct gba *gba
+) {
+    struct ppu_worker *worker;
+
+    worker = gba->ppu_worker;
+    ppu_worker_wait(worker, atomic_load_explicit(&worker->lines_queued, memory_order_relaxed));
+}
+
+/*
+** Flag the worker's copy of PALRAM, VRAM and OAM as outdated, when they were modified
+** without going through the usual accessors (reset, quickload, etc.).
+**
+** It is copied again before the next scanline is queued.
+*/
+void
+ppu_worker_reload(
+    struct gba *gba
+) {
+    if (gba->ppu_worker) {
+        gba->ppu_worker->reload = true;
+    }
+}
+
+/*
+** Called when the log of writes is full: wait until the worker is idle, and apply
+** the pending writes ourselves.
+*/
+void
+ppu_worker_flush_writes(
+    struct ppu_worker *worker
+) {
+    ppu_worker_sync(worker->gba);
+    ppu_worker_apply_writes(worker, worker->writes_tail);
+}
+
+/*
+** Capture the state of the scanline that just entered HBlank and queue it for rendering.
+*/
+void
+ppu_worker_queue_line(
+    struct gba *gba
+) {
+    struct ppu_worker *worker;
+    struct ppu_line *line;
+    uint64_t queued;
+
+    worker = gba->ppu_worker;
+
+    if (worker->reload) {
+        struct gba *view;
+
+        ppu_worker_sync(gba);
+
+        view = worker->view;
+        memcpy(view->memory.palram, gba->memory.palram, sizeof(view->memory.palram));
+        memcpy(view->memory.vram, gba->memory.vram, sizeof(view->memory.vram));
+        memcpy(view->memory.oam, gba->memory.oam, sizeof(view->memory.oam));
+        memset(view->memory.vram_dirty, 0xFF, sizeof(view->memory.vram_dirty));
+        view->memory.oam_dirty = true;
+
+        atomic_store_explicit(&worker->writes_head, worker->writes_tail, memory_order_relaxed);
+        worker->reload = false;
+    }
+
+    // Wait for the slot of the new scanline to be free.
+    queued = atomic_load_explicit(&worker->lines_queued, memory_order_relaxed);
+    if (queued >= GBA_SCREEN_HEIGHT) {
+        ppu_worker_wait(worker, queued - GBA_SCREEN_HEIGHT + 1);
+    }
+
+    line = &worker->lines[queued % GBA_SCREEN_HEIGHT];
+    line->io = gba->io;
+    memcpy(line->internal_px, gba->ppu.internal_px, sizeof(line->internal_px));
+    memcpy(line->internal_py, gba->ppu.internal_py, sizeof(line->internal_py));
+    memcpy(line->layers, gba->ppu.layers, sizeof(line->layers));
+    line->layers_len = gba->ppu.layers_len;
+    line->color_correction = gba->color_correction;
+    line->writes_end = worker->writes_tail;
+
+    // See `ppu_worker_wait_line()`.
+    atomic_store(&worker->lines_queued, queued + 1);
+    if (atomic_load(&worker->worker_sleeping)) {
+        pthread_mutex_lock(&worker->lock);
+        pthread_cond_signal(&worker->wake);
+        pthread_mutex_unlock(&worker->lock);
+    }
+}
@@ -22,6 +22,7 @@ quicksave(
     struct gba const *gba,
     char const *path
 ) {
+    struct core core;
     FILE *file;
     size_t i;
 
@@ -30,8 +31,12 @@ quicksave(
         goto err;
     }
 
+    /* Save the condition flags in `cpsr`, not as the last flag-setting operation. */
+    core = gba->core;
+    core_flags_sync(&core);
+
     if (
-           fwrite(&gba->core, sizeof(gba->core), 1, file) != 1
+           fwrite(&core, sizeof(core), 1, file) != 1
         || fwrite(gba->memory.ewram, sizeof(gba->memory.ewram), 1, file) != 1
         || fwrite(gba->memory.iwram, sizeof(gba->memory.iwram), 1, file) != 1
         || fwrite(gba->memory.palram, sizeof(gba->memory.palram), 1, file) != 1
@@ -92,14 +97,27 @@ finally:
 
 /*
 ** Load a new state for the emulator from the content of the file pointed by `path`.
+**
+** The whole state is read before any of it is applied, so the emulator is left untouched
+** if the file can't be read or is truncated.
+**
+** Return true on success, false on failure.
 */
-void
+bool
 quickload(
     struct gba *gba,
     char const *path
 ) {
+    struct scheduler_event *events;
+    struct gba *state;
     FILE *file;
     size_t i;
+    bool ok;
+
+    ok = false;
+    events = calloc(gba->scheduler.events_size, sizeof(*events));
+    state = malloc(sizeof(*state));
+    hs_assert(events && state);
 
     file = fopen(path, "rb");
     if (!file) {
@@ -107,19 +125,19 @@ quickload(
     }
 
     if (
-           fread(&gba->core, sizeof(gba->core), 1, file) != 1
-        || fread(gba->memory.ewram, sizeof(gba->memory.ewram), 1, file) != 1
-        || fread(gba->memory.iwram, sizeof(gba->memory.iwram), 1, file) != 1
-        || fread(gba->memory.palram, sizeof(gba->memory.palram), 1, file) != 1
-        || fread(gba->memory.vram, sizeof(gba->memory.vram), 1, file) != 1
-        || fread(gba->memory.oam, sizeof(gba->memory.oam), 1, file) != 1
-        || fread(&gba->memory.pbuffer, sizeof(gba->memory.pbuffer), 1, file) != 1
-        || fread(&gba->memory.flash, sizeof(gba->memory.flash), 1, file) != 1
-        || fread(&gba->memory.eeprom, sizeof(gba->memory.eeprom), 1, file) != 1
-        || fread(&gba->io, sizeof(gba->io), 1, file) != 1
-        || fread(&gba->ppu, sizeof(gba->ppu), 1, file) != 1
-        || fread(&gba->gpio, sizeof(gba->gpio), 1, file) != 1
-        || fread(&gba->scheduler.next_event, sizeof(uint64_t), 1, file) != 1
+           fread(&state->core, sizeof(state->core), 1, file) != 1
+        || fread(state->memory.ewram, sizeof(state->memory.ewram), 1, file) != 1
+        || fread(state->memory.iwram, sizeof(state->memory.iwram), 1, file) != 1
+        || fread(state->memory.palram, sizeof(state->memory.palram), 1, file) != 1
+        || fread(state->memory.vram, sizeof(state->memory.vram), 1, file) != 1
+        || fread(state->memory.oam, sizeof(state->memory.oam), 1, file) != 1
+        || fread(&state->memory.pbuffer, sizeof(state->memory.pbuffer), 1, file) != 1
+        || fread(&state->memory.flash, sizeof(state->memory.flash), 1, file) != 1
+        || fread(&state->memory.eeprom, sizeof(state->memory.eeprom), 1, file) != 1
+        || fread(&state->io, sizeof(state->io), 1, file) != 1
+        || fread(&state->ppu, sizeof(state->ppu), 1, file) != 1
+        || fread(&state->gpio, sizeof(state->gpio), 1, file) != 1
+        || fread(&state->scheduler.next_event, sizeof(uint64_t), 1, file) != 1
     ) {
         goto err;
     }
@@ -128,7 +146,7 @@ quickload(
     for (i = 0; i < gba->scheduler.events_size; ++i) {
         struct scheduler_event *event;
 
-        event = gba->scheduler.events + i;
+        event = events + i;
         if (
                fread(&event->active, sizeof(bool), 1, file) != 1
             || fread(&event->repeat, sizeof(bool), 1, file) != 1
@@ -139,6 +157,39 @@ quickload(
         }
     }
 
+    /* The state is complete, apply it. */
+    gba->core = state->core;
+    memcpy(gba->memory.ewram, state->memory.ewram, sizeof(gba->memory.ewram));
+    memcpy(gba->memory.iwram, state->memory.iwram, sizeof(gba->memory.iwram));
+    memcpy(gba->memory.palram, state->memory.palram, sizeof(gba->memory.palram));
+    memcpy(gba->memory.vram, state->memory.vram, sizeof(gba->memory.vram));
+    memcpy(gba->memory.oam, state->memory.oam, sizeof(gba->memory.oam));
+    gba->memory.pbuffer = state->memory.pbuffer;
+    gba->memory.flash = state->memory.flash;
+    gba->memory.eeprom = state->memory.eeprom;
+    gba->io = state->io;
+    gba->ppu = state->ppu;
+    gba->gpio = state->gpio;
+    gba->scheduler.next_event = state->scheduler.next_event;
+
+    for (i = 0; i < gba->scheduler.events_size; ++i) {
+        gba->scheduler.events[i].active = events[i].active;
+        gba->scheduler.events[i].repeat = events[i].repeat;
+        gba->scheduler.events[i].at = events[i].at;
+        gba->scheduler.events[i].period = events[i].period;
+    }
+
+    /* VRAM and OAM were overwritten, the PPU's caches have to be rebuilt. */
+    memset(gba->memory.vram_dirty, 0xFF, sizeof(gba->memory.vram_dirty));
+    gba->memory.oam_dirty = true;
+    ppu_worker_reload(gba);
+
+    // The waitstates aren't saved, they are derived from REG_WAITCNT.
+    mem_update_waitstates(gba);
+
+    // Neither is the order of the layers, derived from REG_DISPCNT and REG_BGxCNT.
+    ppu_update_layer_order(gba);
+
     logln(
         HS_GLOBAL,
         "State loaded from %s%s%s",
@@ -147,6 +198,7 @@ quickload(
         g_reset
     );
 
+    ok = true;
     goto finally;
 
 err:
@@ -155,7 +207,7 @@ err:
         "%sError: failed to load state from %s: %s%s",
         g_light_red,
         path,
-        strerror(errno),
+        (file && !ferror(file)) ? "the file is truncated" : strerror(errno),
         g_reset
     );
 
@@ -164,4 +216,7 @@ finally:
     if (file) {
         fclose(file);
     }
-}
\ No newline at end of file
+    free(state);
+    free(events);
+    return (ok);
+}
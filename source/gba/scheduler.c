@@ -160,7 +160,11 @@ sched_run_for(
         uint64_t old_cycles;
 
         old_cycles = core->cycles;
+#ifdef WITH_THREADED_DISPATCH
+        core_run_threaded(gba, target);
+#else
         core_next(gba);
+#endif
         elapsed = core->cycles - old_cycles;
 
         if (!elapsed) {
@@ -9,7 +9,7 @@
 
 #include "gba/gba.h"
 
-static uint64_t scalers[4] = { 0, 6, 8, 10 };
+static uint64_t const scalers[4] = { 0, 6, 8, 10 };
 
 void timer_overflow(struct gba *gba, union event_data data);
 
@@ -56,7 +56,7 @@ timer_overflow(
     timer->counter.raw = timer->reload.raw;
 
     if (timer->control.irq) {
-        gba->io.int_flag.raw |= 1 << (IRQ_TIMER0 + timer_idx);
+        core_trigger_irq(gba, IRQ_TIMER0 + timer_idx);
     }
 
     if (timer_idx == 0 || timer_idx == 1) {
@@ -0,0 +1,202 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+#define _GNU_SOURCE
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+#include <errno.h>
+#include <string.h>
+#include "hades.h"
+#include "gba/gba.h"
+#include "platform/batch.h"
+#include "utils/fs.h"
+#include "utils/time.h"
+
+/*
+** Nobody listens to the audio, so the APU is only asked for the lowest sample rate.
+** It has no effect on the emulated state.
+*/
+#define BATCH_AUDIO_FREQUENCY       1000
+
+/*
+** Hash the state of the emulated system with FNV-1a (64 bits): the registers of the
+** core, the IO registers, all the RAM and the final framebuffer.
+*/
+static
+uint64_t
+batch_state_hash(
+    struct gba *gba
+) {
+    struct {
+        void const *data;
+        size_t size;
+    } const parts[] = {
+        { gba->core.registers,              sizeof(gba->core.registers) },
+        { &gba->core.cpsr,                  sizeof(gba->core.cpsr) },
+        { &gba->io,                         sizeof(gba->io) },
+        { gba->memory.ewram,                sizeof(gba->memory.ewram) },
+        { gba->memory.iwram,                sizeof(gba->memory.iwram) },
+        { gba->memory.palram,               sizeof(gba->memory.palram) },
+        { gba->memory.vram,                 sizeof(gba->memory.vram) },
+        { gba->memory.oam,                  sizeof(gba->memory.oam) },
+        { gba->framebuffer_frontend,        sizeof(gba->framebuffer_frontend) },
+    };
+    uint64_t hash;
+    size_t i;
+    size_t j;
+
+    core_flags_sync(&gba->core);
+
+    hash = 0xcbf29ce484222325ull;
+    for (i = 0; i < ARRAY_LEN(parts); ++i) {
+        uint8_t const *data;
+
+        data = parts[i].data;
+        for (j = 0; j < parts[i].size; ++j) {
+            hash = (hash ^ data[j]) * 0x100000001b3ull;
+        }
+    }
+    return (hash);
+}
+
+/*
+** Return the basename of `path`, without its extension, in a newly allocated string.
+*/
+static
+char *
+batch_stem(
+    char const *path
+) {
+    char *stem;
+    char *ext;
+
+    stem = strdup(hs_basename(path));
+    hs_assert(stem);
+
+    ext = strrchr(stem, '.');
+    if (ext && ext != stem) {
+        *ext = '\0';
+    }
+    return (stem);
+}
+
+/*
+** Save the last frame of `job` in the output directory, as `<rom>[.<state>].png`.
+*/
+static
+bool
+batch_screenshot(
+    struct batch_config const *config,
+    struct batch_job *job,
+    struct gba *gba
+) {
+    char *rom_stem;
+    char *state_stem;
+    char *path;
+    int out;
+
+    rom_stem = batch_stem(job->rom_path);
+    state_stem = job->state_path ? batch_stem(job->state_path) : NULL;
+
+    hs_assert(-1 != asprintf(
+        &path,
+        "%s/%s%s%s.png",
+        config->output_dir,
+        rom_stem,
+        state_stem ? "." : "",
+        state_stem ? state_stem : ""
+    ));
+
+    out = stbi_write_png(
+        path,
+        GBA_SCREEN_WIDTH,
+        GBA_SCREEN_HEIGHT,
+        4,
+        gba->framebuffer_frontend,
+        GBA_SCREEN_WIDTH * sizeof(uint32_t)
+    );
+
+    if (!out) {
+        hs_assert(-1 != asprintf(&job->error, "failed to write %s", path));
+    }
+
+    free(path);
+    free(state_stem);
+    free(rom_stem);
+    return (out);
+}
+
+/*
+** Run a single game, headless, for the amount of frames given by the configuration.
+**
+** Called by the workers of the pool, see `pool_run()`.
+*/
+void
+batch_run_job(
+    void *raw_config,
+    void *raw_job,
+    size_t worker
+) {
+    struct batch_config const *config;
+    struct batch_job *job;
+    struct gba *gba;
+    struct rom *rom;
+    uint64_t start;
+
+    config = raw_config;
+    job = raw_job;
+    job->worker = worker;
+
+    rom = mem_rom_open(job->rom_path);
+    if (!rom) {
+        hs_assert(-1 != asprintf(&job->error, "failed to open %s: %s", job->rom_path, strerror(errno)));
+        return ;
+    }
+
+    if (rom->size > CART_SIZE || rom->size < 192) {
+        hs_assert(-1 != asprintf(&job->error, "the ROM is invalid"));
+        mem_rom_unref(rom);
+        return ;
+    }
+
+    start = hs_tick_count();
+
+    gba = gba_new();
+    gba_message_push(gba, NEW_MESSAGE_AUDIO_RESAMPLE_FREQ(CYCLES_PER_SECOND / BATCH_AUDIO_FREQUENCY));
+    gba_message_push(gba, NEW_MESSAGE_LOAD_BIOS((uint8_t *)config->bios, NULL));
+    gba_message_push(gba, NEW_MESSAGE_LOAD_ROM(rom));
+    gba_message_push(gba, NEW_MESSAGE_BACKUP_TYPE(BACKUP_AUTO_DETECT));
+    gba_message_push(gba, NEW_MESSAGE_RTC(DEVICE_AUTO_DETECT));
+    gba_message_push(gba, NEW_MESSAGE_SKIP_BIOS(config->skip_bios));
+    gba_message_push(gba, NEW_MESSAGE_RESET());
+    gba_run_frames(gba, 0);
+
+    /*
+    ** The savestate is loaded directly rather than through MESSAGE_QUICKLOAD, so that a job
+    ** whose state can't be loaded fails instead of reporting the hash of a fresh boot.
+    */
+    if (job->state_path && !quickload(gba, job->state_path)) {
+        hs_assert(-1 != asprintf(&job->error, "failed to load the savestate %s", job->state_path));
+        gba_delete(gba);
+        return ;
+    }
+
+    gba_message_push(gba, NEW_MESSAGE_RUN(0));
+
+    gba_run_frames(gba, config->frames);
+
+    job->time = hs_tick_count() - start;
+    job->frames = gba->framecounter;
+    job->cycles = gba->core.cycles;
+    job->hash = batch_state_hash(gba);
+
+    batch_screenshot(config, job, gba);
+
+    gba_delete(gba);
+}
@@ -0,0 +1,471 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** hades-batch: run a list of games headless, in parallel, and record the final frame,
+** a hash of the final state and some performance statistics for each one of them.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include "hades.h"
+#include "gba/gba.h"
+#include "platform/batch.h"
+#include "utils/fs.h"
+#include "utils/time.h"
+
+#if defined (_WIN32) && !defined (__CYGWIN__)
+# include <windows.h>
+#endif
+
+struct batch {
+    struct batch_config config;
+    char const *bios_path;
+    char const *report_path;
+    size_t nb_workers;
+
+    struct batch_job *jobs;
+    size_t nb_jobs;
+};
+
+/*
+** Print the program's usage.
+*/
+static
+void
+print_usage(
+    FILE *file,
+    char const *name
+) {
+    fprintf(
+        file,
+        "Usage: %s [OPTION]... ROM[,SAVESTATE]...\n"
+        "\n"
+        "Run each ROM (optionally starting from the given savestate) for a fixed amount of frames,\n"
+        "save its last frame as a PNG and write a report with a hash of its final state and\n"
+        "performance statistics.\n"
+        "\n"
+        "Options:\n"
+        "    -b, --bios=PATH                   path pointing to the bios dump (default: \"bios.bin\")\n"
+        "    -f, --frames=N                    amount of frames to run each game for (default: 3600)\n"
+        "    -j, --jobs=N                      amount of games to run in parallel (default: number of CPUs)\n"
+        "    -l, --list=PATH                   read more ROM[,SAVESTATE] entries from PATH, one per line\n"
+        "    -o, --output=PATH                 directory where the PNGs are written (default: \".\")\n"
+        "        --report=PATH                 path of the report (default: \"<output>/report.tsv\")\n"
+        "        --color=[always|never|auto]   adjust color settings (default: auto)\n"
+        "        --skip-bios                   skip the BIOS intro and boot the games directly\n"
+        "\n"
+        "    -h, --help                        print this help and exit\n"
+        "    -v, --version                     print the version information and exit\n"
+        "",
+        name
+    );
+}
+
+/*
+** Return the number of CPUs available.
+*/
+static
+size_t
+cpu_count(void)
+{
+#if defined (_WIN32) && !defined (__CYGWIN__)
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors);
+#else
+    long count;
+
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0 ? count : 1);
+#endif
+}
+
+/*
+** Add a job from an entry formatted as `ROM[,SAVESTATE]`.
+*/
+static
+void
+batch_add_job(
+    struct batch *batch,
+    char const *entry
+) {
+    struct batch_job *job;
+    char *rom_path;
+    char *sep;
+
+    rom_path = strdup(entry);
+    hs_assert(rom_path);
+
+    batch->jobs = realloc(batch->jobs, (batch->nb_jobs + 1) * sizeof(struct batch_job));
+    hs_assert(batch->jobs);
+
+    job = &batch->jobs[batch->nb_jobs++];
+    memset(job, 0, sizeof(*job));
+
+    sep = strrchr(rom_path, ',');
+    if (sep) {
+        *sep = '\0';
+        job->state_path = sep + 1;
+    }
+    job->rom_path = rom_path;
+}
+
+/*
+** Add a job for each line of the file at `path`, ignoring empty lines and lines
+** starting with `#`.
+*/
+static
+void
+batch_add_jobs_from_list(
+    struct batch *batch,
+    char const *path
+) {
+    FILE *file;
+    char *line;
+    size_t size;
+    ssize_t len;
+
+    file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "hades-batch: failed to open %s: %s.\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    line = NULL;
+    size = 0;
+    while ((len = getline(&line, &size, file)) != -1) {
+        while (len && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+
+        if (len && line[0] != '#') {
+            batch_add_job(batch, line);
+        }
+    }
+
+    free(line);
+    fclose(file);
+}
+
+/*
+** Parse the given command line arguments.
+*/
+static
+void
+args_parse(
+    struct batch *batch,
+    int argc,
+    char *argv[]
+) {
+    char const *name;
+    uint32_t color;
+
+    color = 0;
+    name = argv[0];
+    while (true) {
+        int c;
+        int option_index;
+
+        enum cli_options {
+            CLI_HELP = 0,
+            CLI_VERSION,
+            CLI_BIOS,
+            CLI_FRAMES,
+            CLI_JOBS,
+            CLI_LIST,
+            CLI_OUTPUT,
+            CLI_REPORT,
+            CLI_COLOR,
+            CLI_SKIP_BIOS,
+        };
+
+        static struct option long_options[] = {
+            [CLI_HELP]      = { "help",         no_argument,        0,  0 },
+            [CLI_VERSION]   = { "version",      no_argument,        0,  0 },
+            [CLI_BIOS]      = { "bios",         required_argument,  0,  0 },
+            [CLI_FRAMES]    = { "frames",       required_argument,  0,  0 },
+            [CLI_JOBS]      = { "jobs",         required_argument,  0,  0 },
+            [CLI_LIST]      = { "list",         required_argument,  0,  0 },
+            [CLI_OUTPUT]    = { "output",       required_argument,  0,  0 },
+            [CLI_REPORT]    = { "report",       required_argument,  0,  0 },
+            [CLI_COLOR]     = { "color",        optional_argument,  0,  0 },
+            [CLI_SKIP_BIOS] = { "skip-bios",    no_argument,        0,  0 },
+                              { 0,              0,                  0,  0 }
+        };
+
+        c = getopt_long(
+            argc,
+            argv,
+            "hvb:f:j:l:o:",
+            long_options,
+            &option_index
+        );
+
+        if (c == -1) {
+            break;
+        }
+
+        if (c == 0) {
+            switch (option_index) {
+                case CLI_HELP:      c = 'h'; break;
+                case CLI_VERSION:   c = 'v'; break;
+                case CLI_BIOS:      c = 'b'; break;
+                case CLI_FRAMES:    c = 'f'; break;
+                case CLI_JOBS:      c = 'j'; break;
+                case CLI_LIST:      c = 'l'; break;
+                case CLI_OUTPUT:    c = 'o'; break;
+                case CLI_REPORT:
+                    batch->report_path = optarg;
+                    continue;
+                case CLI_COLOR: // --color
+                    if (!optarg || !strcmp(optarg, "auto")) {
+                        color = 0;
+                    } else if (!strcmp(optarg, "never")) {
+                        color = 1;
+                    } else if (!strcmp(optarg, "always")) {
+                        color = 2;
+                    } else {
+                        print_usage(stderr, name);
+                        exit(EXIT_FAILURE);
+                    }
+                    continue;
+                case CLI_SKIP_BIOS: // --skip-bios
+                    batch->config.skip_bios = true;
+                    continue;
+                default:
+                    print_usage(stderr, name);
+                    exit(EXIT_FAILURE);
+                    break;
+            }
+        }
+
+        switch (c) {
+            case 'b':
+                batch->bios_path = optarg;
+                break;
+            case 'f':
+                batch->config.frames = strtoul(optarg, NULL, 10);
+                break;
+            case 'j':
+                batch->nb_workers = strtoul(optarg, NULL, 10);
+                if (!batch->nb_workers) {
+                    print_usage(stderr, name);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'l':
+                batch_add_jobs_from_list(batch, optarg);
+                break;
+            case 'o':
+                batch->config.output_dir = optarg;
+                break;
+            case 'h':
+                print_usage(stdout, name);
+                exit(EXIT_SUCCESS);
+                break;
+            case 'v':
+                printf("Hades v" HADES_VERSION "\n");
+                exit(EXIT_SUCCESS);
+                break;
+            default:
+                print_usage(stderr, name);
+                exit(EXIT_FAILURE);
+                break;
+        }
+    }
+
+    for (; optind < argc; ++optind) {
+        batch_add_job(batch, argv[optind]);
+    }
+
+    if (!batch->nb_jobs) {
+        print_usage(stderr, name);
+        exit(EXIT_FAILURE);
+    }
+
+    switch (color) {
+        case 0:
+            if (!hs_isatty(1)) {
+                disable_colors();
+            }
+            break;
+        case 1:
+            disable_colors();
+            break;
+    }
+}
+
+/*
+** Load the BIOS, shared read-only by all the jobs.
+*/
+static
+uint8_t *
+load_bios(
+    char const *path
+) {
+    FILE *file;
+    uint8_t *data;
+
+    file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "hades-batch: failed to open %s: %s.\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    data = calloc(1, BIOS_SIZE);
+    hs_assert(data);
+
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) != BIOS_SIZE) {
+        fprintf(stderr, "hades-batch: the BIOS is invalid.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    rewind(file);
+    if (fread(data, 1, BIOS_SIZE, file) != BIOS_SIZE) {
+        fprintf(stderr, "hades-batch: failed to read %s: %s.\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    fclose(file);
+    return (data);
+}
+
+/*
+** Write the report, one line per job, as tab-separated values.
+*/
+static
+bool
+write_report(
+    struct batch const *batch,
+    char const *path
+) {
+    FILE *file;
+    size_t i;
+
+    file = fopen(path, "w");
+    if (!file) {
+        return (false);
+    }
+
+    fprintf(file, "rom\tsavestate\tstatus\tframes\tcycles\thash\ttime_ms\tfps\tworker\n");
+    for (i = 0; i < batch->nb_jobs; ++i) {
+        struct batch_job const *job;
+
+        job = &batch->jobs[i];
+        fprintf(
+            file,
+            "%s\t%s\t%s\t%u\t%llu\t%016llx\t%.1f\t%.1f\t%zu\n",
+            job->rom_path,
+            job->state_path ? job->state_path : "",
+            job->error ? job->error : "ok",
+            job->frames,
+            (unsigned long long)job->cycles,
+            (unsigned long long)job->hash,
+            job->time / 1000.0,
+            job->time ? job->frames * 1000000.0 / job->time : 0.0,
+            job->worker
+        );
+    }
+
+    fclose(file);
+    return (true);
+}
+
+int
+main(
+    int argc,
+    char *argv[]
+) {
+    struct batch batch;
+    struct pool pool;
+    uint64_t start;
+    uint64_t elapsed;
+    uint64_t frames;
+    char *report_path;
+    size_t failed;
+    size_t i;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.bios_path = "bios.bin";
+    batch.config.output_dir = ".";
+    batch.config.frames = 3600;
+    batch.nb_workers = cpu_count();
+
+    args_parse(&batch, argc, argv);
+
+    /* Only log what the games themselves don't trigger. */
+    g_verbose_global = false;
+
+    batch.config.bios = load_bios(batch.bios_path);
+    batch.nb_workers = min(batch.nb_workers, batch.nb_jobs);
+
+    hs_mkdir(batch.config.output_dir);
+
+    pool_init(&pool, batch.nb_workers);
+    for (i = 0; i < batch.nb_jobs; ++i) {
+        pool_push(&pool, &batch.jobs[i]);
+    }
+
+    start = hs_tick_count();
+    pool_run(&pool, batch_run_job, &batch.config);
+    elapsed = hs_tick_count() - start;
+
+    frames = 0;
+    failed = 0;
+    for (i = 0; i < batch.nb_jobs; ++i) {
+        frames += batch.jobs[i].frames;
+        failed += !!batch.jobs[i].error;
+        if (batch.jobs[i].error) {
+            fprintf(stderr, "hades-batch: %s: %s.\n", batch.jobs[i].rom_path, batch.jobs[i].error);
+        }
+    }
+
+    if (batch.report_path) {
+        report_path = strdup(batch.report_path);
+    } else {
+        hs_assert(-1 != asprintf(&report_path, "%s/report.tsv", batch.config.output_dir));
+    }
+
+    if (!write_report(&batch, report_path)) {
+        fprintf(stderr, "hades-batch: failed to write %s: %s.\n", report_path, strerror(errno));
+        failed = batch.nb_jobs;
+    }
+
+    printf(
+        "%s%zu/%zu%s games ran on %zu workers (%zu steals) in %.2fs, %.1f frames per second. Report saved in %s%s%s.\n",
+        failed ? g_light_red : g_light_green,
+        batch.nb_jobs - failed,
+        batch.nb_jobs,
+        g_reset,
+        batch.nb_workers,
+        (size_t)pool.steals,
+        elapsed / 1000000.0,
+        elapsed ? frames * 1000000.0 / elapsed : 0.0,
+        g_light_magenta,
+        report_path,
+        g_reset
+    );
+
+    pool_cleanup(&pool);
+    free(report_path);
+    for (i = 0; i < batch.nb_jobs; ++i) {
+        free((char *)batch.jobs[i].rom_path);
+        free(batch.jobs[i].error);
+    }
+    free(batch.jobs);
+    free((void *)batch.config.bios);
+
+    return (failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
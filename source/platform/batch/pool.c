@@ -0,0 +1,203 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** A work-stealing thread pool.
+**
+** Tasks are dealt to the workers in a round-robin fashion before they are started.
+** Each worker then runs the tasks of its own deque, newest first, and once it is
+** empty, steals the oldest task of another worker.
+**
+** Tasks are coarse (a whole game) and never spawn other tasks, so a lock per deque
+** is cheap enough, and a worker can stop as soon as a full round of steals fails.
+*/
+
+#include <string.h>
+#include "hades.h"
+#include "platform/batch.h"
+
+struct pool_worker {
+    struct pool *pool;
+    size_t idx;
+    pthread_t thread;
+};
+
+void
+pool_init(
+    struct pool *pool,
+    size_t nb_workers
+) {
+    size_t i;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->nb_workers = nb_workers;
+    pool->deques = calloc(nb_workers, sizeof(struct pool_deque));
+    hs_assert(pool->deques);
+
+    for (i = 0; i < nb_workers; ++i) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    }
+
+    atomic_init(&pool->steals, 0);
+}
+
+/*
+** Add a task to the pool, in the deque of the next worker.
+**
+** Must be called before `pool_run()`.
+*/
+void
+pool_push(
+    struct pool *pool,
+    void *task
+) {
+    struct pool_deque *deque;
+
+    deque = &pool->deques[pool->next_deque];
+    pool->next_deque = (pool->next_deque + 1) % pool->nb_workers;
+
+    if (deque->tail == deque->capacity) {
+        deque->capacity = deque->capacity ? deque->capacity * 2 : 16;
+        deque->tasks = realloc(deque->tasks, deque->capacity * sizeof(void *));
+        hs_assert(deque->tasks);
+    }
+
+    deque->tasks[deque->tail++] = task;
+}
+
+/*
+** Pop the newest task of the deque of the given worker.
+*/
+static
+void *
+pool_pop(
+    struct pool *pool,
+    size_t worker
+) {
+    struct pool_deque *deque;
+    void *task;
+
+    deque = &pool->deques[worker];
+    task = NULL;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->tail > deque->head) {
+        task = deque->tasks[--deque->tail];
+    }
+    pthread_mutex_unlock(&deque->lock);
+
+    return (task);
+}
+
+/*
+** Steal the oldest task of another worker, starting with the one following `worker`.
+*/
+static
+void *
+pool_steal(
+    struct pool *pool,
+    size_t worker
+) {
+    size_t i;
+
+    for (i = 1; i < pool->nb_workers; ++i) {
+        struct pool_deque *deque;
+        void *task;
+
+        deque = &pool->deques[(worker + i) % pool->nb_workers];
+        task = NULL;
+
+        pthread_mutex_lock(&deque->lock);
+        if (deque->tail > deque->head) {
+            task = deque->tasks[deque->head++];
+        }
+        pthread_mutex_unlock(&deque->lock);
+
+        if (task) {
+            atomic_fetch_add_explicit(&pool->steals, 1, memory_order_relaxed);
+            return (task);
+        }
+    }
+    return (NULL);
+}
+
+static
+void *
+pool_worker_main(
+    void *raw
+) {
+    struct pool_worker *worker;
+    struct pool *pool;
+
+    worker = raw;
+    pool = worker->pool;
+
+    while (true) {
+        void *task;
+
+        task = pool_pop(pool, worker->idx);
+        if (!task) {
+            task = pool_steal(pool, worker->idx);
+        }
+
+        if (!task) {
+            break;
+        }
+
+        pool->func(pool->ctx, task, worker->idx);
+    }
+    return (NULL);
+}
+
+/*
+** Run all the tasks of the pool, calling `func(ctx, task, worker)` for each one of
+** them, and wait for their completion.
+*/
+void
+pool_run(
+    struct pool *pool,
+    void (*func)(void *ctx, void *task, size_t worker),
+    void *ctx
+) {
+    struct pool_worker *workers;
+    size_t i;
+
+    pool->func = func;
+    pool->ctx = ctx;
+
+    workers = calloc(pool->nb_workers, sizeof(struct pool_worker));
+    hs_assert(workers);
+
+    for (i = 0; i < pool->nb_workers; ++i) {
+        workers[i].pool = pool;
+        workers[i].idx = i;
+        hs_assert(!pthread_create(&workers[i].thread, NULL, pool_worker_main, &workers[i]));
+    }
+
+    for (i = 0; i < pool->nb_workers; ++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    free(workers);
+}
+
+void
+pool_cleanup(
+    struct pool *pool
+) {
+    size_t i;
+
+    for (i = 0; i < pool->nb_workers; ++i) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+    free(pool->deques);
+    pool->deques = NULL;
+    pool->nb_workers = 0;
+}
@@ -35,6 +35,7 @@ gui_load_config(
                 backup_type: %d,
                 rtc_autodetect: %B,
                 rtc_enabled: %B,
+                skip_bios: %B,
             }),
             &app->recent_roms[0],
             &app->recent_roms[1],
@@ -46,7 +47,8 @@ gui_load_config(
             &app->vsync,
             &app->emulation.backup_type,
             &app->emulation.rtc_autodetect,
-            &app->emulation.rtc_enabled
+            &app->emulation.rtc_enabled,
+            &app->emulation.skip_bios
         );
 
         free(data);
@@ -75,6 +77,7 @@ gui_save_config(
             backup_type: %d,
             rtc_autodetect: %B,
             rtc_enabled: %B,
+            skip_bios: %B,
         }),
         app->recent_roms[0],
         app->recent_roms[1],
@@ -86,7 +89,8 @@ gui_save_config(
         app->vsync,
         app->emulation.backup_type,
         app->emulation.rtc_autodetect,
-        app->emulation.rtc_enabled
+        app->emulation.rtc_enabled,
+        app->emulation.skip_bios
     );
 }
 
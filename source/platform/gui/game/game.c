@@ -70,14 +70,13 @@ bool
 load_rom(
     struct app *app
 ) {
-    FILE *file;
-    size_t file_len;
-    void *data;
+    struct rom *rom;
     char *error_msg;
     enum device_state rtc_state;
 
-    file = fopen(app->emulation.game_path, "rb");
-    if (!file) {
+    // The ROM is mapped rather than copied, see `mem_rom_open()`.
+    rom = mem_rom_open(app->emulation.game_path);
+    if (!rom) {
         hs_assert(-1 != asprintf(
             &error_msg,
             "failed to open %s: %s.",
@@ -88,28 +87,10 @@ load_rom(
         return (true);
     }
 
-    fseek(file, 0, SEEK_END);
-    file_len = ftell(file);
-    if (file_len > CART_SIZE || file_len < 192) {
+    if (rom->size > CART_SIZE || rom->size < 192) {
         error_msg = strdup("the ROM is invalid.");
         gui_new_error(app, error_msg);
-        return (true);
-    }
-
-    rewind(file);
-
-    data = calloc(1, file_len);
-    hs_assert(data);
-
-    if (fread(data, 1, file_len, file) != file_len) {
-        hs_assert(-1 != asprintf(
-            &error_msg,
-            "failed to read %s: %s.",
-            app->emulation.game_path,
-            strerror(errno)
-        ));
-        gui_new_error(app, error_msg);
-        free(data);
+        mem_rom_unref(rom);
         return (true);
     }
 
@@ -119,7 +100,7 @@ load_rom(
         rtc_state = app->emulation.rtc_enabled ? DEVICE_ENABLED : DEVICE_DISABLED;
     }
 
-    gba_message_push(app->emulation.gba, NEW_MESSAGE_LOAD_ROM(data, file_len, free));
+    gba_message_push(app->emulation.gba, NEW_MESSAGE_LOAD_ROM(rom));
     gba_message_push(app->emulation.gba, NEW_MESSAGE_BACKUP_TYPE(app->emulation.backup_type));
     gba_message_push(app->emulation.gba, NEW_MESSAGE_RTC(rtc_state));
 
@@ -307,6 +288,23 @@ gui_game_set_color_correction(
     gba_message_push(app->emulation.gba, NEW_MESSAGE_COLOR_CORRECTION(app->emulation.color_correction));
 }
 
+void
+gui_game_set_skip_bios(
+    struct app *app
+) {
+    gba_message_push(
+        app->emulation.gba,
+        NEW_MESSAGE_SKIP_BIOS(app->emulation.skip_bios || app->emulation.skip_bios_override)
+    );
+}
+
+void
+gui_game_set_render_thread(
+    struct app *app
+) {
+    gba_message_push(app->emulation.gba, NEW_MESSAGE_PPU_WORKER(app->emulation.render_thread));
+}
+
 void
 gui_game_set_backup_type(
     struct app *app
@@ -58,6 +58,8 @@ print_usage(
         "Options:\n"
         "    -b, --bios=PATH                   path pointing to the bios dump (default: \"bios.bin\")\n"
         "        --color=[always|never|auto]   adjust color settings (default: auto)\n"
+        "        --skip-bios                   skip the BIOS intro and boot the game directly\n"
+        "        --render-thread               render the screen on a separate thread\n"
         "\n"
         "    -h, --help                        print this help and exit\n"
         "    -v, --version                     print the version information and exit\n"
@@ -90,14 +92,18 @@ args_parse(
             CLI_VERSION,
             CLI_BIOS,
             CLI_COLOR,
+            CLI_SKIP_BIOS,
+            CLI_RENDER_THREAD,
         };
 
         static struct option long_options[] = {
-            [CLI_HELP]      = { "help",         no_argument,        0,  0 },
-            [CLI_VERSION]   = { "version",      no_argument,        0,  0 },
-            [CLI_BIOS]      = { "bios",         required_argument,  0,  0 },
-            [CLI_COLOR]     = { "color",        optional_argument,  0,  0 },
-                              { 0,              0,                  0,  0 }
+            [CLI_HELP]           = { "help",          no_argument,        0,  0 },
+            [CLI_VERSION]        = { "version",       no_argument,        0,  0 },
+            [CLI_BIOS]           = { "bios",          required_argument,  0,  0 },
+            [CLI_COLOR]          = { "color",         optional_argument,  0,  0 },
+            [CLI_SKIP_BIOS]      = { "skip-bios",     no_argument,        0,  0 },
+            [CLI_RENDER_THREAD]  = { "render-thread", no_argument,        0,  0 },
+                                   { 0,               0,                  0,  0 }
         };
 
         c = getopt_long(
@@ -145,6 +151,12 @@ args_parse(
                             color = 0;
                         }
                         break;
+                    case CLI_SKIP_BIOS: // --skip-bios
+                        app->emulation.skip_bios_override = true;
+                        break;
+                    case CLI_RENDER_THREAD: // --render-thread
+                        app->emulation.render_thread = true;
+                        break;
                     default:
                         print_usage(stderr, name);
                         exit(EXIT_FAILURE);
@@ -456,9 +468,7 @@ main(
     app.emulation.backup_type = BACKUP_AUTO_DETECT;
     app.emulation.rtc_autodetect = true;
     app.emulation.rtc_enabled = true;
-    app.emulation.gba = malloc(sizeof(*app.emulation.gba));
-    hs_assert(app.emulation.gba);
-    gba_init(app.emulation.gba);
+    app.emulation.gba = gba_new();
 
     gui_load_config(&app);
 
@@ -470,6 +480,12 @@ main(
     /* Set the color correction */
     gui_game_set_color_correction(&app);
 
+    /* Set if the BIOS intro is skipped */
+    gui_game_set_skip_bios(&app);
+
+    /* Set if the scanlines are rendered on a separate thread */
+    gui_game_set_render_thread(&app);
+
     /* Start the logic thread */
     pthread_create(
         &logic_thread,
@@ -93,6 +93,13 @@ gui_render_menubar(
                 gui_game_set_color_correction(app);
             }
 
+            /* Skip BIOS (toggling it drops the `--skip-bios` override) */
+            if (igMenuItemBool("Skip BIOS intro", NULL, app->emulation.skip_bios || app->emulation.skip_bios_override, true)) {
+                app->emulation.skip_bios = !(app->emulation.skip_bios || app->emulation.skip_bios_override);
+                app->emulation.skip_bios_override = false;
+                gui_game_set_skip_bios(app);
+            }
+
             /* VSync */
             if (igMenuItemBool("Enable VSync", NULL, app->vsync, true)) {
                 app->vsync ^= 1;
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+
+################################################################################
+##
+##  This file is part of the Hades GBA Emulator, and is made available under
+##  the terms of the GNU General Public License version 2.
+##
+##  Copyright (C) 2021-2022 - The Hades Authors
+##
+################################################################################
+
+"""
+Measure the L1 and last-level data cache misses of the emulator.
+
+Run `hades-batch` on a fixed workload under `perf stat`, and report the misses per
+emulated frame. The workload is a small ARM program, generated here, that keeps reading
+and writing EWRAM, IWRAM and VRAM while the PPU renders a bitmap mode. More games
+(`ROM[,SAVESTATE]`) can be given after the path of `hades-batch` to measure them too.
+
+Without `perf` or hardware counters, only the wall time is reported.
+
+Usage: bench_cache.py HADES_BATCH [ROM[,SAVESTATE]]...
+"""
+
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+FRAMES = 3600
+EVENTS = ['L1-dcache-load-misses', 'LLC-load-misses']
+
+# Entry point at 0x08000000, in ARM mode (the BIOS intro is skipped).
+WORKLOAD = [
+    0xE3A00402,     # mov r0, #0x02000000           EWRAM
+    0xE3A01403,     # mov r1, #0x03000000           IWRAM
+    0xE3A02406,     # mov r2, #0x06000000           VRAM
+    0xE3A03000,     # mov r3, #0
+    0xE3A08301,     # mov r8, #0x04000000
+    0xE3A09B01,     # mov r9, #0x400
+    0xE3899003,     # orr r9, r9, #3
+    0xE1C890B0,     # strh r9, [r8]                 DISPCNT: mode 3, BG2
+                    # loop:
+    0xE2833004,     #   add r3, r3, #4
+    0xE3C3373F,     #   bic r3, r3, #0xFC0000       Wrap at 256KB
+    0xE7904003,     #   ldr r4, [r0, r3]
+    0xE0844003,     #   add r4, r4, r3
+    0xE7804003,     #   str r4, [r0, r3]
+    0xE1A05883,     #   mov r5, r3, lsl #17
+    0xE1A058A5,     #   mov r5, r5, lsr #17         Wrap at 32KB
+    0xE7916005,     #   ldr r6, [r1, r5]
+    0xE0266004,     #   eor r6, r6, r4
+    0xE7816005,     #   str r6, [r1, r5]
+    0xE1A07803,     #   mov r7, r3, lsl #16
+    0xE1A07827,     #   mov r7, r7, lsr #16         Wrap at 64KB
+    0xE7826007,     #   str r6, [r2, r7]
+    0xEAFFFFF1,     #   b loop
+]
+
+
+def write_files(tmp):
+    rom = os.path.join(tmp, 'workload.gba')
+    with open(rom, 'wb') as f:
+        code = struct.pack('<%dI' % len(WORKLOAD), *WORKLOAD)
+        f.write(code.ljust(256, b'\0'))
+
+    bios = os.path.join(tmp, 'bios.bin')
+    with open(bios, 'wb') as f:
+        f.write(bytes(0x4000))
+
+    return (rom, bios)
+
+
+def main(argv):
+    if len(argv) < 2:
+        print(__doc__.strip(), file=sys.stderr)
+        return 1
+
+    batch = argv[1]
+    tmp = tempfile.mkdtemp(prefix='hades-bench-')
+    try:
+        rom, bios = write_files(tmp)
+        games = [rom] + argv[2:]
+        cmd = [batch, '-j', '1', '--skip-bios', '-f', str(FRAMES), '-b', bios, '-o', tmp] + games
+
+        perf = shutil.which('perf')
+        if perf:
+            cmd = [perf, 'stat', '-x', ',', '-o', os.path.join(tmp, 'perf.csv'), '-e', ','.join(EVENTS), '--'] + cmd
+
+        start = time.monotonic()
+        subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL)
+        elapsed = time.monotonic() - start
+
+        frames = FRAMES * len(games)
+        print('%d games, %d frames, %.2fs (%.0f fps)' % (len(games), frames, elapsed, frames / elapsed))
+
+        if not perf:
+            print('perf not found, no cache statistics')
+            return 0
+
+        with open(os.path.join(tmp, 'perf.csv')) as f:
+            for line in f:
+                fields = line.strip().split(',')
+                if len(fields) < 3 or fields[2] not in EVENTS:
+                    continue
+                if not fields[0].isdigit():
+                    print('%-24s %s' % (fields[2], fields[0]))
+                else:
+                    print('%-24s %14d (%.0f per frame)' % (fields[2], int(fields[0]), int(fields[0]) / frames))
+        return 0
+    finally:
+        shutil.rmtree(tmp)
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -0,0 +1,173 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Check that every implementation of the color special effects is bit-exact with the
+** per-pixel formulas `ppu_merge_layer()` used before they were vectorized.
+**
+** The implementations are static, so `blend.c` is included rather than linked.
+**
+** All the BGR555 colors are tested with all the coefficients (0-16). For the alpha
+** blending, each one of them is blended with 32 grays, so that each channel goes through
+** every pair of 5-bit values.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "gba/ppu/blend.c"
+
+#define NB_COLORS       (1 << 15)
+
+static uint16_t colors[NB_COLORS];
+static uint16_t grays[32][NB_COLORS];
+
+static
+uint16_t
+ref_alpha(
+    uint16_t top,
+    uint16_t bot,
+    uint32_t eva,
+    uint32_t evb
+) {
+    union color topc;
+    union color botc;
+    union color res;
+
+    topc.raw = top;
+    botc.raw = bot;
+    res.raw = 0;
+    res.red = min(31, ((uint32_t)topc.red * eva + (uint32_t)botc.red * evb) >> 4);
+    res.green = min(31, ((uint32_t)topc.green * eva + (uint32_t)botc.green * evb) >> 4);
+    res.blue = min(31, ((uint32_t)topc.blue * eva + (uint32_t)botc.blue * evb) >> 4);
+    return (res.raw);
+}
+
+static
+uint16_t
+ref_brighten(
+    uint16_t top,
+    uint32_t evy
+) {
+    union color topc;
+    union color res;
+
+    topc.raw = top;
+    res.raw = 0;
+    res.red = topc.red + (((31 - topc.red) * evy) >> 4);
+    res.green = topc.green + (((31 - topc.green) * evy) >> 4);
+    res.blue = topc.blue + (((31 - topc.blue) * evy) >> 4);
+    return (res.raw);
+}
+
+static
+uint16_t
+ref_darken(
+    uint16_t top,
+    uint32_t evy
+) {
+    union color topc;
+    union color res;
+
+    topc.raw = top;
+    res.raw = 0;
+    res.red = topc.red - ((topc.red * evy) >> 4);
+    res.green = topc.green - ((topc.green * evy) >> 4);
+    res.blue = topc.blue - ((topc.blue * evy) >> 4);
+    return (res.raw);
+}
+
+/*
+** Run the given implementation over all the colors, twice: once on the whole aligned
+** buffer, and once shifted by one pixel so that the unaligned loads and the scalar tail
+** are exercised too.
+*/
+static
+bool
+check(
+    char const *name,
+    blend_alpha_fn alpha,
+    blend_fade_fn brighten,
+    blend_fade_fn darken
+) {
+    static uint16_t dst[NB_COLORS];
+    size_t errors;
+    uint32_t ev;
+    uint32_t evb;
+    uint32_t shift;
+    size_t g;
+    size_t i;
+
+    errors = 0;
+    for (shift = 0; shift <= 1; ++shift) {
+        size_t len;
+
+        len = NB_COLORS - shift * 3;
+
+        for (ev = 0; ev <= 16; ++ev) {
+            for (evb = 0; evb <= 16; ++evb) {
+                for (g = 0; g < 32; ++g) {
+                    alpha(dst, colors + shift, grays[g] + shift, ev, evb, len);
+                    for (i = 0; i < len; ++i) {
+                        errors += dst[i] != ref_alpha(colors[i + shift], grays[g][i + shift], ev, evb);
+                    }
+                }
+            }
+
+            brighten(dst, colors + shift, ev, len);
+            for (i = 0; i < len; ++i) {
+                errors += dst[i] != ref_brighten(colors[i + shift], ev);
+            }
+
+            darken(dst, colors + shift, ev, len);
+            for (i = 0; i < len; ++i) {
+                errors += dst[i] != ref_darken(colors[i + shift], ev);
+            }
+        }
+    }
+
+    printf("%-8s %s (%zu mismatches)\n", name, errors ? "FAIL" : "ok", errors);
+    return (!errors);
+}
+
+int
+main(
+    void
+) {
+    bool ok;
+    size_t g;
+    size_t i;
+
+    for (i = 0; i < NB_COLORS; ++i) {
+        colors[i] = i;
+        for (g = 0; g < 32; ++g) {
+            grays[g][i] = g | (g << 5) | (g << 10);
+        }
+    }
+
+    ok = check("scalar", blend_alpha_scalar, blend_brighten_scalar, blend_darken_scalar);
+
+#ifdef WITH_BLEND_SSE2
+    ok &= check("sse2", blend_alpha_sse2, blend_brighten_sse2, blend_darken_sse2);
+#endif
+
+#ifdef WITH_BLEND_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        ok &= check("avx2", blend_alpha_avx2, blend_brighten_avx2, blend_darken_avx2);
+    } else {
+        printf("avx2     skipped (unsupported by the host)\n");
+    }
+#endif
+
+#ifdef WITH_BLEND_NEON
+    ok &= check("neon", blend_alpha_neon, blend_brighten_neon, blend_darken_neon);
+#endif
+
+    return (ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
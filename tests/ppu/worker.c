@@ -0,0 +1,284 @@
+/******************************************************************************\
+**
+**  This file is part of the Hades GBA Emulator, and is made available under
+**  the terms of the GNU General Public License version 2.
+**
+**  Copyright (C) 2021-2022 - The Hades Authors
+**
+\******************************************************************************/
+
+/*
+** Check that the PPU worker renders exactly the same frames as `ppu_hblank()`.
+**
+** The same pseudo-random workload (VRAM, PALRAM, OAM and IO registers rewritten between
+** each frame, every video mode, windows, blending, affine layers, sprites...) is run three
+** times: with the worker disabled, enabled, and toggled every few frames. The hash of each
+** frame must be the same in the three runs.
+**
+** The wall time and the CPU time of the emulation thread of each run are printed too.
+**
+** Usage: test_ppu_worker [FRAMES]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "hades.h"
+#include "gba/gba.h"
+
+#define DEFAULT_FRAMES      600
+#define TOGGLE_PERIOD       37
+
+enum worker_mode {
+    WORKER_OFF,
+    WORKER_ON,
+    WORKER_TOGGLED,
+};
+
+static char const * const worker_modes_name[] = {
+    [WORKER_OFF]        = "off",
+    [WORKER_ON]         = "on",
+    [WORKER_TOGGLED]    = "toggled",
+};
+
+static uint64_t rng_state;
+
+static
+uint32_t
+rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return ((uint32_t)(rng_state >> 11));
+}
+
+static
+double
+now(
+    clockid_t clock
+) {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static
+uint64_t
+frame_hash(
+    struct gba const *gba
+) {
+    uint8_t const *data;
+    uint64_t hash;
+    size_t i;
+
+    data = (uint8_t const *)gba->framebuffer_frontend;
+    hash = 0xcbf29ce484222325ull;
+    for (i = 0; i < sizeof(gba->framebuffer_frontend); ++i) {
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+    return (hash);
+}
+
+static
+void
+write16(
+    struct gba *gba,
+    uint32_t addr,
+    uint16_t val
+) {
+    mem_write16(gba, addr, val, NON_SEQUENTIAL);
+}
+
+/*
+** Rewrite a random part of the PPU's state before frame `frame`.
+*/
+static
+void
+randomize_ppu(
+    struct gba *gba,
+    uint32_t frame
+) {
+    uint16_t dispcnt;
+    uint32_t addr;
+    size_t i;
+    size_t j;
+
+    if (frame % 16 == 0) {
+        for (addr = 0; addr < 0x18000; addr += 2) {
+            write16(gba, 0x06000000 + addr, rng() & ((frame & 32) ? 0x3333 : 0xFFFF));
+        }
+        for (addr = 0; addr < 0x400; addr += 2) {
+            write16(gba, 0x05000000 + addr, rng());
+            write16(gba, 0x07000000 + addr, rng());
+        }
+    } else {
+        for (i = 0; i < 200; ++i) {
+            write16(gba, 0x06000000 + (rng() % 0x18000 & ~1), rng());
+        }
+        for (i = 0; i < 50; ++i) {
+            mem_write8(gba, 0x06000000 + (rng() % 0x18000), rng(), NON_SEQUENTIAL);
+        }
+        for (i = 0; i < 20; ++i) {
+            mem_write32(gba, 0x06000000 + (rng() % 0x20000 & ~3), rng(), NON_SEQUENTIAL);
+        }
+        for (i = 0; i < 30; ++i) {
+            write16(gba, 0x05000000 + (rng() % 0x400 & ~1), rng());
+            write16(gba, 0x07000000 + (rng() % 0x400 & ~1), rng());
+        }
+
+        // Keep a few sprites small, on screen and non-affine.
+        for (i = 0; i < 16; ++i) {
+            addr = 0x07000000 + (rng() % 128) * 8;
+            write16(gba, addr + 0, (rng() % 160) | (rng() & 0xF000));
+            write16(gba, addr + 2, (rng() % 240) | (rng() & 0xF000));
+        }
+    }
+
+    // No forced blank, no CGB mode, and a majority of text modes.
+    dispcnt = rng() & ~0x0088;
+    if (frame % 4 == 0) {
+        dispcnt = (dispcnt & ~7) | (rng() % 3 ? 0 : 1);
+    } else if (frame % 4 == 1) {
+        dispcnt = (dispcnt & ~7) | (rng() % 6);
+    }
+    if (rng() % 4 == 0) {
+        dispcnt &= ~0xE000;
+    }
+    write16(gba, 0x04000000, dispcnt);
+
+    for (i = 0; i < 4; ++i) {
+        write16(gba, 0x04000008 + i * 2, rng() & ((rng() & 1) ? 0xFFFF : 0xFFBF));  // BGxCNT
+    }
+    for (i = 0; i < 8; ++i) {
+        write16(gba, 0x04000010 + i * 2, rng());                                    // BGxHOFS, BGxVOFS
+    }
+    for (i = 0; i < 2; ++i) {
+        addr = 0x04000020 + i * 16;                                                 // BG2/BG3 affine parameters
+        if (rng() & 1) {
+            write16(gba, addr + 0, 0x100);
+            write16(gba, addr + 2, 0);
+            write16(gba, addr + 4, 0);
+            write16(gba, addr + 6, 0x100);
+        } else {
+            for (j = 0; j < 4; ++j) {
+                write16(gba, addr + j * 2, (rng() & 0x3FF) - 0x200);
+            }
+        }
+        for (j = 0; j < 4; ++j) {
+            write16(gba, addr + 8 + j * 2, (rng() & 1) ? 0 : rng());
+        }
+    }
+    for (i = 0; i < 6; ++i) {
+        write16(gba, 0x04000040 + i * 2, rng());                                    // Windows
+    }
+    write16(gba, 0x0400004C, (rng() & 1) ? 0 : rng());                              // MOSAIC
+    write16(gba, 0x04000050, rng());                                                // BLDCNT
+    write16(gba, 0x04000052, (rng() & 0x1F1F) | ((rng() & 1) ? 0x1010 : 0));        // BLDALPHA
+    write16(gba, 0x04000054, rng());                                                // BLDY
+
+    gba->color_correction = (frame % 7 == 3);
+}
+
+/*
+** Run the workload for `frames` frames and store the hash of each one in `hashes`.
+*/
+static
+void
+run(
+    char const *rom_path,
+    enum worker_mode mode,
+    uint64_t *hashes,
+    uint32_t frames
+) {
+    static uint8_t bios[BIOS_SIZE];
+    struct gba *gba;
+    double wall;
+    double cpu;
+    uint32_t i;
+
+    rng_state = 0x123456789abcdefull;
+
+    gba = gba_new();
+    gba_message_push(gba, NEW_MESSAGE_AUDIO_RESAMPLE_FREQ(CYCLES_PER_SECOND / 1000));
+    gba_message_push(gba, NEW_MESSAGE_LOAD_BIOS(bios, NULL));
+    gba_message_push(gba, NEW_MESSAGE_LOAD_ROM(mem_rom_open(rom_path)));
+    gba_message_push(gba, NEW_MESSAGE_SKIP_BIOS(true));
+    gba_message_push(gba, NEW_MESSAGE_RESET());
+    gba_message_push(gba, NEW_MESSAGE_PPU_WORKER(mode == WORKER_ON));
+    gba_message_push(gba, NEW_MESSAGE_RUN(0));
+    gba_run_frames(gba, 1);
+
+    wall = now(CLOCK_MONOTONIC);
+    cpu = now(CLOCK_THREAD_CPUTIME_ID);
+    for (i = 0; i < frames; ++i) {
+        randomize_ppu(gba, i);
+        if (mode == WORKER_TOGGLED && i % TOGGLE_PERIOD == 0) {
+            gba_message_push(gba, NEW_MESSAGE_PPU_WORKER((i / TOGGLE_PERIOD) & 1));
+        }
+        gba_run_frames(gba, 1);
+        hashes[i] = frame_hash(gba);
+    }
+    wall = now(CLOCK_MONOTONIC) - wall;
+    cpu = now(CLOCK_THREAD_CPUTIME_ID) - cpu;
+
+    printf(
+        "worker %-8s %.3fs wall, %.3fs on the emulation thread (%.0f fps)\n",
+        worker_modes_name[mode],
+        wall,
+        cpu,
+        frames / wall
+    );
+
+    gba_delete(gba);
+}
+
+int
+main(
+    int argc,
+    char *argv[]
+) {
+    /*
+    ** `ldr r0, [pc]`, `add r1, r1, #1`, `b .-4`: keeps the core busy for the whole frame.
+    */
+    static uint32_t const rom[48] = { 0xE59F0000, 0xE2811001, 0xEAFFFFFC };
+    char rom_path[] = "/tmp/hades-test-XXXXXX";
+    uint64_t *hashes[ARRAY_LEN(worker_modes_name)];
+    uint32_t frames;
+    bool ok;
+    size_t mode;
+    uint32_t i;
+    int fd;
+
+    frames = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_FRAMES;
+
+    fd = mkstemp(rom_path);
+    hs_assert(fd >= 0 && write(fd, rom, sizeof(rom)) == sizeof(rom));
+    close(fd);
+
+    for (mode = 0; mode < ARRAY_LEN(hashes); ++mode) {
+        hashes[mode] = calloc(frames, sizeof(uint64_t));
+        hs_assert(hashes[mode]);
+        run(rom_path, mode, hashes[mode], frames);
+    }
+
+    unlink(rom_path);
+
+    ok = true;
+    for (mode = WORKER_ON; mode < ARRAY_LEN(hashes); ++mode) {
+        for (i = 0; i < frames; ++i) {
+            if (hashes[mode][i] != hashes[WORKER_OFF][i]) {
+                printf("worker %s: frame %u differs\n", worker_modes_name[mode], i);
+                ok = false;
+                break;
+            }
+        }
+        free(hashes[mode]);
+    }
+    free(hashes[WORKER_OFF]);
+
+    return (ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}